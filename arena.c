@@ -0,0 +1,112 @@
+/*
+ * This file is part of Re-Comprehend
+ *
+ * Ryan Mallon, 2015, <rmallon@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to
+ * the public domain worldwide. This software is distributed without
+ * any warranty.  You should have received a copy of the CC0 Public
+ * Domain Dedication along with this software. If not, see
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "util.h"
+
+#define ARENA_BLOCK_SIZE	(64 * 1024)
+#define ARENA_ALIGN		16
+
+struct arena_block {
+	struct arena_block	*next;
+	size_t			size;
+	size_t			used;
+	_Alignas(ARENA_ALIGN) unsigned char data[];
+};
+
+static struct arena_block *arena_new_block(struct arena *arena, size_t size)
+{
+	struct arena_block *block;
+
+	if (size < ARENA_BLOCK_SIZE)
+		size = ARENA_BLOCK_SIZE;
+
+	block = xmalloc(sizeof(*block) + size);
+	block->size = size;
+	block->used = 0;
+	block->next = arena->blocks;
+	arena->blocks = block;
+
+	return block;
+}
+
+/*
+ * Allocate zeroed memory from the arena.
+ */
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	struct arena_block *block = arena->blocks;
+	void *p;
+
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	if (!block || block->size - block->used < size)
+		block = arena_new_block(arena, size);
+
+	p = block->data + block->used;
+	block->used += size;
+
+	return p;
+}
+
+void *arena_memdup(struct arena *arena, const void *data, size_t size)
+{
+	void *p;
+
+	p = arena_alloc(arena, size);
+	if (size)
+		memcpy(p, data, size);
+
+	return p;
+}
+
+/*
+ * Copy a heap allocated array into the arena and free the original. Used
+ * for arrays which are grown while parsing and are then fixed in size.
+ */
+void *arena_move(struct arena *arena, void *data, size_t size)
+{
+	void *p;
+
+	p = arena_memdup(arena, data, size);
+	free(data);
+
+	return p;
+}
+
+char *arena_strndup(struct arena *arena, const char *str, size_t size)
+{
+	char *p;
+
+	p = arena_alloc(arena, size + 1);
+	memcpy(p, str, size);
+	p[size] = '\0';
+
+	return p;
+}
+
+void arena_free(struct arena *arena)
+{
+	struct arena_block *block, *next;
+
+	for (block = arena->blocks; block; block = next) {
+		next = block->next;
+		free(block);
+	}
+
+	arena->blocks = NULL;
+}
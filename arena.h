@@ -0,0 +1,38 @@
+/*
+ * This file is part of Re-Comprehend
+ *
+ * Ryan Mallon, 2015, <rmallon@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to
+ * the public domain worldwide. This software is distributed without
+ * any warranty.  You should have received a copy of the CC0 Public
+ * Domain Dedication along with this software. If not, see
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ */
+
+#ifndef _RECOMPREHEND_ARENA_H
+#define _RECOMPREHEND_ARENA_H
+
+#include <stddef.h>
+
+struct arena_block;
+
+/*
+ * Simple bump allocator. Allocations cannot be freed individually, the
+ * whole arena is released at once with arena_free. A zeroed arena is
+ * empty and ready to use.
+ */
+struct arena {
+	struct arena_block	*blocks;
+};
+
+void *arena_alloc(struct arena *arena, size_t size);
+void *arena_memdup(struct arena *arena, const void *data, size_t size);
+void *arena_move(struct arena *arena, void *data, size_t size);
+char *arena_strndup(struct arena *arena, const char *str, size_t size);
+void arena_free(struct arena *arena);
+
+#endif /* _RECOMPREHEND_ARENA_H */
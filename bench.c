@@ -0,0 +1,481 @@
+/*
+ * This file is part of Re-Comprehend
+ *
+ * Ryan Mallon, 2015, <rmallon@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to
+ * the public domain worldwide. This software is distributed without
+ * any warranty.  You should have received a copy of the CC0 Public
+ * Domain Dedication along with this software. If not, see
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ */
+
+/*
+ * Micro-benchmarks for the loader, parser, VM and renderer.
+ *
+ * Each benchmark is run for a number of warm-up samples, which are
+ * discarded, and then for the requested number of timed samples. A sample
+ * is one pass over the benchmark's whole workload, for example looking up
+ * every dictionary word once. Output is one tab separated line per
+ * benchmark, giving the number of operations in each sample and the
+ * distribution of the sample times in nanoseconds.
+ *
+ * Anything the game prints while a sample is running is discarded, and
+ * game specific opcodes are disabled so that functions which save, restore
+ * or exit can be run in isolation.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "recomprehend.h"
+#include "image_data.h"
+#include "dictionary.h"
+#include "game_data.h"
+#include "game_native.h"
+#include "graphics.h"
+#include "strings.h"
+#include "game.h"
+#include "util.h"
+
+extern struct comprehend_game game_transylvania;
+extern struct comprehend_game game_crimson_crown_1;
+extern struct comprehend_game game_crimson_crown_2;
+extern struct comprehend_game game_oo_topos;
+extern struct comprehend_game game_talisman;
+
+static struct comprehend_game *comprehend_games[] = {
+	&game_transylvania,
+	&game_crimson_crown_1,
+	&game_crimson_crown_2,
+	&game_oo_topos,
+	&game_talisman,
+};
+
+/* Used when the game directory has no commands.txt */
+static const char *default_commands[] = {
+	"look", "inventory", "north", "south", "east", "west", "up", "down",
+	"get lamp", "drop lamp", "examine door", "open door", "go north",
+	"pick up box", "xyzzy", "wait",
+};
+
+struct bench {
+	const char	*name;
+	bool		graphics;
+
+	/* Untimed preparation for each sample */
+	void		(*setup)(struct comprehend_game *game);
+
+	/* Run one sample, returning the number of operations */
+	size_t		(*run)(struct comprehend_game *game);
+
+	/* Untimed cleanup after each sample */
+	void		(*teardown)(struct comprehend_game *game);
+};
+
+static const char *bench_game_dir;
+static char **commands;
+static size_t nr_commands;
+
+static uint64_t time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int stdout_fd = -1;
+
+static void silence_stdout(void)
+{
+	int fd;
+
+	fflush(stdout);
+	fd = open("/dev/null", O_WRONLY);
+	if (fd < 0)
+		fatal_strerror(errno, "Cannot open /dev/null");
+
+	stdout_fd = dup(STDOUT_FILENO);
+	dup2(fd, STDOUT_FILENO);
+	close(fd);
+}
+
+static void restore_stdout(void)
+{
+	fflush(stdout);
+	dup2(stdout_fd, STDOUT_FILENO);
+	close(stdout_fd);
+	stdout_fd = -1;
+}
+
+static void setup_reset(struct comprehend_game *game)
+{
+	comprehend_reset_state(game, game->state);
+	game->state->update_flags = UPDATE_ALL;
+}
+
+static void setup_unload(struct comprehend_game *game)
+{
+	comprehend_unload_game(game);
+}
+
+static size_t bench_load_game(struct comprehend_game *game)
+{
+	comprehend_load_game(game, bench_game_dir);
+	return 1;
+}
+
+/*
+ * The string cache limit is set to zero for each sample, so that every
+ * lookup decodes the string again.
+ */
+static size_t saved_string_cache_limit;
+
+static void setup_decode_strings(struct comprehend_game *game)
+{
+	saved_string_cache_limit = string_cache_set_limit(0);
+}
+
+static void teardown_decode_strings(struct comprehend_game *game)
+{
+	string_cache_set_limit(saved_string_cache_limit);
+}
+
+static size_t bench_decode_strings(struct comprehend_game *game)
+{
+	struct game_info *info = game->info;
+	struct game_state *state = game->state;
+	size_t i;
+
+	for (i = 0; i < info->strings.nr_strings; i++)
+		string_table_lookup(&info->strings, &state->strings, i);
+	for (i = 0; i < info->strings2.nr_strings; i++)
+		string_table_lookup(&info->strings2, &state->strings2, i);
+
+	return info->strings.nr_strings + info->strings2.nr_strings;
+}
+
+static size_t bench_find_words(struct comprehend_game *game)
+{
+	struct game_info *info = game->info;
+	size_t i;
+
+	/* Every word, and a miss for each */
+	for (i = 0; i < info->nr_words; i++) {
+		dict_find_word_by_string(game, info->words[i].word);
+		dict_find_word_by_string(game, "xyzzy");
+	}
+
+	return info->nr_words * 2;
+}
+
+static size_t bench_play_commands(struct comprehend_game *game)
+{
+	char buffer[1024];
+	size_t i;
+
+	for (i = 0; i < nr_commands; i++) {
+		snprintf(buffer, sizeof(buffer), "%s", commands[i]);
+		comprehend_play_line(game, buffer);
+	}
+
+	return nr_commands;
+}
+
+static size_t bench_eval_functions(struct comprehend_game *game)
+{
+	struct game_info *info = game->info;
+	struct word verb = {"", 1, WORD_TYPE_VERB}, noun = {"", 0, 0};
+	struct word *word;
+	size_t i;
+
+	/*
+	 * Functions are run with a direction verb and the noun of the first
+	 * item, so that opcodes using the current verb and object have one.
+	 */
+	if (info->header.nr_items) {
+		noun.index = game->state->item[0].word;
+		noun.type = WORD_TYPE_NOUN;
+		word = find_dict_word_by_index(game, noun.index,
+					       WORD_TYPE_NOUN_MASK);
+		if (word) {
+			memcpy(noun.word, word->word, sizeof(noun.word));
+			noun.type = word->type;
+		}
+	}
+
+	for (i = 0; i < info->nr_functions; i++)
+		eval_function(game, &info->functions[i], &verb,
+			      info->header.nr_items ? &noun : NULL);
+
+	return info->nr_functions;
+}
+
+static size_t bench_draw_images(struct comprehend_game *game)
+{
+	struct game_info *info = game->info;
+	size_t i;
+
+	for (i = 0; i < info->room_images.nr_images; i++)
+		draw_image(&info->room_images, i);
+	for (i = 0; i < info->item_images.nr_images; i++)
+		draw_image(&info->item_images, i);
+
+	return info->room_images.nr_images + info->item_images.nr_images;
+}
+
+static void setup_floodfill(struct comprehend_game *game)
+{
+	g_clear_screen(G_COLOR_WHITE);
+	g_draw_box(20, 20, 300, 200, G_COLOR_BLACK);
+	g_draw_line(20, 110, 300, 20, G_COLOR_BLACK);
+}
+
+static size_t bench_floodfill(struct comprehend_game *game)
+{
+	g_floodfill(160, 150, G_COLOR_RED, G_COLOR_WHITE);
+	return 1;
+}
+
+static struct bench benches[] = {
+	{"load_game",		false,	setup_unload,	bench_load_game},
+	{"dict_find_word",	false,	NULL,		bench_find_words},
+	{"play_line",		false,	setup_reset,	bench_play_commands},
+	{"eval_function",	false,	setup_reset,	bench_eval_functions},
+	{"draw_image",		true,	NULL,		bench_draw_images},
+	{"floodfill",		true,	setup_floodfill, bench_floodfill},
+	{"decode_string",	false,	setup_decode_strings,
+	 bench_decode_strings,	teardown_decode_strings},
+};
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Nearest rank percentile of sorted samples */
+static uint64_t percentile(uint64_t *samples, size_t nr_samples,
+			   unsigned percent)
+{
+	size_t rank = (nr_samples * percent + 99) / 100;
+
+	return samples[rank ? rank - 1 : 0];
+}
+
+static void run_bench(struct comprehend_game *game, struct bench *bench,
+		      unsigned nr_warmup, unsigned nr_samples)
+{
+	uint64_t *samples, start, total = 0;
+	size_t ops = 0;
+	unsigned i;
+
+	samples = xmalloc(nr_samples * sizeof(*samples));
+	for (i = 0; i < nr_warmup + nr_samples; i++) {
+		if (bench->setup)
+			bench->setup(game);
+
+		silence_stdout();
+		start = time_ns();
+		ops = bench->run(game);
+		if (i >= nr_warmup)
+			samples[i - nr_warmup] = time_ns() - start;
+		restore_stdout();
+
+		if (bench->teardown)
+			bench->teardown(game);
+	}
+
+	qsort(samples, nr_samples, sizeof(*samples), compare_u64);
+	for (i = 0; i < nr_samples; i++)
+		total += samples[i];
+
+	printf("%s\t%u\t%zu\t%llu\t%llu\t%llu\t%llu\t%llu\t%llu\n",
+	       bench->name, nr_samples, ops,
+	       (unsigned long long)samples[0],
+	       (unsigned long long)percentile(samples, nr_samples, 50),
+	       (unsigned long long)percentile(samples, nr_samples, 90),
+	       (unsigned long long)percentile(samples, nr_samples, 99),
+	       (unsigned long long)samples[nr_samples - 1],
+	       (unsigned long long)(total / nr_samples));
+	fflush(stdout);
+	free(samples);
+}
+
+static void add_command(const char *line)
+{
+	commands = xrealloc(commands, (nr_commands + 1) * sizeof(*commands));
+	commands[nr_commands++] = xstrndup(line, strlen(line));
+}
+
+/*
+ * Load the commands to play. Re-Comprehend's own '!' commands are
+ * skipped, they are not game input and '!quit' would exit.
+ */
+static void load_commands(const char *filename)
+{
+	char line[1024];
+	FILE *fd;
+	size_t i;
+
+	fd = fopen(filename, "r");
+	if (!fd) {
+		for (i = 0; i < ARRAY_SIZE(default_commands); i++)
+			add_command(default_commands[i]);
+		return;
+	}
+
+	while (fgets(line, sizeof(line), fd))
+		if (line[0] != '!')
+			add_command(line);
+	fclose(fd);
+}
+
+static void usage(const char *progname)
+{
+	int i;
+
+	printf("Usage %s [OPTION]... GAME_NAME GAME_DIR\n", progname);
+	printf("\nOptions:\n");
+	printf("  -n, --samples=N               Timed samples (default 20)\n");
+	printf("  -W, --warmup=N                Warm-up samples (default 3)\n");
+	printf("  -b, --bench=NAME              Only run the named benchmark\n");
+	printf("  -s, --script=FILE             Commands for play_line\n");
+	printf("  -g, --no-graphics             Skip the graphics benchmarks\n");
+	printf("  -N, --native=FILE             Run functions with native code\n");
+
+	printf("\nBenchmarks:\n");
+	for (i = 0; i < ARRAY_SIZE(benches); i++)
+		printf("    %s\n", benches[i].name);
+
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	struct option long_opts[] = {
+		{"samples",		required_argument,	0, 'n'},
+		{"warmup",		required_argument,	0, 'W'},
+		{"bench",		required_argument,	0, 'b'},
+		{"script",		required_argument,	0, 's'},
+		{"no-graphics",		no_argument,		0, 'g'},
+		{"native",		required_argument,	0, 'N'},
+		{"help",		no_argument,		0, '?'},
+		{NULL,			0,			0, 0},
+	};
+	const char *short_opts = "n:W:b:s:gN:?";
+	struct comprehend_game *game;
+	struct game_ops bench_ops;
+	const char *game_name, *bench_name = NULL, *script = NULL;
+	char path[PATH_MAX];
+	unsigned nr_samples = 20, nr_warmup = 3;
+	bool graphics_enabled = true;
+	int i, c, opt_index;
+
+	while (1) {
+		c = getopt_long(argc, argv, short_opts, long_opts, &opt_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'n':
+			nr_samples = strtoul(optarg, NULL, 0);
+			if (nr_samples == 0)
+				usage(argv[0]);
+			break;
+
+		case 'W':
+			nr_warmup = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'b':
+			bench_name = optarg;
+			break;
+
+		case 's':
+			script = optarg;
+			break;
+
+		case 'g':
+			graphics_enabled = false;
+			break;
+
+		case 'N':
+			game_native_set_file(optarg);
+			break;
+
+		case '?':
+		default:
+			usage(argv[0]);
+			break;
+		}
+	}
+
+	if (optind >= argc || argc - optind != 2)
+		usage(argv[0]);
+
+	game_name = argv[optind++];
+	bench_game_dir = argv[optind++];
+
+	game = NULL;
+	for (i = 0; i < ARRAY_SIZE(comprehend_games); i++) {
+		if (strcmp(game_name, comprehend_games[i]->short_name) == 0) {
+			game = comprehend_games[i];
+			break;
+		}
+	}
+	if (!game) {
+		printf("Unknown game '%s'\n", game_name);
+		usage(argv[0]);
+	}
+
+	if (!script) {
+		snprintf(path, sizeof(path), "%s/commands.txt", bench_game_dir);
+		script = path;
+	}
+	load_commands(script);
+
+	/* Prompts read from stdin, make them see end of file */
+	if (!freopen("/dev/null", "r", stdin))
+		fatal_strerror(errno, "Cannot open /dev/null");
+
+	/* Allow running without a display */
+	if (graphics_enabled) {
+		setenv("SDL_VIDEODRIVER", "dummy", 0);
+		g_init(G_RENDER_WIDTH, G_RENDER_HEIGHT);
+	}
+
+	game->info = xmalloc(sizeof(*game->info));
+	comprehend_load_game(game, bench_game_dir);
+
+	bench_ops = *game->ops;
+	bench_ops.handle_special_opcode = NULL;
+	game->ops = &bench_ops;
+
+	printf("# benchmark\tsamples\tops\tmin_ns\tp50_ns\tp90_ns\tp99_ns\tmax_ns\tmean_ns\n");
+	for (i = 0; i < ARRAY_SIZE(benches); i++) {
+		if (bench_name && strcmp(bench_name, benches[i].name) != 0)
+			continue;
+		if (benches[i].graphics && !graphics_enabled)
+			continue;
+
+		run_bench(game, &benches[i], nr_warmup, nr_samples);
+	}
+
+	exit(EXIT_SUCCESS);
+}
@@ -19,43 +19,161 @@
 #include <string.h>
 
 #include "recomprehend.h"
+#include "arena.h"
+#include "hash_index.h"
 #include "game_data.h"
 #include "dictionary.h"
 
-static bool word_match(struct word *word, const char *string)
+#define NR_WORD_TYPE_BITS	8
+
+/*
+ * Dictionary words are looked up by their first six characters packed
+ * into an integer. Words shorter than six characters must match exactly,
+ * and six character words match any string starting with them, so a
+ * string matches a word exactly when their keys are equal.
+ */
+static uint64_t word_key(const char *string)
+{
+	uint64_t key = 0;
+	int i;
+
+	for (i = 0; i < 6 && string[i]; i++)
+		key |= (uint64_t)(uint8_t)string[i] << (i * 8);
+
+	return key;
+}
+
+static void dict_build_hash(struct game_info *info)
+{
+	size_t i;
+
+	hash_index_init(&info->word_hash, &info->arena, info->nr_words);
+	for (i = info->nr_words; i-- > 0; )
+		hash_index_add(&info->word_hash, word_key(info->words[i].word),
+			       i);
+}
+
+static void dict_build_index_table(struct game_info *info)
+{
+	struct word_index_table *table;
+	struct word *word;
+	size_t i;
+	int bit;
+
+	table = arena_alloc(&info->arena, sizeof(*table));
+	memset(table->first, 0xff, sizeof(table->first));
+	memset(table->by_type, 0xff, sizeof(table->by_type));
+	table->next = arena_alloc(&info->arena, info->nr_words *
+				  sizeof(*table->next));
+
+	/*
+	 * Add in reverse so that each chain is in dictionary order, and the
+	 * first word for each type bit is the earliest one.
+	 */
+	for (i = info->nr_words; i-- > 0; ) {
+		word = &info->words[i];
+		table->next[i] = table->first[word->index];
+		table->first[word->index] = i;
+
+		for (bit = 0; bit < NR_WORD_TYPE_BITS; bit++)
+			if (word->type & (1 << bit))
+				table->by_type[word->index][bit] = i;
+	}
+
+	info->word_table = table;
+}
+
+static uint64_t word_pair_key(uint8_t index1, uint8_t type1,
+			      uint8_t index2, uint8_t type2)
+{
+	return index1 | (type1 << 8) | (index2 << 16) | ((uint32_t)type2 << 24);
+}
+
+/*
+ * Word pairs are hashed by the index and type of both words. Only the
+ * first entry for each pair is used, since that is the one which matches.
+ */
+static void dict_build_pair_hash(struct game_info *info)
+{
+	struct word_map *map;
+	size_t i;
+
+	hash_index_init(&info->word_pair_hash, &info->arena,
+			info->nr_word_maps);
+	for (i = info->nr_word_maps; i-- > 0; ) {
+		map = &info->word_map[i];
+		hash_index_add(&info->word_pair_hash,
+			       word_pair_key(map->word[0].index,
+					     map->word[0].type,
+					     map->word[1].index,
+					     map->word[1].type), i);
+	}
+}
+
+/*
+ * Build the dictionary lookup indexes. Called once the game has been
+ * loaded, the indexes are allocated from the game's arena.
+ */
+void dict_build_index(struct comprehend_game *game)
+{
+	dict_build_hash(game->info);
+	dict_build_index_table(game->info);
+	dict_build_pair_hash(game->info);
+}
+
+/*
+ * Returns the word which the pair word1, word2 combines into, or NULL if
+ * the words are not a pair.
+ */
+struct word_index *dict_find_word_pair(struct comprehend_game *game,
+				       struct word *word1, struct word *word2)
 {
-	/* Words less than 6 characters must match exactly */
-	if (strlen(word->word) < 6 && strlen(string) != strlen(word->word))
-		return false;
+	uint32_t i;
 
-	return strncmp(word->word, string, strlen(word->word)) == 0;
+	i = hash_index_first(&game->info->word_pair_hash,
+			     word_pair_key(word1->index, word1->type,
+					   word2->index, word2->type));
+	if (i == HASH_INDEX_NONE)
+		return NULL;
+
+	return &game->info->word_map[i].word[2];
 }
 
 struct word *dict_find_word_by_string(struct comprehend_game *game,
 				      const char *string)
 {
-	int i;
+	uint32_t i;
 
 	if (!string)
 		return NULL;
 
-	for (i = 0; i < game->info->nr_words; i++)
-		if (word_match(&game->info->words[i], string))
-			return &game->info->words[i];
+	i = hash_index_first(&game->info->word_hash, word_key(string));
+	if (i == HASH_INDEX_NONE)
+		return NULL;
 
-	return NULL;
+	return &game->info->words[i];
 }
 
 struct word *dict_find_word_by_index_type(struct comprehend_game *game,
 					  uint8_t index, uint8_t type)
 {
-	int i;
-
-	for (i = 0; i < game->info->nr_words; i++) {
-		if (game->info->words[i].index == index &&
-		    game->info->words[i].type == type)
+	struct word_index_table *table = game->info->word_table;
+	uint32_t i;
+	int bit;
+
+	/* Every match has the lowest type bit, start from the first word with it */
+	for (bit = 0; bit < NR_WORD_TYPE_BITS; bit++)
+		if (type & (1 << bit))
+			break;
+
+	if (bit < NR_WORD_TYPE_BITS)
+		i = table->by_type[index][bit];
+	else
+		i = table->first[index];
+
+	for (; i != HASH_INDEX_NONE; i = table->next[i])
+		if (game->info->words[i].type == type)
 			return &game->info->words[i];
-	}
 
 	return NULL;
 }
@@ -63,26 +181,36 @@ struct word *dict_find_word_by_index_type(struct comprehend_game *game,
 struct word *find_dict_word_by_index(struct comprehend_game *game,
 				     uint8_t index, uint8_t type_mask)
 {
-	int i;
-
-	for (i = 0; i < game->info->nr_words; i++) {
-		if (game->info->words[i].index == index &&
-		    (game->info->words[i].type & type_mask) != 0)
-			return &game->info->words[i];
+	struct word_index_table *table = game->info->word_table;
+	uint32_t i, first = HASH_INDEX_NONE;
+	int bit;
+
+	/* The first match is the earliest first word for any bit in the mask */
+	for (bit = 0; bit < NR_WORD_TYPE_BITS; bit++) {
+		if (!(type_mask & (1 << bit)))
+			continue;
+
+		i = table->by_type[index][bit];
+		if (i < first)
+			first = i;
 	}
 
-	return NULL;
+	if (first == HASH_INDEX_NONE)
+		return NULL;
+
+	return &game->info->words[first];
 }
 
 bool dict_match_index_type(struct comprehend_game *game, const char *word,
 			   uint8_t index, uint8_t type_mask)
 {
-	int i;
+	uint32_t i;
 
-	for (i = 0; i < game->info->nr_words; i++)
+	for (i = hash_index_first(&game->info->word_hash, word_key(word));
+	     i != HASH_INDEX_NONE;
+	     i = game->info->word_hash.next[i])
 		if (game->info->words[i].index == index &&
-		    ((game->info->words[i].type & type_mask) != 0) &&
-		    word_match(&game->info->words[i], word))
+		    (game->info->words[i].type & type_mask) != 0)
 			return true;
 
 	return false;
@@ -21,13 +21,17 @@
 
 struct comprehend_game;
 struct word;
+struct word_index;
 
+void dict_build_index(struct comprehend_game *game);
 struct word *find_dict_word_by_index(struct comprehend_game *game,
 				     uint8_t index, uint8_t type_mask);
 struct word *dict_find_word_by_index_type(struct comprehend_game *game,
 					  uint8_t index, uint8_t type);
 struct word *dict_find_word_by_string(struct comprehend_game *game,
 				      const char *string);
+struct word_index *dict_find_word_pair(struct comprehend_game *game,
+				       struct word *word1, struct word *word2);
 bool dict_match_index_type(struct comprehend_game *game, const char *word,
 			   uint8_t index, uint8_t type_mask);
 
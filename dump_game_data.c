@@ -150,7 +150,11 @@ void dump_instruction(struct comprehend_game *game,
 		break;
 
 	case OPCODE_SET_STRING_REPLACEMENT:
-		printf(" %s", game->info->replace_words[instr->operand[0] - 1]);
+		if (instr->operand[0] == 0 ||
+		    instr->operand[0] > game->state->nr_replace_words)
+			printf(" [BAD_REPLACE_WORD(%.2x)]", instr->operand[0]);
+		else
+			printf(" %s", game->state->replace_words[instr->operand[0] - 1]);
 		break;
 	}
 
@@ -159,16 +163,18 @@ void dump_instruction(struct comprehend_game *game,
 
 static void dump_functions(struct comprehend_game *game)
 {
+	struct instruction *instructions;
 	struct function *func;
 	int i, j;
 
 	printf("Functions (%zd entries)\n", game->info->nr_functions);
 	for (i = 0; i < game->info->nr_functions; i++) {
 		func = &game->info->functions[i];
+		instructions = &game->info->instructions[func->first_instruction];
 
 		printf("[%.4x] (%zd instructions)\n", i, func->nr_instructions);
 		for (j = 0; j < func->nr_instructions; j++)
-			dump_instruction(game, NULL, &func->instructions[j]);
+			dump_instruction(game, NULL, &instructions[j]);
 		printf("\n");
 	}
 }
@@ -288,7 +294,7 @@ static void dump_rooms(struct comprehend_game *game)
 	/* Room zero acts as the players inventory */
 	printf("Rooms (%zd entries)\n", game->info->nr_rooms);
 	for (i = 1; i <= game->info->nr_rooms; i++) {
-		room = &game->info->rooms[i];
+		room = &game->state->rooms[i];
 
 		printf("  [%.2x] flags=%.2x, graphic=%.2x\n",
 		       i, room->flags, room->graphic);
@@ -314,7 +320,7 @@ static void dump_items(struct comprehend_game *game)
 
 	printf("Items (%zd entries)\n", game->info->header.nr_items);
 	for (i = 0; i < game->info->header.nr_items; i++) {
-		item = &game->info->item[i];
+		item = &game->state->item[i];
 
 		printf("  [%.2x] %s\n", i + 1,
 		       item->string_desc ?
@@ -340,10 +346,16 @@ static void dump_items(struct comprehend_game *game)
 
 static void dump_string_table(struct string_table *table)
 {
+	struct string_cache cache;
 	int i;
 
+	memset(&cache, 0, sizeof(cache));
+	string_table_decode_all(table, &cache);
 	for (i = 0; i < table->nr_strings; i++)
-		printf("[%.4x] %s\n", i, table->strings[i]);
+		printf("[%.4x] %s\n", i,
+		       string_table_lookup(table, &cache, i));
+
+	string_cache_free(&cache);
 }
 
 static void dump_game_data_strings(struct comprehend_game *game)
@@ -367,7 +379,7 @@ static void dump_replace_words(struct comprehend_game *game)
 	printf("Replacement words (%zd entries)\n",
 	       game->info->nr_replace_words);
 	for (i = 0; i < game->info->nr_replace_words; i++)
-		printf("  [%.2x] %s\n", i + 1, game->info->replace_words[i]);
+		printf("  [%.2x] %s\n", i + 1, game->state->replace_words[i]);
 }
 
 static void dump_header(struct comprehend_game *game)
@@ -0,0 +1,700 @@
+/*
+ * This file is part of Re-Comprehend
+ *
+ * Ryan Mallon, 2015, <rmallon@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to
+ * the public domain worldwide. This software is distributed without
+ * any warranty.  You should have received a copy of the CC0 Public
+ * Domain Dedication along with this software. If not, see
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ */
+
+/*
+ * The interpreter loop. This file is included several times by game.c, to
+ * build a traced version of eval_function for when debugging is enabled and
+ * release versions with all of the debug checks compiled out. EVAL_TRACED
+ * selects the version, EVAL_STEP is run after each instruction and
+ * EVAL_NAME gives its functions unique names.
+ */
+
+/*
+ * Returns the next instruction of the function to execute, starting from
+ * instr, or NULL if the function has finished. The rest of a command block
+ * is skipped in one step if its tests failed.
+ */
+static struct instruction *
+EVAL_NAME(next_instruction)(struct comprehend_game *game,
+			    struct function_state *func_state,
+			    struct instruction *instr,
+			    struct instruction *end)
+{
+	size_t skip;
+
+	for (; instr < end; instr += skip) {
+		skip = 1;
+
+		if (func_state->executed && !instr->is_command) {
+			/*
+			 * At least one command has been executed and the
+			 * current instruction is a test. Exit the function.
+			 */
+			return NULL;
+		}
+
+#if EVAL_TRACED
+		if (!instr->is_command) {
+			printf("? ");
+		} else {
+			if (func_state->test_result)
+				printf("+ ");
+			else
+				printf("- ");
+		}
+
+		dump_instruction(game, func_state, instr);
+#endif
+
+		if (func_state->or_count)
+			func_state->or_count--;
+
+		if (!instr->is_command) {
+			if (func_state->in_command) {
+				/*
+				 * Finished command sequence - clear test
+				 * result.
+				 */
+				func_state->in_command = false;
+				func_state->test_result = false;
+				func_state->and = false;
+			}
+			return instr;
+		}
+
+		func_state->in_command = true;
+
+		if (func_state->or_count != 0)
+			printf("Warning: or_count == %d\n",
+			       func_state->or_count);
+		func_state->or_count = 0;
+
+		if (func_state->test_result) {
+			func_state->else_result = false;
+			func_state->executed = true;
+			return instr;
+		}
+
+#if !EVAL_TRACED
+		/*
+		 * The tests failed, so none of the commands in the block will
+		 * run. Skip them all, the traced version still dumps each one.
+		 */
+		skip = instr->skip;
+		if (skip > end - instr)
+			skip = end - instr;
+#endif
+	}
+
+	return NULL;
+}
+
+static bool EVAL_NAME(eval_function)(struct comprehend_game *game,
+				     struct function *func,
+				     struct word *verb, struct word *noun)
+{
+#ifdef HAVE_THREADED_DISPATCH
+	static const void *const dispatch_table[NR_OPCODES] = {
+		[OPCODE_UNKNOWN] = &&op_default,
+		TARGET_ENTRY(TEST_FALSE),
+		TARGET_ENTRY(HAVE_OBJECT),
+		TARGET_ENTRY(OR),
+		TARGET_ENTRY(IN_ROOM),
+		TARGET_ENTRY(VAR_EQ),
+		TARGET_ENTRY(CURRENT_OBJECT_TAKEABLE),
+		TARGET_ENTRY(OBJECT_PRESENT),
+		TARGET_ENTRY(ELSE),
+		TARGET_ENTRY(OBJECT_IN_ROOM),
+		TARGET_ENTRY(OBJECT_NOT_VALID),
+		TARGET_ENTRY(INVENTORY_FULL),
+		TARGET_ENTRY(TEST_FLAG),
+		TARGET_ENTRY(CURRENT_OBJECT_IN_ROOM),
+		TARGET_ENTRY(HAVE_CURRENT_OBJECT),
+		TARGET_ENTRY(OBJECT_IS_NOT_NOWHERE),
+		TARGET_ENTRY(CURRENT_OBJECT_PRESENT),
+		TARGET_ENTRY(TEST_ROOM_FLAG),
+		TARGET_ENTRY(NOT_HAVE_OBJECT),
+		TARGET_ENTRY(NOT_IN_ROOM),
+		TARGET_ENTRY(CURRENT_OBJECT_IS_NOWHERE),
+		TARGET_ENTRY(OBJECT_NOT_PRESENT),
+		TARGET_ENTRY(OBJECT_NOT_IN_ROOM),
+		TARGET_ENTRY(TEST_NOT_FLAG),
+		TARGET_ENTRY(NOT_HAVE_CURRENT_OBJECT),
+		TARGET_ENTRY(OBJECT_IS_NOWHERE),
+		TARGET_ENTRY(CURRENT_OBJECT_NOT_PRESENT),
+		TARGET_ENTRY(CURRENT_OBJECT_NOT_TAKEABLE),
+		TARGET_ENTRY(TEST_NOT_ROOM_FLAG),
+		TARGET_ENTRY(INVENTORY),
+		TARGET_ENTRY(TAKE_OBJECT),
+		TARGET_ENTRY(MOVE_OBJECT_TO_ROOM),
+		TARGET_ENTRY(SAVE_ACTION),
+		TARGET_ENTRY(MOVE_TO_ROOM),
+		TARGET_ENTRY(VAR_ADD),
+		TARGET_ENTRY(SET_ROOM_DESCRIPTION),
+		TARGET_ENTRY(MOVE_OBJECT_TO_CURRENT_ROOM),
+		TARGET_ENTRY(VAR_SUB),
+		TARGET_ENTRY(SET_OBJECT_DESCRIPTION),
+		TARGET_ENTRY(SET_OBJECT_LONG_DESCRIPTION),
+		TARGET_ENTRY(MOVE),
+		TARGET_ENTRY(MOVE_DIRECTION),
+		TARGET_ENTRY(PRINT),
+		TARGET_ENTRY(REMOVE_OBJECT),
+		TARGET_ENTRY(SET_FLAG),
+		TARGET_ENTRY(CALL_FUNC),
+		TARGET_ENTRY(TURN_TICK),
+		TARGET_ENTRY(CLEAR_FLAG),
+		TARGET_ENTRY(INVENTORY_ROOM),
+		TARGET_ENTRY(TAKE_CURRENT_OBJECT),
+		TARGET_ENTRY(SPECIAL),
+		TARGET_ENTRY(DROP_OBJECT),
+		TARGET_ENTRY(DROP_CURRENT_OBJECT),
+		TARGET_ENTRY(SET_ROOM_GRAPHIC),
+		TARGET_ENTRY(SET_OBJECT_GRAPHIC),
+		TARGET_ENTRY(REMOVE_CURRENT_OBJECT),
+		[OPCODE_DO_VERB] = &&op_default,
+		TARGET_ENTRY(VAR_INC),
+		TARGET_ENTRY(VAR_DEC),
+		TARGET_ENTRY(MOVE_CURRENT_OBJECT_TO_ROOM),
+		TARGET_ENTRY(DESCRIBE_CURRENT_OBJECT),
+		TARGET_ENTRY(SET_STRING_REPLACEMENT),
+		TARGET_ENTRY(SET_CURRENT_NOUN_STRING_REPLACEMENT),
+		TARGET_ENTRY(CURRENT_NOT_OBJECT),
+		TARGET_ENTRY(CURRENT_IS_OBJECT),
+		TARGET_ENTRY(DRAW_ROOM),
+		TARGET_ENTRY(DRAW_OBJECT),
+		TARGET_ENTRY(WAIT_KEY),
+		TARGET_ENTRY(BAD_OPERAND),
+	};
+#endif
+	struct function_state state, *func_state = &state;
+	size_t base = game->state->nr_frames;
+	struct function_frame *frame;
+	struct instruction *instr, *end;
+	struct room *room;
+	struct item *item;
+	uint16_t index;
+	bool test;
+	int count;
+
+	instr = enter_function(game, func, func_state, &end);
+	instr = EVAL_NAME(next_instruction)(game, func_state, instr, end);
+	if (!instr)
+		goto function_return;
+
+#ifndef HAVE_THREADED_DISPATCH
+dispatch:
+#endif
+	switch (instr->op) {
+	TARGET(VAR_ADD):
+		game->state->variable[instr->arg[0]] +=
+			game->state->variable[instr->arg[1]];
+		NEXT();
+
+	TARGET(VAR_SUB):
+		game->state->variable[instr->arg[0]] -=
+			game->state->variable[instr->arg[1]];
+		NEXT();
+
+	TARGET(VAR_INC):
+		game->state->variable[instr->arg[0]]++;
+		NEXT();
+
+	TARGET(VAR_DEC):
+		game->state->variable[instr->arg[0]]--;
+		NEXT();
+
+	TARGET(VAR_EQ):
+		func_set_test_result(func_state,
+				     game->state->variable[instr->arg[0]] ==
+				     game->state->variable[instr->arg[1]]);
+		NEXT();
+
+	TARGET(TURN_TICK):
+		game->state->variable[VAR_TURN_COUNT]++;
+		NEXT();
+
+	TARGET(PRINT):
+		console_println_string(game, instr->arg[0]);
+		NEXT();
+
+	TARGET(TEST_NOT_ROOM_FLAG):
+		room = &game->state->rooms[game->state->current_room];
+		func_set_test_result(func_state,
+				     !(room->flags & instr->arg[0]));
+		NEXT();
+
+	TARGET(TEST_ROOM_FLAG):
+		room = &game->state->rooms[game->state->current_room];
+		func_set_test_result(func_state,
+				     room->flags & instr->arg[0]);
+		NEXT();
+
+	TARGET(NOT_IN_ROOM):
+		func_set_test_result(func_state,
+				     game->state->current_room != instr->arg[0]);
+		NEXT();
+
+	TARGET(IN_ROOM):
+		func_set_test_result(func_state,
+				     game->state->current_room == instr->arg[0]);
+		NEXT();
+
+	TARGET(MOVE_TO_ROOM):
+		if (instr->arg[0] == 0xff) {
+			/*
+			 * FIXME - Not sure what this is for. Transylvania
+			 * uses it in the 'go north' case when in room
+			 * 0x01 or 0x0c, and Oo-Topos uses it when you shoot
+			 * the alien. Ignore it for now.
+			 */
+			NEXT();
+		}
+
+		move_to(game, instr->arg[0]);
+		NEXT();
+
+	TARGET(MOVE):
+		/* Move in the direction dictated by the current verb */
+		room = &game->state->rooms[game->state->current_room];
+		if (verb->index - 1 >= NR_DIRECTIONS)
+			fatal_error("Bad verb %d:%d in move",
+				    verb->index, verb->type);
+
+		if (room->direction[verb->index - 1])
+			move_to(game, room->direction[verb->index - 1]);
+		else
+			console_println_string(game, STRING_CANT_GO);
+		NEXT();
+
+	TARGET(MOVE_DIRECTION):
+		room = &game->state->rooms[game->state->current_room];
+		if (room->direction[instr->arg[0]])
+			move_to(game, room->direction[instr->arg[0]]);
+		else
+			console_println_string(game, STRING_CANT_GO);
+		NEXT();
+
+	TARGET(ELSE):
+		func_state->test_result = func_state->else_result;
+		NEXT();
+
+	TARGET(MOVE_OBJECT_TO_CURRENT_ROOM):
+		item = &game->state->item[instr->arg[0]];
+		move_object(game, item, game->state->current_room);
+		NEXT();
+
+	TARGET(OBJECT_IN_ROOM):
+		item = &game->state->item[instr->arg[0]];
+		func_set_test_result(func_state,
+				     item->room == instr->arg[1]);
+		NEXT();
+
+	TARGET(OBJECT_NOT_IN_ROOM):
+		item = &game->state->item[instr->arg[0]];
+		func_set_test_result(func_state,
+				     item->room != instr->arg[1]);
+		NEXT();
+
+	TARGET(MOVE_OBJECT_TO_ROOM):
+		item = &game->state->item[instr->arg[0]];
+		move_object(game, item, instr->arg[1]);
+		NEXT();
+
+	TARGET(INVENTORY_FULL):
+		item = get_item_by_noun(game, noun);
+		func_set_test_result(func_state,
+				     game->state->variable[VAR_INVENTORY_WEIGHT] +
+				     (item->flags & ITEMF_WEIGHT_MASK) >
+				     game->state->variable[VAR_INVENTORY_LIMIT]);
+		NEXT();
+
+	TARGET(DESCRIBE_CURRENT_OBJECT):
+		/*
+		 * This opcode is only used in version 2
+		 * FIXME - unsure what the single operand is for.
+		 */
+		item = get_item_by_noun(game, noun);
+		printf("%s\n", string_lookup(game, item->long_string));
+		NEXT();
+
+	TARGET(CURRENT_OBJECT_IN_ROOM):
+		/* FIXME - use common code for these two ops */
+		test = false;
+
+		if (noun) {
+			for (item = first_item_with_word(game, noun->index);
+			     item; item = next_item_by_noun(game, item)) {
+				if (item->room == instr->arg[0]) {
+					test = true;
+					break;
+				}
+			}
+		}
+
+		func_set_test_result(func_state, test);
+		NEXT();
+
+	TARGET(CURRENT_OBJECT_NOT_PRESENT):
+		/* FIXME - use common code for these two ops */
+		item = get_item_by_noun(game, noun);
+		if (item)
+			func_set_test_result(func_state,
+					     item->room != game->state->current_room);
+		else
+			func_set_test_result(func_state, true);
+		NEXT();
+
+	TARGET(CURRENT_OBJECT_PRESENT):
+		item = get_item_by_noun(game, noun);
+		if (item)
+			func_set_test_result(func_state,
+					     item->room == game->state->current_room);
+		else
+			func_set_test_result(func_state, false);
+		NEXT();
+
+	TARGET(HAVE_OBJECT):
+		item = &game->state->item[instr->arg[0]];
+		func_set_test_result(func_state,
+				     item->room == ROOM_INVENTORY);
+		NEXT();
+
+	TARGET(NOT_HAVE_CURRENT_OBJECT):
+		item = get_item_by_noun(game, noun);
+		func_set_test_result(func_state,
+				     !item || item->room != ROOM_INVENTORY);
+		NEXT();
+
+	TARGET(HAVE_CURRENT_OBJECT):
+		item = get_item_by_noun(game, noun);
+		func_set_test_result(func_state,
+				     item->room == ROOM_INVENTORY);
+		NEXT();
+
+	TARGET(NOT_HAVE_OBJECT):
+		item = &game->state->item[instr->arg[0]];
+		func_set_test_result(func_state,
+				     item->room != ROOM_INVENTORY);
+		NEXT();
+
+	TARGET(CURRENT_OBJECT_TAKEABLE):
+		item = get_item_by_noun(game, noun);
+		if (!item)
+			func_set_test_result(func_state, false);
+		else
+			func_set_test_result(func_state,
+					     (item->flags & ITEMF_CAN_TAKE));
+		NEXT();
+
+	TARGET(CURRENT_OBJECT_NOT_TAKEABLE):
+		item = get_item_by_noun(game, noun);
+		if (!item)
+			func_set_test_result(func_state, true);
+		else
+			func_set_test_result(func_state,
+					     !(item->flags & ITEMF_CAN_TAKE));
+		NEXT();
+
+	TARGET(CURRENT_OBJECT_IS_NOWHERE):
+		item = get_item_by_noun(game, noun);
+		if (!item)
+			func_set_test_result(func_state, false);
+		else
+			func_set_test_result(func_state,
+					     item->room == ROOM_NOWHERE);
+		NEXT();
+
+	TARGET(OBJECT_IS_NOWHERE):
+		item = &game->state->item[instr->arg[0]];
+		func_set_test_result(func_state,
+				     item->room == ROOM_NOWHERE);
+		NEXT();
+
+	TARGET(OBJECT_IS_NOT_NOWHERE):
+		item = &game->state->item[instr->arg[0]];
+		func_set_test_result(func_state,
+				     item->room != ROOM_NOWHERE);
+		NEXT();
+
+	TARGET(OBJECT_NOT_PRESENT):
+		item = &game->state->item[instr->arg[0]];
+		func_set_test_result(func_state,
+				     item->room != game->state->current_room);
+		NEXT();
+
+	TARGET(OBJECT_PRESENT):
+		item = &game->state->item[instr->arg[0]];
+		func_set_test_result(func_state,
+				     item->room == game->state->current_room);
+		NEXT();
+
+	TARGET(OBJECT_NOT_VALID):
+		/* FIXME - should be called OPCODE_CURRENT_OBJECT_NOT_VALID */
+		func_set_test_result(func_state, !noun ||
+				     (noun->type & WORD_TYPE_NOUN_MASK) == 0);
+		NEXT();
+
+	TARGET(CURRENT_IS_OBJECT):
+		func_set_test_result(func_state,
+				     get_item_by_noun(game, noun) != NULL);
+		NEXT();
+
+	TARGET(CURRENT_NOT_OBJECT):
+		func_set_test_result(func_state,
+				     get_item_by_noun(game, noun) == NULL);
+		NEXT();
+
+	TARGET(REMOVE_OBJECT):
+		item = &game->state->item[instr->arg[0]];
+		move_object(game, item, ROOM_NOWHERE);
+		NEXT();
+
+	TARGET(REMOVE_CURRENT_OBJECT):
+		item = get_item_by_noun(game, noun);
+		move_object(game, item, ROOM_NOWHERE);
+		NEXT();
+
+	TARGET(INVENTORY):
+		count = num_objects_in_room(game, ROOM_INVENTORY);
+		if (count == 0) {
+			console_println_string(game, STRING_INVENTORY_EMPTY);
+			NEXT();
+		}
+
+		console_println_string(game, STRING_INVENTORY);
+		for (item = first_item_in_room(game, ROOM_INVENTORY); item;
+		     item = next_item_in_room(game, item))
+			printf("%s\n", string_lookup(game, item->string_desc));
+		NEXT();
+
+	TARGET(INVENTORY_ROOM):
+		count = num_objects_in_room(game, instr->arg[0]);
+		if (count == 0) {
+			console_println_string(game, instr->arg[1] + 1);
+			NEXT();
+		}
+
+		console_println_string(game, instr->arg[1]);
+		for (item = first_item_in_room(game, instr->arg[0]); item;
+		     item = next_item_in_room(game, item))
+			printf("%s\n", string_lookup(game, item->string_desc));
+		NEXT();
+
+	TARGET(MOVE_CURRENT_OBJECT_TO_ROOM):
+		item = get_item_by_noun(game, noun);
+		if (!item)
+			fatal_error("Bad current object\n");
+
+		move_object(game, item, instr->arg[0]);
+		NEXT();
+
+	TARGET(DROP_OBJECT):
+		item = &game->state->item[instr->arg[0]];
+		move_object(game, item, game->state->current_room);
+		NEXT();
+
+	TARGET(DROP_CURRENT_OBJECT):
+		item = get_item_by_noun(game, noun);
+		if (!item)
+			fatal_error("Attempt to take object failed\n");
+
+		move_object(game, item, game->state->current_room);
+		NEXT();
+
+	TARGET(TAKE_CURRENT_OBJECT):
+		item = get_item_by_noun(game, noun);
+		if (!item)
+			fatal_error("Attempt to take object failed\n");
+
+		move_object(game, item, ROOM_INVENTORY);
+		NEXT();
+
+	TARGET(TAKE_OBJECT):
+		item = &game->state->item[instr->arg[0]];
+		move_object(game, item, ROOM_INVENTORY);
+		NEXT();
+
+	TARGET(TEST_FLAG):
+		func_set_test_result(func_state,
+				     game->state->flags[instr->arg[0]]);
+		NEXT();
+
+	TARGET(TEST_NOT_FLAG):
+		func_set_test_result(func_state,
+				     !game->state->flags[instr->arg[0]]);
+		NEXT();
+
+	TARGET(CLEAR_FLAG):
+		game->state->flags[instr->arg[0]] = false;
+		NEXT();
+
+	TARGET(SET_FLAG):
+		game->state->flags[instr->arg[0]] = true;
+		NEXT();
+
+	TARGET(OR):
+		if (func_state->or_count) {
+			func_state->or_count += 2;
+		} else {
+			func_state->test_result = false;
+			func_state->or_count += 3;
+		}
+		NEXT();
+
+	TARGET(SET_OBJECT_DESCRIPTION):
+		item = &game->state->item[instr->arg[0]];
+		item->string_desc = instr->arg[1];
+		NEXT();
+
+	TARGET(SET_OBJECT_LONG_DESCRIPTION):
+		item = &game->state->item[instr->arg[0]];
+		item->long_string = instr->arg[1];
+		NEXT();
+
+	TARGET(SET_ROOM_DESCRIPTION):
+		room = &game->state->rooms[instr->arg[0]];
+		room->string_desc = instr->arg[1];
+		NEXT();
+
+	TARGET(SET_OBJECT_GRAPHIC):
+		item = &game->state->item[instr->arg[0]];
+		item->graphic = instr->arg[1];
+		if (item->room == game->state->current_room)
+			game->state->update_flags |= UPDATE_GRAPHICS;
+		NEXT();
+
+	TARGET(SET_ROOM_GRAPHIC):
+		room = &game->state->rooms[instr->arg[0]];
+		room->graphic = instr->arg[1];
+		if (instr->arg[0] == game->state->current_room)
+			game->state->update_flags |= UPDATE_GRAPHICS;
+		NEXT();
+
+	TARGET(CALL_FUNC):
+		index = instr->arg[0];
+#if EVAL_TRACED
+		debug_printf(DEBUG_FUNCTIONS,
+			     "Calling subfunction %.4x\n", index);
+#endif
+		if (!push_function_frame(game->state, func_state, instr, end)) {
+			call_depth_exceeded(index);
+			game->state->nr_frames = base;
+			return false;
+		}
+
+		func = &game->info->functions[index];
+		instr = enter_function(game, func, func_state, &end);
+		instr = EVAL_NAME(next_instruction)(game, func_state, instr, end);
+		if (!instr)
+			goto function_return;
+		DISPATCH();
+
+	TARGET(TEST_FALSE):
+		/*
+		 * FIXME - not sure what this is for. In Transylvania
+		 * it is opcode 0x50 and is used when attempting to
+		 * take the bar in the cellar. If it returns true then
+		 * the response is "there's none here".
+		 */
+		func_set_test_result(func_state, false);
+		NEXT();
+
+	TARGET(SAVE_ACTION):
+		/*
+		 * FIXME - This saves the current verb and allows the next
+		 * command to use just the noun. This is used to allow
+		 * responses to ask the player what they meant, e.g:
+		 *
+		 *   > drop
+		 *   I don't understand what you want to drop.
+		 *   > gun
+		 *   Okay.
+		 */
+		NEXT();
+
+	TARGET(SET_STRING_REPLACEMENT):
+		game->state->current_replace_word = instr->arg[0];
+		NEXT();
+
+	TARGET(SET_CURRENT_NOUN_STRING_REPLACEMENT):
+		/*
+		 * FIXME - Not sure what the operand is for,
+		 * maybe capitalisation?
+		 */
+		if (noun && (noun->type & WORD_TYPE_NOUN_PLURAL))
+			game->state->current_replace_word = 3;
+		else if (noun && (noun->type & WORD_TYPE_FEMALE))
+			game->state->current_replace_word = 0;
+		else if (noun && (noun->type & WORD_TYPE_MALE))
+			game->state->current_replace_word = 1;
+		else
+			game->state->current_replace_word = 2;
+		NEXT();
+
+	TARGET(DRAW_ROOM):
+		draw_location_image(&game->info->room_images,
+				    instr->arg[0] - 1);
+		NEXT();
+
+	TARGET(DRAW_OBJECT):
+		draw_image(&game->info->item_images, instr->arg[0] - 1);
+		NEXT();
+
+	TARGET(WAIT_KEY):
+		console_wait_key();
+		NEXT();
+
+	TARGET(BAD_OPERAND):
+		fatal_error("Bad operand in instruction %.2x(%.2x, %.2x, %.2x)\n",
+			    instr->opcode, instr->operand[0],
+			    instr->operand[1], instr->operand[2]);
+		NEXT();
+
+	TARGET(SPECIAL):
+		/* Game specific opcode */
+		if (game->ops->handle_special_opcode)
+			game->ops->handle_special_opcode(game,
+							 instr->arg[0]);
+		NEXT();
+
+	TARGET_DEFAULT:
+		if (instr->opcode & 0x80) {
+#if EVAL_TRACED
+			debug_printf(DEBUG_FUNCTIONS,
+				     "Unhandled command opcode %.2x\n",
+				     instr->opcode);
+#endif
+		} else {
+#if EVAL_TRACED
+			debug_printf(DEBUG_FUNCTIONS,
+				     "Unhandled test opcode %.2x - returning false\n",
+				     instr->opcode);
+#endif
+			func_set_test_result(func_state, false);
+		}
+		NEXT();
+	}
+
+function_return:
+	/* Resume the caller if this was a subfunction */
+	if (game->state->nr_frames == base)
+		return true;
+
+	frame = &game->state->frames[--game->state->nr_frames];
+	state = frame->func_state;
+	instr = frame->instr;
+	end = frame->end;
+	NEXT();
+}
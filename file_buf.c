@@ -15,14 +15,16 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <stdbool.h>
 #include <unistd.h>
 #include <stdint.h>
-#include <endian.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <fcntl.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "file_buf.h"
 #include "util.h"
@@ -30,26 +32,42 @@
 int file_buf_map_may_fail(const char *filename, struct file_buf *fb)
 {
 	struct stat s;
-	FILE *fd;
+	uint8_t *data;
+	int fd, err;
 
 	memset(fb, 0, sizeof(*fb));
 
-	fd = fopen(filename, "rb");
-	if (!fd)
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
 		return -errno;
 
-	fstat(fileno(fd), &s);
+	if (fstat(fd, &s) != 0) {
+		err = -errno;
+		close(fd);
+		return err;
+	}
 
-	fb->data = xmalloc(s.st_size);
 	fb->size = s.st_size;
-	fread(fb->data, 1, fb->size, fd);
-	fclose(fd);
+	if (fb->size) {
+		data = mmap(NULL, fb->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED) {
+			fb->mapped = true;
+		} else {
+			/* Not everything can be mapped, fall back to reading */
+			data = xmalloc(fb->size);
+			if (read(fd, data, fb->size) != fb->size) {
+				err = -errno;
+				free(data);
+				close(fd);
+				return err ? err : -EIO;
+			}
+		}
 
-	fb->p = fb->data;
+		fb->data = data;
+	}
 
-	// FIXME - remove
-	fb->marked = malloc(fb->size);
-	memset(fb->marked, 0, fb->size);
+	close(fd);
+	fb->p = fb->data;
 
 	return 0;
 }
@@ -60,13 +78,92 @@ void file_buf_map(const char *filename, struct file_buf *fb)
 
 	err = file_buf_map_may_fail(filename, fb);
 	if (err)
-		fatal_strerror(errno, "Cannot open file '%s'", filename);
+		fatal_strerror(-err, "Cannot open file '%s'", filename);
 }
 
 void file_buf_unmap(struct file_buf *fb)
 {
+	if (fb->mapped)
+		munmap((void *)fb->data, fb->size);
+	else
+		free((void *)fb->data);
 	free(fb->marked);
-	free(fb->data);
+}
+
+struct file_cache_entry {
+	char			*filename;
+	struct file_buf		fb;
+	bool			ready;		/* fb has been mapped */
+	struct file_cache_entry	*next;
+};
+
+/*
+ * Files may be mapped from the loader threads. The lock only covers the
+ * list of entries, files are mapped outside of it so that different files
+ * can be opened at once. Threads wanting a file which another thread is
+ * still mapping wait on file_cache_ready.
+ */
+static pthread_mutex_t file_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t file_cache_ready = PTHREAD_COND_INITIALIZER;
+
+/*
+ * Returns the mapping of filename in the cache, mapping it the first time
+ * it is requested. The returned file_buf must not be modified, callers
+ * read from a copy of it. Safe to call from multiple threads.
+ */
+const struct file_buf *file_cache_map(struct file_cache *cache,
+				      const char *filename)
+{
+	struct file_cache_entry *entry;
+
+	pthread_mutex_lock(&file_cache_lock);
+
+	for (entry = cache->entries; entry; entry = entry->next)
+		if (strcmp(entry->filename, filename) == 0)
+			goto out;
+
+	/* Add the entry before mapping so that other threads wait for it */
+	entry = xmalloc(sizeof(*entry));
+	entry->filename = xstrndup(filename, strlen(filename));
+	entry->next = cache->entries;
+	cache->entries = entry;
+	pthread_mutex_unlock(&file_cache_lock);
+
+	file_buf_map(filename, &entry->fb);
+
+	pthread_mutex_lock(&file_cache_lock);
+	entry->ready = true;
+	pthread_cond_broadcast(&file_cache_ready);
+
+out:
+	while (!entry->ready)
+		pthread_cond_wait(&file_cache_ready, &file_cache_lock);
+	pthread_mutex_unlock(&file_cache_lock);
+	return &entry->fb;
+}
+
+void file_cache_free(struct file_cache *cache)
+{
+	struct file_cache_entry *entry, *next;
+
+	for (entry = cache->entries; entry; entry = next) {
+		next = entry->next;
+		file_buf_unmap(&entry->fb);
+		free(entry->filename);
+		free(entry);
+	}
+
+	cache->entries = NULL;
+}
+
+/*
+ * Start recording which bytes of the file are read, for use with
+ * file_buf_show_unmarked. This slows down all reads from the file.
+ */
+void file_buf_track_reads(struct file_buf *fb)
+{
+	if (!fb->marked)
+		fb->marked = xmalloc((fb->size + 7) / 8);
 }
 
 void file_buf_set_pos(struct file_buf *fb, unsigned pos)
@@ -78,19 +175,14 @@ void file_buf_set_pos(struct file_buf *fb, unsigned pos)
 	fb->p = fb->data + pos;
 }
 
-unsigned file_buf_get_pos(struct file_buf *fb)
-{
-	return fb->p - fb->data;
-}
-
-void *file_buf_data_pointer(struct file_buf *fb)
+const void *file_buf_data_pointer(struct file_buf *fb)
 {
 	return fb->p;
 }
 
 size_t file_buf_strlen(struct file_buf *fb, bool *eof)
 {
-	uint8_t *end;
+	const uint8_t *end;
 
 	if (eof)
 		*eof = false;
@@ -106,44 +198,47 @@ size_t file_buf_strlen(struct file_buf *fb, bool *eof)
 	return end - fb->p;
 }
 
+static bool file_buf_is_marked(struct file_buf *fb, size_t pos)
+{
+	return fb->marked[pos / 8] & (1 << (pos % 8));
+}
+
 void file_buf_get_data(struct file_buf *fb, void *data, size_t data_size)
 {
-	if (file_buf_get_pos(fb) + data_size > fb->size)
+	size_t i, pos = file_buf_get_pos(fb);
+
+	if (data_size > fb->size - pos)
 		fatal_error("Not enough data in file (%x + %x > %x)\n",
-			    file_buf_get_pos(fb), data_size, fb->size);
+			    pos, data_size, fb->size);
 
 	if (data)
 		memcpy(data, fb->p, data_size);
 
 	/* Mark this region of the file as read */
-	memset(fb->marked + file_buf_get_pos(fb), '?', data_size);
+	if (fb->marked)
+		for (i = pos; i < pos + data_size; i++)
+			fb->marked[i / 8] |= 1 << (i % 8);
 
 	fb->p += data_size;
 }
 
-void file_buf_get_u8(struct file_buf *fb, uint8_t *val)
-{
-	file_buf_get_data(fb, val, sizeof(*val));
-}
-
-void file_buf_get_le16(struct file_buf *fb, uint16_t *val)
-{
-	file_buf_get_data(fb, val, sizeof(*val));
-	*val = le16toh(*val);
-}
-
 /*
  * Debugging function to show regions of a file that have not been read.
+ * Reads are only recorded after file_buf_track_reads has been called.
  */
 void file_buf_show_unmarked(struct file_buf *fb)
 {
 	int i, start = -1;
 
+	if (!fb->marked)
+		return;
+
 	for (i = 0; i < fb->size; i++) {
-		if (!fb->marked[i] && start == -1)
+		if (!file_buf_is_marked(fb, i) && start == -1)
 			start = i;
 
-		if ((fb->marked[i] || i == fb->size - 1) && start != -1) {
+		if ((file_buf_is_marked(fb, i) || i == fb->size - 1) &&
+		    start != -1) {
 			printf("%.4x - %.4x unmarked (%d bytes)\n", 
 			       start, i - 1, i - start);
 			start = -1;
@@ -20,28 +20,87 @@
 #include <stdint.h>
 #include <stdio.h>
 
+/*
+ * Read-only view of a file. The file is mapped directly when possible,
+ * so the data must never be written to.
+ */
 struct file_buf {
-	uint8_t		*data;
+	const uint8_t	*data;
 	size_t		size;
-	uint8_t		*p;
+	const uint8_t	*p;
+	bool		mapped;
 
+	/* Bitmap of bytes which have been read, only used for debugging */
 	uint8_t		*marked;
 };
 
+struct file_cache_entry;
+
+/*
+ * The files used while loading a game. Each distinct file is only mapped
+ * once, and stays mapped until the cache is freed. A zeroed cache is
+ * empty and ready to use.
+ */
+struct file_cache {
+	struct file_cache_entry	*entries;
+};
+
 void file_buf_map(const char *filename, struct file_buf *fb);
 int file_buf_map_may_fail(const char *filename, struct file_buf *fb);
 void file_buf_unmap(struct file_buf *fb);
+const struct file_buf *file_cache_map(struct file_cache *cache,
+				      const char *filename);
+void file_cache_free(struct file_cache *cache);
+
+void file_buf_track_reads(struct file_buf *fb);
 void file_buf_show_unmarked(struct file_buf *fb);
 
-void *file_buf_data_pointer(struct file_buf *fb);
+const void *file_buf_data_pointer(struct file_buf *fb);
 void file_buf_set_pos(struct file_buf *fb, unsigned pos);
-unsigned file_buf_get_pos(struct file_buf *fb);
 
 size_t file_buf_strlen(struct file_buf *fb, bool *eof);
 
 void file_buf_get_data(struct file_buf *fb, void *data, size_t data_size);
-void file_buf_get_u8(struct file_buf *fb, uint8_t *val);
-void file_buf_get_le16(struct file_buf *fb, uint16_t *val);
+
+static inline unsigned file_buf_get_pos(struct file_buf *fb)
+{
+	return fb->p - fb->data;
+}
+
+/*
+ * The single value accessors are used for every image opcode and most of
+ * the game data, so handle the common case inline. Reads which overrun
+ * the file, or which need to be marked, go through file_buf_get_data.
+ */
+static inline bool file_buf_fast_read(struct file_buf *fb, size_t size)
+{
+	return !fb->marked && fb->size - file_buf_get_pos(fb) >= size;
+}
+
+static inline void file_buf_get_u8(struct file_buf *fb, uint8_t *val)
+{
+	if (!file_buf_fast_read(fb, sizeof(*val))) {
+		file_buf_get_data(fb, val, sizeof(*val));
+		return;
+	}
+
+	*val = *fb->p++;
+}
+
+static inline void file_buf_get_le16(struct file_buf *fb, uint16_t *val)
+{
+	uint8_t buf[2];
+
+	if (!file_buf_fast_read(fb, sizeof(*val))) {
+		file_buf_get_data(fb, buf, sizeof(buf));
+	} else {
+		buf[0] = fb->p[0];
+		buf[1] = fb->p[1];
+		fb->p += 2;
+	}
+
+	*val = buf[0] | (buf[1] << 8);
+}
 
 #define file_buf_get_array(fb, type, base, array, member, size)		\
 	do {								\
@@ -19,6 +19,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <limits.h>
+#include <errno.h>
 #include <stdio.h>
 #include <ctype.h>
 
@@ -29,8 +30,8 @@
 #include "graphics.h"
 #include "strings.h"
 #include "game.h"
+#include "game_native.h"
 #include "util.h"
-#include "opcode_map.h"
 
 struct sentence {
 	struct word	words[4];
@@ -44,105 +45,261 @@ static void console_init(void)
 	ioctl(STDOUT_FILENO, TIOCGWINSZ, &console_winsize);
 }
 
+/*
+ * In batch mode player input, including the answers to prompts, is read
+ * from a script instead of stdin.
+ */
+static FILE *console_script;
+
+void console_set_script(const char *filename)
+{
+	console_script = fopen(filename, "r");
+	if (!console_script)
+		fatal_strerror(errno, "Cannot open script '%s'", filename);
+}
+
+static struct console_input *console_input;
+
+/*
+ * Record the input read from now on into input, so that it can be read
+ * again by console_input_replay. Recordings can be nested.
+ */
+void console_input_record(struct console_input *input)
+{
+	memset(input, 0, sizeof(*input));
+	input->parent = console_input;
+	console_input = input;
+}
+
+/*
+ * Replay the recorded input. Once the recording has been used up, input
+ * is read as normal again.
+ */
+void console_input_replay(struct console_input *input)
+{
+	input->replay = true;
+	input->next = 0;
+}
+
+void console_input_end(struct console_input *input)
+{
+	size_t i;
+
+	console_input = input->parent;
+	for (i = 0; i < input->nr_lines; i++)
+		free(input->lines[i]);
+	free(input->lines);
+}
+
+static char *console_read(struct console_input *input, char *buffer,
+			  size_t size, FILE *fd)
+{
+	if (!input)
+		return fgets(buffer, size, fd);
+
+	if (input->replay && input->next < input->nr_lines) {
+		snprintf(buffer, size, "%s", input->lines[input->next++]);
+		return buffer;
+	}
+
+	if (!console_read(input->parent, buffer, size, fd))
+		return NULL;
+
+	if (!input->replay) {
+		input->lines = grow_array(input->lines, &input->nr_allocated,
+					  input->nr_lines + 1,
+					  sizeof(*input->lines));
+		input->lines[input->nr_lines++] = xstrndup(buffer,
+							   strlen(buffer));
+	}
+
+	return buffer;
+}
+
+/*
+ * Read a line of player input. Lines read from a script are echoed so
+ * that the output reads like an interactive session. The game exits at
+ * the end of the input.
+ */
+char *console_get_line(char *buffer, size_t size)
+{
+	FILE *fd = console_script ? console_script : stdin;
+
+	if (!console_read(console_input, buffer, size, fd)) {
+		fflush(stdout);
+		exit(EXIT_SUCCESS);
+	}
+
+	if (console_script) {
+		fputs(buffer, stdout);
+		if (!strchr(buffer, '\n'))
+			putchar('\n');
+	}
+
+	return buffer;
+}
+
 int console_get_key(void)
 {
-	int c, dummy;
+	char buffer[1024];
+	int c;
+
+	if (console_script)
+		return console_get_line(buffer, sizeof(buffer))[0];
 
-	dummy = c = getchar();
+	if (!console_read(console_input, buffer, sizeof(buffer), stdin))
+		return EOF;
+	c = (unsigned char)buffer[0];
 
 	/* Clear input buffer */
-	while (dummy != '\n' && dummy != EOF)
-		dummy = getchar();
+	while (!strchr(buffer, '\n') &&
+	       console_read(console_input, buffer, sizeof(buffer), stdin))
+		;
 
 	return c;
 }
 
-void console_println(struct comprehend_game *game, const char *text)
+/*
+ * Wait for a key press before continuing. Batch mode doesn't wait, so the
+ * script only needs to hold commands and the answers to prompts.
+ */
+void console_wait_key(void)
 {
-	const char *replace, *word, *p = text;
-	char bad_word[64];
-	size_t line_length = 0;
-	int word_len;
+	if (!console_script)
+		console_get_key();
+}
 
-	if (!text) {
-		printf("\n");
-		return;
+/* Output for the line being printed by console_println */
+static char *console_buf;
+static size_t console_buf_size, console_buf_len;
+
+static void console_put(const char *text, size_t len)
+{
+	size_t new_size = console_buf_size ? console_buf_size : 256;
+
+	if (console_buf_len + len > console_buf_size) {
+		while (new_size < console_buf_len + len)
+			new_size *= 2;
+		console_buf = xrealloc(console_buf, new_size);
+		console_buf_size = new_size;
 	}
 
-	while (*p) {
-		switch (*p) {
-		case '\n':
-			word = NULL;
-			word_len = 0;
+	memcpy(console_buf + console_buf_len, text, len);
+	console_buf_len += len;
+}
+
+static const char *replace_word(struct comprehend_game *game, char *bad_word,
+				size_t bad_word_size)
+{
+	if (game->state->current_replace_word >= game->info->nr_replace_words) {
+		snprintf(bad_word, bad_word_size, "[BAD_REPLACE_WORD(%.2x)]",
+			 game->state->current_replace_word);
+		return bad_word;
+	}
+
+	return game->state->replace_words[game->state->current_replace_word];
+}
+
+/*
+ * Print a string template, word wrapping to the console width. The whole
+ * output is built up and then written in one go.
+ */
+static void console_print_template(struct comprehend_game *game,
+				   const struct string_template *tmpl)
+{
+	const struct string_token *token;
+	size_t i, line_length = 0, word_len;
+	const char *word;
+	char bad_word[64];
+
+	console_buf_len = 0;
+	for (i = 0; i < tmpl->nr_tokens; i++) {
+		token = &tmpl->tokens[i];
+
+		switch (token->type) {
+		case STRING_TOKEN_NEWLINE:
+			console_put("\n", 1);
 			line_length = 0;
-			printf("\n");
-			p++;
-			break;
+			continue;
 
-		case '@':
-			/* Replace word */
-			if (game->info->current_replace_word >= game->info->nr_replace_words) {
-				snprintf(bad_word, sizeof(bad_word),
-					 "[BAD_REPLACE_WORD(%.2x)]",
-					 game->info->current_replace_word);
-				word = bad_word;
-			} else {
-				word = game->info->replace_words[game->info->current_replace_word];
-			}
+		case STRING_TOKEN_REPLACE_WORD:
+			word = replace_word(game, bad_word, sizeof(bad_word));
 			word_len = strlen(word);
-			p++;
 			break;
 
 		default:
-			/* Find next space */
-			word_len = strcspn(p, " \n");
-			if (word_len == 0)
-				break;
-
-			/*
-			 * If this word contains a replacement symbol, then
-			 * print everything before the symbol.
-			 */
-			replace = strchr(p, '@');
-			if (replace)
-				word_len = replace - p;
-
-			word = p;
-			p += word_len;
+			word = tmpl->text + token->offset;
+			word_len = token->len;
 			break;
 		}
 
-		if (!word || !word_len)
+		if (!word_len)
 			continue;
 
 		/* Print this word */
 		if (line_length + word_len > console_winsize.ws_col) {
 			/* Too long - insert a line break */
-			printf("\n");
+			console_put("\n", 1);
 			line_length = 0;
 		}
 
-		printf("%.*s", word_len, word);
+		console_put(word, word_len);
 		line_length += word_len;
 
-		if (*p == ' ') {
+		if (token->space) {
 			if (line_length >= console_winsize.ws_col) {
 				/* Newline, don't print the space */
-				printf("\n");
+				console_put("\n", 1);
 				line_length = 0;
 			} else {
-				printf(" ");
+				console_put(" ", 1);
 				line_length++;
 			}
-			p++;
-
-			/* Skip any double spaces */
-			while (*p == ' ')
-				p++;
 		}
 	}
 
-	printf("\n");
+	console_put("\n", 1);
+	fwrite(console_buf, 1, console_buf_len, stdout);
+}
+
+/* Template for text which is not from the string tables, reused */
+static struct string_template *console_tmpl;
+static size_t console_tmpl_size;
+
+void console_println(struct comprehend_game *game, const char *text)
+{
+	size_t size;
+
+	if (!text) {
+		printf("\n");
+		return;
+	}
+
+	size = string_template_max_size(text);
+	if (size > console_tmpl_size) {
+		console_tmpl = xrealloc(console_tmpl, size);
+		console_tmpl_size = size;
+	}
+
+	string_template_split(console_tmpl, text);
+	console_print_template(game, console_tmpl);
+}
+
+/*
+ * Print a string from the game's string tables. The strings are split
+ * into templates when they are decoded, so this avoids rescanning them.
+ */
+void console_println_string(struct comprehend_game *game, uint16_t index)
+{
+	const struct string_template *tmpl;
+
+	tmpl = string_lookup_template(game, index);
+	if (!tmpl) {
+		console_println(game, string_lookup(game, index));
+		return;
+	}
+
+	console_print_template(game, tmpl);
 }
 
 static struct room *get_room(struct comprehend_game *game, uint16_t index)
@@ -154,7 +311,7 @@ static struct room *get_room(struct comprehend_game *game, uint16_t index)
 	if (index - 1 >= game->info->nr_rooms)
 		fatal_error("Room index %d is invalid", index);
 
-	return &game->info->rooms[index];
+	return &game->state->rooms[index];
 }
 
 struct item *get_item(struct comprehend_game *game, uint16_t index)
@@ -162,7 +319,7 @@ struct item *get_item(struct comprehend_game *game, uint16_t index)
 	if (index >= game->info->header.nr_items)
 		fatal_error("Bad item %d\n", index);
 
-	return &game->info->item[index];
+	return &game->state->item[index];
 }
 
 void game_save(struct comprehend_game *game)
@@ -170,7 +327,7 @@ void game_save(struct comprehend_game *game)
 	char path[PATH_MAX], filename[32];
 	int c;
 
-	console_println(game, game->info->strings.strings[STRING_SAVE_GAME]);
+	console_println_string(game, STRING_SAVE_GAME);
 
 	c = console_get_key();
 	if (c < '1' || c > '3') {
@@ -192,7 +349,7 @@ void game_restore(struct comprehend_game *game)
 	char path[PATH_MAX], filename[32];
 	int c;
 
-	console_println(game, game->info->strings.strings[STRING_RESTORE_GAME]);
+	console_println_string(game, STRING_RESTORE_GAME);
 
 	c = console_get_key();
 	if (c < '1' || c > '3') {
@@ -208,96 +365,161 @@ void game_restore(struct comprehend_game *game)
 	snprintf(path, sizeof(path), "%s%s", game->game_dir, filename);
 	comprehend_restore_game(game, path);
 
-	game->info->update_flags = UPDATE_ALL;
+	game->state->update_flags = UPDATE_ALL;
 }
 
 void game_restart(struct comprehend_game *game)
 {
-	console_println(game, string_lookup(game, game->strings->game_restart));
-	console_get_key();
+	if (game->strings)
+		console_println_string(game, game->strings->game_restart);
+	console_wait_key();
 
-	comprehend_load_game(game, game->game_dir);
-	game->info->update_flags = UPDATE_ALL;
+	comprehend_reset_state(game, game->state);
 }
 
-static struct word_index *is_word_pair(struct comprehend_game *game,
-				       struct word *word1, struct word *word2)
+static struct item *item_or_null(struct comprehend_game *game, uint32_t i)
 {
-	struct word_map *map;
-	int i;
+	return i == NO_ITEM ? NULL : &game->state->item[i];
+}
+
+static void link_room_item(struct game_state *state, uint32_t i)
+{
+	struct item_links *links = state->item_links;
+	uint32_t *next = &state->room_items[state->item[i].room];
+	uint32_t prev = NO_ITEM;
+
+	/* Keep the room's items in item order */
+	while (*next != NO_ITEM && *next < i) {
+		prev = *next;
+		next = &links[*next].room_next;
+	}
 
-	/* Check if this is a word pair */
-	for (i = 0; i < game->info->nr_word_maps; i++) {
-		map = &game->info->word_map[i];
+	links[i].room_prev = prev;
+	links[i].room_next = *next;
+	if (*next != NO_ITEM)
+		links[*next].room_prev = i;
+	*next = i;
+}
+
+static void unlink_room_item(struct game_state *state, uint32_t i)
+{
+	struct item_links *links = state->item_links;
 
-		if (map->word[0].index == word1->index &&
-		    map->word[0].type == word1->type &&
-		    map->word[1].index == word2->index &&
-		    map->word[1].type == word2->type)
-			return &map->word[2];
+	if (links[i].room_prev == NO_ITEM)
+		state->room_items[state->item[i].room] = links[i].room_next;
+	else
+		links[links[i].room_prev].room_next = links[i].room_next;
+
+	if (links[i].room_next != NO_ITEM)
+		links[links[i].room_next].room_prev = links[i].room_prev;
+}
+
+/*
+ * Rebuild the noun and room item chains from the item table.
+ */
+void build_item_index(struct comprehend_game *game, struct game_state *state)
+{
+	struct item_links *links = state->item_links;
+	size_t i;
+
+	memset(state->noun_items, 0xff, sizeof(state->noun_items));
+	memset(state->room_items, 0xff, sizeof(state->room_items));
+
+	/* Add in reverse so that each chain is in item order */
+	for (i = game->info->header.nr_items; i-- > 0; ) {
+		links[i].noun_next = state->noun_items[state->item[i].word];
+		state->noun_items[state->item[i].word] = i;
+
+		links[i].room_prev = NO_ITEM;
+		links[i].room_next = state->room_items[state->item[i].room];
+		if (links[i].room_next != NO_ITEM)
+			links[links[i].room_next].room_prev = i;
+		state->room_items[state->item[i].room] = i;
 	}
+}
 
-	return NULL;
+struct item *first_item_in_room(struct comprehend_game *game, uint8_t room)
+{
+	return item_or_null(game, game->state->room_items[room]);
 }
 
-static struct item *get_item_by_noun(struct comprehend_game *game,
-				     struct word *noun)
+struct item *next_item_in_room(struct comprehend_game *game,
+			       struct item *item)
 {
-	int i;
+	return item_or_null(game, game->state->item_links[
+				    item - game->state->item].room_next);
+}
+
+struct item *first_item_with_word(struct comprehend_game *game,
+				  uint8_t index)
+{
+	return item_or_null(game, game->state->noun_items[index]);
+}
 
+/*
+ * Returns the first item for a noun. Several items can share the same
+ * noun, the others can be found with next_item_by_noun.
+ *
+ * FIXME - in oo-topos the word 'box' matches more than one object
+ *         (the box and the snarl-in-a-box). The player is unable
+ *         to drop the latter because this will match the former.
+ */
+struct item *get_item_by_noun(struct comprehend_game *game,
+			      struct word *noun)
+{
 	if (!noun || !(noun->type & WORD_TYPE_NOUN_MASK))
 		return NULL;
 
-	/*
-	 * FIXME - in oo-topos the word 'box' matches more than one object
-	 *         (the box and the snarl-in-a-box). The player is unable
-	 *         to drop the latter because this will match the former.
-	 */
-	for (i = 0; i < game->info->header.nr_items; i++)
-		if (game->info->item[i].word == noun->index)
-			return &game->info->item[i];
+	return first_item_with_word(game, noun->index);
+}
 
-	return NULL;
+/*
+ * Returns the next item, in item order, with the same noun as item.
+ */
+struct item *next_item_by_noun(struct comprehend_game *game,
+			       struct item *item)
+{
+	return item_or_null(game, game->state->item_links[
+				    item - game->state->item].noun_next);
 }
 
 static void update_graphics(struct comprehend_game *game)
 {
 	struct item *item;
 	struct room *room;
-	int type, i;
+	int type;
 
 	if (!g_enabled())
 		return;
 
 	type = ROOM_IS_NORMAL;
 	if (game->ops->room_is_special)
-		type = game->ops->room_is_special(game, game->info->current_room, NULL);
+		type = game->ops->room_is_special(game, game->state->current_room, NULL);
 
 	switch (type) {
 	case ROOM_IS_DARK:
-		if (game->info->update_flags & UPDATE_GRAPHICS)
+		if (game->state->update_flags & UPDATE_GRAPHICS)
 			draw_dark_room();
 		break;
 
 	case ROOM_IS_TOO_BRIGHT:
-		if (game->info->update_flags & UPDATE_GRAPHICS)
+		if (game->state->update_flags & UPDATE_GRAPHICS)
 			draw_bright_room();
 		break;
 
 	default:
-		if (game->info->update_flags & UPDATE_GRAPHICS) {
-			room = get_room(game, game->info->current_room);
+		if (game->state->update_flags & UPDATE_GRAPHICS) {
+			room = get_room(game, game->state->current_room);
 			draw_location_image(&game->info->room_images,
 					    room->graphic - 1);
 		}
 
-		if ((game->info->update_flags & UPDATE_GRAPHICS) ||
-		    (game->info->update_flags & UPDATE_GRAPHICS_ITEMS)) {
-			for (i = 0; i < game->info->header.nr_items; i++) {
-				item = &game->info->item[i];
-
-				if (item->room == game->info->current_room &&
-				    item->graphic != 0)
+		if ((game->state->update_flags & UPDATE_GRAPHICS) ||
+		    (game->state->update_flags & UPDATE_GRAPHICS_ITEMS)) {
+			for (item = first_item_in_room(game,
+						       game->state->current_room);
+			     item; item = next_item_in_room(game, item)) {
+				if (item->graphic != 0)
 					draw_image(&game->info->item_images,
 						   item->graphic - 1);
 			}
@@ -308,34 +530,26 @@ static void update_graphics(struct comprehend_game *game)
 
 static void describe_objects_in_current_room(struct comprehend_game *game)
 {
-	struct item *item;
+	struct item *first, *item;
 	size_t count = 0;
-	int i;
-
-	for (i = 0; i < game->info->header.nr_items; i++) {
-		item = &game->info->item[i];
 
-		if (item->room == game->info->current_room &&
-		    item->string_desc != 0)
+	first = first_item_in_room(game, game->state->current_room);
+	for (item = first; item; item = next_item_in_room(game, item))
+		if (item->string_desc != 0)
 			count++;
-	}
 
 	if (count > 0) {
-		console_println(game, string_lookup(game, STRING_YOU_SEE));
-
-		for (i = 0; i < game->info->header.nr_items; i++) {
-			item = &game->info->item[i];
+		console_println_string(game, STRING_YOU_SEE);
 
-			if (item->room == game->info->current_room &&
-			    item->string_desc != 0)
-				console_println(game, string_lookup(game, item->string_desc));
-		}
+		for (item = first; item; item = next_item_in_room(game, item))
+			if (item->string_desc != 0)
+				console_println_string(game, item->string_desc);
 	}
 }
 
 static void update(struct comprehend_game *game)
 {
-	struct room *room = get_room(game, game->info->current_room);
+	struct room *room = get_room(game, game->state->current_room);
 	unsigned room_type, room_desc_string;
 
 	update_graphics(game);
@@ -345,55 +559,37 @@ static void update(struct comprehend_game *game)
 	room_desc_string = room->string_desc;
 	if (game->ops->room_is_special)
 		room_type = game->ops->room_is_special(game,
-						       game->info->current_room,
+						       game->state->current_room,
 						       &room_desc_string);
 
-	if (game->info->update_flags & UPDATE_ROOM_DESC)
-		console_println(game, string_lookup(game, room_desc_string));
+	if (game->state->update_flags & UPDATE_ROOM_DESC)
+		console_println_string(game, room_desc_string);
 
-	if ((game->info->update_flags & UPDATE_ITEM_LIST) &&
+	if ((game->state->update_flags & UPDATE_ITEM_LIST) &&
 	    room_type == ROOM_IS_NORMAL)
 		describe_objects_in_current_room(game);
 
-	game->info->update_flags = 0;
+	game->state->update_flags = 0;
 }
 
-static void move_to(struct comprehend_game *game, uint8_t room)
+void move_to(struct comprehend_game *game, uint8_t room)
 {
 	if (room - 1 >= game->info->nr_rooms)
 		fatal_error("Attempted to move to invalid room %.2x\n", room);
 
-	game->info->current_room = room;
-	game->info->update_flags = (UPDATE_GRAPHICS | UPDATE_ROOM_DESC |
+	game->state->current_room = room;
+	game->state->update_flags = (UPDATE_GRAPHICS | UPDATE_ROOM_DESC |
 				    UPDATE_ITEM_LIST);
 }
 
-static void func_set_test_result(struct function_state *func_state, bool value)
+size_t num_objects_in_room(struct comprehend_game *game, int room)
 {
-	if (func_state->or_count == 0) {
-		/* And */
-		if (func_state->and) {
-			if (!value)
-				func_state->test_result = false;
-		} else {
-			func_state->test_result = value;
-			func_state->and = true;
-		}
-
-	} else {
-		/* Or */
-		if (value)
-			func_state->test_result = value;
-	}
-}
-
-static size_t num_objects_in_room(struct comprehend_game *game, int room)
-{
-	size_t count = 0, i;
+	struct item *item;
+	size_t count = 0;
 
-	for (i = 0; i < game->info->header.nr_items; i++)
-		if (game->info->item[i].room == room)
-			count++;
+	for (item = first_item_in_room(game, room); item;
+	     item = next_item_in_room(game, item))
+		count++;
 
 	return count;
 }
@@ -407,582 +603,169 @@ void move_object(struct comprehend_game *game, struct item *item, int new_room)
 
 	if (item->room == ROOM_INVENTORY) {
 		/* Removed from player's inventory */
-		game->info->variable[VAR_INVENTORY_WEIGHT] -= obj_weight;
+		game->state->variable[VAR_INVENTORY_WEIGHT] -= obj_weight;
 	}
 	if (new_room == ROOM_INVENTORY) {
 		/* Moving to the player's inventory */
-		game->info->variable[VAR_INVENTORY_WEIGHT] += obj_weight;
+		game->state->variable[VAR_INVENTORY_WEIGHT] += obj_weight;
 	}
 
-	if (item->room == game->info->current_room) {
+	if (item->room == game->state->current_room) {
 		/* Item moved away from the current room */
-		game->info->update_flags |= UPDATE_GRAPHICS;
+		game->state->update_flags |= UPDATE_GRAPHICS;
 
-	} else if (new_room == game->info->current_room) {
+	} else if (new_room == game->state->current_room) {
 		/*
 		 * Item moved into the current room. Only the item needs a
 		 * redraw, not the whole room.
 		 */
-		game->info->update_flags |= (UPDATE_GRAPHICS_ITEMS |
+		game->state->update_flags |= (UPDATE_GRAPHICS_ITEMS |
 					     UPDATE_ITEM_LIST);
 	}
 
+	unlink_room_item(game->state, item - game->state->item);
 	item->room = new_room;
+	link_room_item(game->state, item - game->state->item);
 
 }
 
-static void eval_instruction(struct comprehend_game *game,
-			     struct function_state *func_state,
-			     struct instruction *instr,
-			     struct word *verb, struct word *noun)
-{
-	uint8_t *opcode_map;
-	struct room *room;
-	struct item *item;
-	uint16_t index;
-	bool test;
-	int i, count;
-
-	room = get_room(game, game->info->current_room);
+#define DEFAULT_MAX_CALL_DEPTH	256
 
-	if (debugging_enabled()) {
-		if (!instr->is_command) {
-			printf("? ");
-		} else {
-			if (func_state->test_result)
-				printf("+ ");
-			else
-				printf("- ");
-		}
+static unsigned max_call_depth = DEFAULT_MAX_CALL_DEPTH;
 
-		dump_instruction(game, func_state, instr);
-	}
-
-	if (func_state->or_count)
-		func_state->or_count--;
-
-	if (instr->is_command) {
-		bool do_command;
-
-		func_state->in_command = true;
-		do_command = func_state->test_result;
-
-		if (func_state->or_count != 0)
-			printf("Warning: or_count == %d\n",
-			       func_state->or_count);
-		func_state->or_count = 0;
-
-		if (!do_command)
-			return;
+/*
+ * Limit how deeply functions can call each other. A game which goes deeper,
+ * for example because its functions call each other in a cycle, gets an
+ * error instead of exhausting the stack.
+ */
+void eval_set_max_call_depth(unsigned depth)
+{
+	max_call_depth = depth;
+}
 
-		func_state->else_result = false;
-		func_state->executed = true;
+static void call_depth_exceeded(uint16_t index)
+{
+	printf("Error: function call depth limit (%u) exceeded calling %.4x\n",
+	       max_call_depth, index);
+}
 
-	} else {
-		if (func_state->in_command) {
-			/* Finished command sequence - clear test result */
-			func_state->in_command = false;
-			func_state->test_result = false;
-			func_state->and = false;
-		}
+/*
+ * Native code runs function calls on the C stack, but counts them against
+ * the same limit. Returns false if calling function index would exceed it,
+ * otherwise the caller must drop the frame again once the call returns.
+ */
+bool eval_enter_call(struct comprehend_game *game, uint16_t index)
+{
+	if (game->state->nr_frames >= max_call_depth) {
+		call_depth_exceeded(index);
+		return false;
 	}
 
-	opcode_map = get_opcode_map(game);
-	switch (opcode_map[instr->opcode]) {
-	case OPCODE_VAR_ADD:
-		game->info->variable[instr->operand[0]] +=
-			game->info->variable[instr->operand[1]];
-		break;
-
-	case OPCODE_VAR_SUB:
-		game->info->variable[instr->operand[0]] -=
-			game->info->variable[instr->operand[1]];
-		break;
-
-	case OPCODE_VAR_INC:
-		game->info->variable[instr->operand[0]]++;
-		break;
-
-	case OPCODE_VAR_DEC:
-		game->info->variable[instr->operand[0]]--;
-		break;
-
-	case OPCODE_VAR_EQ:
-		func_set_test_result(func_state,
-				     game->info->variable[instr->operand[0]] ==
-				     game->info->variable[instr->operand[1]]);
-		break;
-
-	case OPCODE_TURN_TICK:
-		game->info->variable[VAR_TURN_COUNT]++;
-		break;
-
-	case OPCODE_PRINT:
-		console_println(game, instr_lookup_string(game,
-							  instr->operand[0],
-							  instr->operand[1]));
-		break;
-
-	case OPCODE_TEST_NOT_ROOM_FLAG:
-		func_set_test_result(func_state,
-				     !(room->flags & instr->operand[0]));
-		break;
-
-	case OPCODE_TEST_ROOM_FLAG:
-		func_set_test_result(func_state,
-				     room->flags & instr->operand[0]);
-		break;
-
-	case OPCODE_NOT_IN_ROOM:
-		func_set_test_result(func_state,
-				     game->info->current_room != instr->operand[0]);
-		break;
-
-	case OPCODE_IN_ROOM:
-		func_set_test_result(func_state,
-				     game->info->current_room == instr->operand[0]);
-		break;
-
-	case OPCODE_MOVE_TO_ROOM:
-		if (instr->operand[0] == 0xff) {
-			/*
-			 * FIXME - Not sure what this is for. Transylvania
-			 * uses it in the 'go north' case when in room
-			 * 0x01 or 0x0c, and Oo-Topos uses it when you shoot
-			 * the alien. Ignore it for now.
-			 */
-			break;
-		}
-
-		move_to(game, instr->operand[0]);
-		break;
-
-	case OPCODE_MOVE:
-		/* Move in the direction dictated by the current verb */
-		if (verb->index - 1 >= NR_DIRECTIONS)
-			fatal_error("Bad verb %d:%d in move",
-				    verb->index, verb->type);
-
-		if (room->direction[verb->index - 1])
-			move_to(game, room->direction[verb->index - 1]);
-		else
-			console_println(game, string_lookup(game, STRING_CANT_GO));
-		break;
-
-	case OPCODE_MOVE_DIRECTION:
-		if (room->direction[instr->operand[0] - 1])
-			move_to(game, room->direction[instr->operand[0] - 1]);
-		else
-			console_println(game, string_lookup(game, STRING_CANT_GO));
-		break;
-
-	case OPCODE_ELSE:
-		func_state->test_result = func_state->else_result;
-		break;
-
-	case OPCODE_MOVE_OBJECT_TO_CURRENT_ROOM:
-		item = get_item(game, instr->operand[0] - 1);
-		move_object(game, item, game->info->current_room);
-		break;
-
-	case OPCODE_OBJECT_IN_ROOM:
-		item = get_item(game, instr->operand[0] - 1);
-		func_set_test_result(func_state,
-				     item->room == instr->operand[1]);
-		break;
-
-	case OPCODE_OBJECT_NOT_IN_ROOM:
-		item = get_item(game, instr->operand[0] - 1);
-		func_set_test_result(func_state,
-				     item->room != instr->operand[1]);
-		break;
-
-	case OPCODE_MOVE_OBJECT_TO_ROOM:
-		item = get_item(game, instr->operand[0] - 1);
-		move_object(game, item, instr->operand[1]);
-		break;
-
-	case OPCODE_INVENTORY_FULL:
-		item = get_item_by_noun(game, noun);
-		func_set_test_result(func_state,
-				     game->info->variable[VAR_INVENTORY_WEIGHT] +
-				     (item->flags & ITEMF_WEIGHT_MASK) >
-				     game->info->variable[VAR_INVENTORY_LIMIT]);
-		break;
-
-	case OPCODE_DESCRIBE_CURRENT_OBJECT:
-		/*
-		 * This opcode is only used in version 2
-		 * FIXME - unsure what the single operand is for.
-		 */
-		item = get_item_by_noun(game, noun);
-		printf("%s\n", string_lookup(game, item->long_string));
-		break;
-
-	case OPCODE_CURRENT_OBJECT_IN_ROOM:
-		/* FIXME - use common code for these two ops */
-		test = false;
-
-		if (noun) {
-			for (i = 0; i < game->info->header.nr_items; i++) {
-				struct item *item = &game->info->item[i];
-
-				if (item->word == noun->index &&
-				    item->room == instr->operand[0]) {
-					test = true;
-					break;
-				}
-			}
-		}
-
-		func_set_test_result(func_state, test);
-		break;
-
-	case OPCODE_CURRENT_OBJECT_NOT_PRESENT:
-		/* FIXME - use common code for these two ops */
-		item = get_item_by_noun(game, noun);
-		if (item)
-			func_set_test_result(func_state,
-					     item->room != game->info->current_room);
-		else
-			func_set_test_result(func_state, true);
-		break;
-
-	case OPCODE_CURRENT_OBJECT_PRESENT:
-		item = get_item_by_noun(game, noun);
-		if (item)
-			func_set_test_result(func_state,
-					     item->room == game->info->current_room);
-		else
-			func_set_test_result(func_state, false);
-		break;
-
-	case OPCODE_HAVE_OBJECT:
-		item = get_item(game, instr->operand[0] - 1);
-		func_set_test_result(func_state,
-				     item->room == ROOM_INVENTORY);
-		break;
-
-	case OPCODE_NOT_HAVE_CURRENT_OBJECT:
-		item = get_item_by_noun(game, noun);
-		func_set_test_result(func_state,
-				     !item || item->room != ROOM_INVENTORY);
-		break;
-
-	case OPCODE_HAVE_CURRENT_OBJECT:
-		item = get_item_by_noun(game, noun);
-		func_set_test_result(func_state,
-				     item->room == ROOM_INVENTORY);
-		break;
-
-	case OPCODE_NOT_HAVE_OBJECT:
-		item = get_item(game, instr->operand[0] - 1);
-		func_set_test_result(func_state,
-				     item->room != ROOM_INVENTORY);
-		break;
-
-	case OPCODE_CURRENT_OBJECT_TAKEABLE:
-		item = get_item_by_noun(game, noun);
-		if (!item)
-			func_set_test_result(func_state, false);
-		else
-			func_set_test_result(func_state,
-					     (item->flags & ITEMF_CAN_TAKE));
-		break;
-
-	case OPCODE_CURRENT_OBJECT_NOT_TAKEABLE:
-		item = get_item_by_noun(game, noun);
-		if (!item)
-			func_set_test_result(func_state, true);
-		else
-			func_set_test_result(func_state,
-					     !(item->flags & ITEMF_CAN_TAKE));
-		break;
-
-	case OPCODE_CURRENT_OBJECT_IS_NOWHERE:
-		item = get_item_by_noun(game, noun);
-		if (!item)
-			func_set_test_result(func_state, false);
-		else
-			func_set_test_result(func_state,
-					     item->room == ROOM_NOWHERE);
-		break;
-
-	case OPCODE_OBJECT_IS_NOWHERE:
-		item = get_item(game, instr->operand[0] - 1);
-		func_set_test_result(func_state,
-				     item->room == ROOM_NOWHERE);
-		break;
-
-	case OPCODE_OBJECT_IS_NOT_NOWHERE:
-		item = get_item(game, instr->operand[0] - 1);
-		func_set_test_result(func_state,
-				     item->room != ROOM_NOWHERE);
-		break;
-
-	case OPCODE_OBJECT_NOT_PRESENT:
-		item = get_item(game, instr->operand[0] - 1);
-		func_set_test_result(func_state,
-				     item->room != game->info->current_room);
-		break;
-
-	case OPCODE_OBJECT_PRESENT:
-		item = get_item(game, instr->operand[0] - 1);
-		func_set_test_result(func_state,
-				     item->room == game->info->current_room);
-		break;
-
-	case OPCODE_OBJECT_NOT_VALID:
-		/* FIXME - should be called OPCODE_CURRENT_OBJECT_NOT_VALID */
-		func_set_test_result(func_state, !noun ||
-				     (noun->type & WORD_TYPE_NOUN_MASK) == 0);
-		break;
-
-	case OPCODE_CURRENT_IS_OBJECT:
-		func_set_test_result(func_state,
-				     get_item_by_noun(game, noun) != NULL);
-		break;
-
-	case OPCODE_CURRENT_NOT_OBJECT:
-		func_set_test_result(func_state,
-				     get_item_by_noun(game, noun) == NULL);
-		break;
-
-	case OPCODE_REMOVE_OBJECT:
-		item = get_item(game, instr->operand[0] - 1);
-		move_object(game, item, ROOM_NOWHERE);
-		break;
-
-	case OPCODE_REMOVE_CURRENT_OBJECT:
-		item = get_item_by_noun(game, noun);
-		move_object(game, item, ROOM_NOWHERE);
-		break;
-
-	case OPCODE_INVENTORY:
-		count = num_objects_in_room(game, ROOM_INVENTORY);
-		if (count == 0) {
-			console_println(game, string_lookup(game, STRING_INVENTORY_EMPTY));
-			break;
-		}
-
-		console_println(game, string_lookup(game, STRING_INVENTORY));
-		for (i = 0; i < game->info->header.nr_items; i++) {
-			item = &game->info->item[i];
-			if (item->room == ROOM_INVENTORY)
-				printf("%s\n",
-				       string_lookup(game, item->string_desc));
-		}
-		break;
-
-	case OPCODE_INVENTORY_ROOM:
-		count = num_objects_in_room(game, instr->operand[0]);
-		if (count == 0) {
-			console_println(game, string_lookup(game, instr->operand[1] + 1));
-			break;
-		}
-
-		console_println(game, string_lookup(game, instr->operand[1]));
-		for (i = 0; i < game->info->header.nr_items; i++) {
-			item = &game->info->item[i];
-			if (item->room == instr->operand[0])
-				printf("%s\n",
-				       string_lookup(game, item->string_desc));
-		}
-		break;
-
-	case OPCODE_MOVE_CURRENT_OBJECT_TO_ROOM:
-		item = get_item_by_noun(game, noun);
-		if (!item)
-			fatal_error("Bad current object\n");
-
-		move_object(game, item, instr->operand[0]);
-		break;
-
-	case OPCODE_DROP_OBJECT:
-		item = get_item(game, instr->operand[0] - 1);
-		move_object(game, item, game->info->current_room);
-		break;
-
-	case OPCODE_DROP_CURRENT_OBJECT:
-		item = get_item_by_noun(game, noun);
-		if (!item)
-			fatal_error("Attempt to take object failed\n");
-
-		move_object(game, item, game->info->current_room);
-		break;
-
-	case OPCODE_TAKE_CURRENT_OBJECT:
-		item = get_item_by_noun(game, noun);
-		if (!item)
-			fatal_error("Attempt to take object failed\n");
-
-		move_object(game, item, ROOM_INVENTORY);
-		break;
-
-	case OPCODE_TAKE_OBJECT:
-		item = get_item(game, instr->operand[0] - 1);
-		move_object(game, item, ROOM_INVENTORY);
-		break;
-
-	case OPCODE_TEST_FLAG:
-		func_set_test_result(func_state,
-				     game->info->flags[instr->operand[0]]);
-		break;
-
-	case OPCODE_TEST_NOT_FLAG:
-		func_set_test_result(func_state,
-				     !game->info->flags[instr->operand[0]]);
-		break;
-
-	case OPCODE_CLEAR_FLAG:
-		game->info->flags[instr->operand[0]] = false;
-		break;
-
-	case OPCODE_SET_FLAG:
-		game->info->flags[instr->operand[0]] = true;
-		break;
-
-	case OPCODE_OR:
-		if (func_state->or_count) {
-			func_state->or_count += 2;
-		} else {
-			func_state->test_result = false;
-			func_state->or_count += 3;
-		}
-		break;
-
-	case OPCODE_SET_OBJECT_DESCRIPTION:
-		item = get_item(game, instr->operand[0] - 1);
-		item->string_desc = (instr->operand[2] << 8) | instr->operand[1];
-		break;
-
-	case OPCODE_SET_OBJECT_LONG_DESCRIPTION:
-		item = get_item(game, instr->operand[0] - 1);
-		item->long_string = (instr->operand[2] << 8) | instr->operand[1];
-		break;
-
-	case OPCODE_SET_ROOM_DESCRIPTION:
-		room = get_room(game, instr->operand[0]);
-		switch (instr->operand[2]) {
-		case 0x80:
-			room->string_desc = instr->operand[1];
-			break;
-		case 0x81:
-			room->string_desc = instr->operand[1] + 0x100;
-			break;
-		case 0x82:
-			room->string_desc = instr->operand[1] + 0x200;
-			break;
-		default:
-			fatal_error("Bad string desc %.2x:%.2x\n",
-				    instr->operand[1], instr->operand[2]);
-			break;
-		}
-		break;
-
-	case OPCODE_SET_OBJECT_GRAPHIC:
-		item = get_item(game, instr->operand[0] - 1);
-		item->graphic = instr->operand[1];
-		if (item->room == game->info->current_room)
-			game->info->update_flags |= UPDATE_GRAPHICS;
-		break;
+	game->state->nr_frames++;
+	return true;
+}
 
-	case OPCODE_SET_ROOM_GRAPHIC:
-		room = get_room(game, instr->operand[0]);
-		room->graphic = instr->operand[1];
-		if (instr->operand[0] == game->info->current_room)
-			game->info->update_flags |= UPDATE_GRAPHICS;
-		break;
+/*
+ * Set up the state for running a function and return its first
+ * instruction. The end of the function is returned in end.
+ */
+static struct instruction *enter_function(struct comprehend_game *game,
+					  struct function *func,
+					  struct function_state *func_state,
+					  struct instruction **end)
+{
+	struct instruction *instr;
 
-	case OPCODE_CALL_FUNC:
-		index = instr->operand[0];
-		if (instr->operand[1] == 0x81)
-			index += 256;
-		if (index >= game->info->nr_functions)
-			fatal_error("Bad function %.4x >= %.4x\n",
-				    index, game->info->nr_functions);
-
-		debug_printf(DEBUG_FUNCTIONS,
-			     "Calling subfunction %.4x\n", index);
-		eval_function(game, &game->info->functions[index], verb, noun);
-		break;
+	memset(func_state, 0, sizeof(*func_state));
+	func_state->test_result = true;
+	func_state->else_result = true;
 
-	case OPCODE_TEST_FALSE:
-		/*
-		 * FIXME - not sure what this is for. In Transylvania
-		 * it is opcode 0x50 and is used when attempting to
-		 * take the bar in the cellar. If it returns true then
-		 * the response is "there's none here".
-		 */
-		func_set_test_result(func_state, false);
-		break;
-
-	case OPCODE_SAVE_ACTION:
-		/*
-		 * FIXME - This saves the current verb and allows the next
-		 * command to use just the noun. This is used to allow
-		 * responses to ask the player what they meant, e.g:
-		 *
-		 *   > drop
-		 *   I don't understand what you want to drop.
-		 *   > gun
-		 *   Okay.
-		 */
-		break;
-
-	case OPCODE_SET_STRING_REPLACEMENT:
-		game->info->current_replace_word = instr->operand[0] - 1;
-		break;
+	instr = &game->info->instructions[func->first_instruction];
+	*end = instr + func->nr_instructions;
+	return instr;
+}
 
-	case OPCODE_SET_CURRENT_NOUN_STRING_REPLACEMENT:
-		/*
-		 * FIXME - Not sure what the operand is for,
-		 * maybe capitalisation?
-		 */
-		if (noun && (noun->type & WORD_TYPE_NOUN_PLURAL))
-			game->info->current_replace_word = 3;
-		else if (noun && (noun->type & WORD_TYPE_FEMALE))
-			game->info->current_replace_word = 0;
-		else if (noun && (noun->type & WORD_TYPE_MALE))
-			game->info->current_replace_word = 1;
-		else
-			game->info->current_replace_word = 2;
-		break;
+/*
+ * Suspend the calling function while a subfunction runs. Returns false if
+ * the call depth limit has been reached.
+ */
+static bool push_function_frame(struct game_state *state,
+				struct function_state *func_state,
+				struct instruction *instr,
+				struct instruction *end)
+{
+	struct function_frame *frame;
 
-	case OPCODE_DRAW_ROOM:
-		draw_location_image(&game->info->room_images,
-				    instr->operand[0] - 1);
-		break;
+	if (state->nr_frames >= max_call_depth)
+		return false;
 
-	case OPCODE_DRAW_OBJECT:
-		draw_image(&game->info->item_images, instr->operand[0] - 1);
-		break;
+	state->frames = grow_array(state->frames, &state->nr_frames_allocated,
+				   state->nr_frames + 1,
+				   sizeof(*state->frames));
+	frame = &state->frames[state->nr_frames++];
+	frame->func_state = *func_state;
+	frame->instr = instr;
+	frame->end = end;
+	return true;
+}
 
-	case OPCODE_WAIT_KEY:
-		console_get_key();
-		break;
+/*
+ * The interpreter uses direct threaded dispatch if the compiler supports
+ * labels as values: each handler jumps straight to the handler for the next
+ * instruction. Otherwise every instruction goes back through the switch.
+ */
+#ifdef __GNUC__
+#define HAVE_THREADED_DISPATCH
+#endif
+
+#ifdef HAVE_THREADED_DISPATCH
+#define TARGET(name)		case OPCODE_##name: op_##name
+#define TARGET_DEFAULT		default: op_default
+#define TARGET_ENTRY(name)	[OPCODE_##name] = &&op_##name
+#define DISPATCH()		goto *dispatch_table[instr->op]
+#else
+#define TARGET(name)		case OPCODE_##name
+#define TARGET_DEFAULT		default
+#define DISPATCH()		goto dispatch
+#endif
+
+#define NEXT()								\
+	do {								\
+		EVAL_STEP(game, func_state, instr);			\
+		instr = EVAL_NAME(next_instruction)(game, func_state,	\
+						    instr + 1, end);	\
+		if (!instr)						\
+			goto function_return;				\
+		DISPATCH();						\
+	} while (0)
+
+#define EVAL_STEP(game, func_state, instr)	do { } while (0)
+
+#define EVAL_TRACED		0
+#define EVAL_NAME(name)		name##_release
+#include "eval_function.h"
+#undef EVAL_TRACED
+#undef EVAL_NAME
+
+#define EVAL_TRACED		1
+#define EVAL_NAME(name)		name##_traced
+#include "eval_function.h"
+#undef EVAL_TRACED
+#undef EVAL_NAME
 
-	case OPCODE_SPECIAL:
-		/* Game specific opcode */
-		if (game->ops->handle_special_opcode)
-			game->ops->handle_special_opcode(game,
-							 instr->operand[0]);
-		break;
+/*
+ * The checked version reports the state after every instruction, so that
+ * it can be compared with native code, see native_eval_function.
+ */
+#undef EVAL_STEP
+#define EVAL_STEP(game, func_state, instr)				\
+	native_check_step(game, func_state, instr)
 
-	default:
-		if (instr->opcode & 0x80) {
-			debug_printf(DEBUG_FUNCTIONS,
-				     "Unhandled command opcode %.2x\n",
-				     instr->opcode);
-		} else {
-			debug_printf(DEBUG_FUNCTIONS,
-				     "Unhandled test opcode %.2x - returning false\n",
-				     instr->opcode);
-			func_set_test_result(func_state, false);
-		}
-		break;
-	}
-}
+#define EVAL_TRACED		0
+#define EVAL_NAME(name)		name##_checked
+#include "eval_function.h"
+#undef EVAL_TRACED
+#undef EVAL_NAME
 
 /*
  * Comprehend functions consist of test and command instructions (if the MSB
@@ -992,30 +775,23 @@ static void eval_instruction(struct comprehend_game *game,
  * executed until either a test instruction is found or the end of the function
  * is reached. Otherwise the commands instructions are skipped over and the
  * next test sequence (if there is one) is tried.
+ *
+ * Functions can call other functions. The calls are run on the session's
+ * frame stack rather than by recursion. Returns false, abandoning the
+ * function and all of its callers, if the call depth limit is exceeded.
+ *
+ * If native code was loaded for the game then it runs the functions
+ * instead, unless debugging is enabled.
  */
-void eval_function(struct comprehend_game *game, struct function *func,
+bool eval_function(struct comprehend_game *game, struct function *func,
 		   struct word *verb, struct word *noun)
 {
-	struct function_state func_state = {
-		.test_result = true
-	};
-	int i;
-
-	func_state.else_result = true;
-	func_state.executed = false;
-
-	for (i = 0; i < func->nr_instructions; i++) {
-		if (func_state.executed && !func->instructions[i].is_command) {
-			/*
-			 * At least one command has been executed and the
-			 * current instruction is a test. Exit the function.
-			 */
-			break;
-		}
-
-		eval_instruction(game, &func_state, &func->instructions[i],
-				 verb, noun);
-	}
+	if (debugging_enabled())
+		return eval_function_traced(game, func, verb, noun);
+	if (game->info->native)
+		return native_eval_function(game, func, verb, noun,
+					    eval_function_checked);
+	return eval_function_release(game, func, verb, noun);
 }
 
 static void skip_whitespace(char **p)
@@ -1045,6 +821,11 @@ static void handle_debug_command(struct comprehend_game *game,
 			debug_enable(DEBUG_FUNCTIONS);
 		printf("Debugging %s\n", debugging_enabled() ? "on" : "off");
 
+	} else if (strncmp(line, "reload", 6) == 0) {
+		/* Reload the game data files and start a new game */
+		comprehend_load_game(game, game->game_dir);
+		game->state->update_flags = UPDATE_ALL;
+
 	} else if (strncmp(line, "dump objects", 12) == 0) {
 		dump_game_data(game, DUMP_ITEMS);
 
@@ -1052,70 +833,143 @@ static void handle_debug_command(struct comprehend_game *game,
 		dump_game_data(game, DUMP_ROOMS);
 
 	} else if (strncmp(line, "dump state", 10) == 0) {
-		printf("Current room: %.2x\n", game->info->current_room);
+		printf("Current room: %.2x\n", game->state->current_room);
 		printf("Carry weight %d/%d\n\n",
-		       game->info->variable[VAR_INVENTORY_WEIGHT],
-		       game->info->variable[VAR_INVENTORY_LIMIT]);
+		       game->state->variable[VAR_INVENTORY_WEIGHT],
+		       game->state->variable[VAR_INVENTORY_LIMIT]);
 
 		printf("Flags:\n");
-		for (i = 0; i < ARRAY_SIZE(game->info->flags); i++)
-			printf("  [%.2x]: %d\n", i, game->info->flags[i]);
+		for (i = 0; i < ARRAY_SIZE(game->state->flags); i++)
+			printf("  [%.2x]: %d\n", i, game->state->flags[i]);
 		printf("\n");
 
 		printf("Variables:\n");
-		for (i = 0; i < ARRAY_SIZE(game->info->variable); i++)
+		for (i = 0; i < ARRAY_SIZE(game->state->variable); i++)
 			printf("  [%.2x]: %5d (0x%.4x)\n",
-			       i, game->info->variable[i],
-			       game->info->variable[i]);
+			       i, game->state->variable[i],
+			       game->state->variable[i]);
 		printf("\n");
 	}
 }
 
+/*
+ * Actions are indexed by their number of words and the word indexes.
+ * Word types are masks, so they are checked against the sentence once an
+ * action with the right words has been found.
+ */
+static uint64_t action_key(size_t nr_words, const uint8_t *index)
+{
+	uint64_t key = (uint64_t)nr_words << 32;
+	int i;
+
+	for (i = 0; i < nr_words; i++)
+		key |= (uint64_t)index[i] << (i * 8);
+
+	return key;
+}
+
+void build_action_index(struct comprehend_game *game)
+{
+	struct game_info *info = game->info;
+	struct action *action;
+	size_t i;
+
+	hash_index_init(&info->action_index, &info->arena, info->nr_actions);
+	for (i = info->nr_actions; i-- > 0; ) {
+		action = &info->action[i];
+		hash_index_add(&info->action_index,
+			       action_key(action->nr_words, action->word), i);
+	}
+}
+
+static bool action_matches(struct action *action, struct sentence *sentence)
+{
+	int j;
+
+	if (action->type == ACTION_VERB_OPT_NOUN &&
+	    sentence->nr_words > action->nr_words + 1)
+		return false;
+	if (action->type != ACTION_VERB_OPT_NOUN &&
+	    sentence->nr_words != action->nr_words)
+		return false;
+
+	/*
+	 * If all words in a sentence match those for an action then
+	 * run that action's function.
+	 */
+	for (j = 0; j < action->nr_words; j++) {
+		if (sentence->words[j].index == action->word[j] &&
+		    (sentence->words[j].type & action->word_type[j]))
+			continue;
+
+		/* Word didn't match */
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Find the first action in the table which matches the sentence. Only
+ * actions with one fewer word than the sentence (VERB_OPT_NOUN), or with
+ * at least as many, can match. Words past the end of the sentence can
+ * still match since combining a word pair leaves the second word behind.
+ * There is one chain of candidates for each possible number of action
+ * words, and the chains are merged in table order.
+ */
+static struct action *find_action(struct comprehend_game *game,
+				  struct sentence *sentence)
+{
+	struct hash_index *index = &game->info->action_index;
+	uint32_t chain[ARRAY_SIZE(sentence->words) + 1], first;
+	uint8_t words[ARRAY_SIZE(sentence->words)];
+	size_t nr_words, min_words, i, next;
+
+	for (i = 0; i < ARRAY_SIZE(words); i++)
+		words[i] = sentence->words[i].index;
+
+	min_words = sentence->nr_words - 1;
+	for (nr_words = min_words; nr_words < ARRAY_SIZE(chain); nr_words++)
+		chain[nr_words] = hash_index_first(index,
+						   action_key(nr_words, words));
+
+	while (1) {
+		first = HASH_INDEX_NONE;
+		for (i = min_words; i < ARRAY_SIZE(chain); i++) {
+			if (chain[i] < first) {
+				first = chain[i];
+				next = i;
+			}
+		}
+		if (first == HASH_INDEX_NONE)
+			return NULL;
+
+		if (action_matches(&game->info->action[first], sentence))
+			return &game->info->action[first];
+		chain[next] = index->next[first];
+	}
+}
+
 static bool handle_sentence(struct comprehend_game *game,
 			    struct sentence *sentence)
 {
 	struct function *func;
 	struct action *action;
-	int i, j;
 
 	if (sentence->nr_words == 0)
 		return false;
 
 	/* Find a matching action */
-	for (i = 0; i < game->info->nr_actions; i++) {
-		action = &game->info->action[i];
-
-		if (action->type == ACTION_VERB_OPT_NOUN &&
-		    sentence->nr_words > action->nr_words + 1)
-			continue;
-		if (action->type != ACTION_VERB_OPT_NOUN &&
-		    sentence->nr_words != action->nr_words)
-			continue;
-
-		/*
-		 * If all words in a sentence match those for an action then
-		 * run that action's function.
-		 */
-		for (j = 0; j < action->nr_words; j++) {
-			if (sentence->words[j].index == action->word[j] &&
-			    (sentence->words[j].type & action->word_type[j]))
-				continue;
-
-			/* Word didn't match */
-			break;
-		}
-		if (j == action->nr_words)
-		{
-			/* Match */
-			func = &game->info->functions[action->function];
-			eval_function(game, func,
-				      &sentence->words[0], &sentence->words[1]);
-			return true;
-		}
+	action = find_action(game, sentence);
+	if (action) {
+		func = &game->info->functions[action->function];
+		eval_function(game, func,
+			      &sentence->words[0], &sentence->words[1]);
+		return true;
 	}
 
 	/* No matching action */
-	console_println(game, string_lookup(game, STRING_DONT_UNDERSTAND));
+	console_println_string(game, STRING_DONT_UNDERSTAND);
 	return false;
 }
 
@@ -1160,9 +1014,9 @@ static void read_sentence(struct comprehend_game *game, char **line,
 			index = sentence->nr_words;
 
 			/* See if this word and the previous are a word pair */
-			pair = is_word_pair(game,
-					    &sentence->words[index - 2],
-					    &sentence->words[index - 1]);
+			pair = dict_find_word_pair(game,
+						   &sentence->words[index - 2],
+						   &sentence->words[index - 1]);
 			if (pair) {
 				sentence->words[index - 2].index = pair->index;
 				sentence->words[index - 2].type = pair->type;
@@ -1199,20 +1053,17 @@ static void after_turn(struct comprehend_game *game)
 		game->ops->after_turn(game);
 }
 
-static void read_input(struct comprehend_game *game)
+static void begin_turn(struct comprehend_game *game)
 {
-	struct sentence sentence;
-	char *line = NULL, buffer[1024];
-	bool handled;
-
 	if (game->ops->before_prompt)
 		game->ops->before_prompt(game);
 	before_turn(game);
+}
 
-	while (!line) {
-		printf("> ");
-		line = fgets(buffer, sizeof(buffer), stdin);
-	}
+static void handle_input(struct comprehend_game *game, char *line)
+{
+	struct sentence sentence;
+	bool handled;
 
 	/* Re-comprehend special commands start with '!' */
 	if (*line == '!') {
@@ -1236,6 +1087,28 @@ static void read_input(struct comprehend_game *game)
 	}
 }
 
+static void read_input(struct comprehend_game *game)
+{
+	char *line, buffer[1024];
+
+	begin_turn(game);
+
+	printf("> ");
+	line = console_get_line(buffer, sizeof(buffer));
+
+	handle_input(game, line);
+}
+
+/*
+ * Play a single turn with line as the player's input, as if it had been
+ * typed at the prompt. The line is modified.
+ */
+void comprehend_play_line(struct comprehend_game *game, char *line)
+{
+	begin_turn(game);
+	handle_input(game, line);
+}
+
 void comprehend_play_game(struct comprehend_game *game)
 {
 	console_init();
@@ -1243,7 +1116,7 @@ void comprehend_play_game(struct comprehend_game *game)
 	if (game->ops->before_game)
 		game->ops->before_game(game);
 
-	game->info->update_flags = UPDATE_ALL;
+	game->state->update_flags = UPDATE_ALL;
 	while (1)
 		read_input(game);
 }
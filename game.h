@@ -17,21 +17,56 @@
 #define _RECOMPREHEND_GAME_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 struct comprehend_game;
+struct game_state;
 struct function;
 struct item;
 struct word;
 
+/* Player input recorded while a function runs, see console_input_record */
+struct console_input {
+	char			**lines;
+	size_t			nr_lines;
+	size_t			nr_allocated;
+	size_t			next;
+	bool			replay;
+	struct console_input	*parent;
+};
+
 void console_println(struct comprehend_game *game, const char *text);
+void console_println_string(struct comprehend_game *game, uint16_t index);
+void console_set_script(const char *filename);
+char *console_get_line(char *buffer, size_t size);
 int console_get_key(void);
+void console_wait_key(void);
+void console_input_record(struct console_input *input);
+void console_input_replay(struct console_input *input);
+void console_input_end(struct console_input *input);
 
 struct item *get_item(struct comprehend_game *game, uint16_t index);
+struct item *get_item_by_noun(struct comprehend_game *game,
+			      struct word *noun);
+struct item *next_item_by_noun(struct comprehend_game *game,
+			       struct item *item);
+struct item *first_item_with_word(struct comprehend_game *game,
+				  uint8_t index);
+struct item *first_item_in_room(struct comprehend_game *game, uint8_t room);
+struct item *next_item_in_room(struct comprehend_game *game,
+			       struct item *item);
+size_t num_objects_in_room(struct comprehend_game *game, int room);
 void move_object(struct comprehend_game *game, struct item *item, int new_room);
-void eval_function(struct comprehend_game *game, struct function *func,
+void move_to(struct comprehend_game *game, uint8_t room);
+void eval_set_max_call_depth(unsigned depth);
+bool eval_enter_call(struct comprehend_game *game, uint16_t index);
+bool eval_function(struct comprehend_game *game, struct function *func,
 		   struct word *verb, struct word *noun);
 
+void build_action_index(struct comprehend_game *game);
+void build_item_index(struct comprehend_game *game, struct game_state *state);
+void comprehend_play_line(struct comprehend_game *game, char *line);
 void comprehend_play_game(struct comprehend_game *game);
 void game_save(struct comprehend_game *game);
 void game_restore(struct comprehend_game *game);
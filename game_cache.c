@@ -0,0 +1,521 @@
+/*
+ * This file is part of Re-Comprehend
+ *
+ * Ryan Mallon, 2015, <rmallon@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to
+ * the public domain worldwide. This software is distributed without
+ * any warranty.  You should have received a copy of the CC0 Public
+ * Domain Dedication along with this software. If not, see
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ */
+
+/*
+ * Compiled game cache. Parsing a game's data files decodes every string
+ * and walks all of the tables, which is slow compared to just running
+ * the interpreter. The cache stores the fully parsed game_info in a
+ * single file which is mapped read-only on later runs, with the arrays
+ * used in place. All references within the file are file offsets, so it
+ * can be mapped at any address.
+ *
+ * The cache is tied to the exact contents of the game's source files and
+ * to the layout of the structures it stores, and records a hash of its own
+ * contents. A stale or damaged cache is ignored and the game data is
+ * parsed as normal.
+ */
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include "recomprehend.h"
+#include "game_cache.h"
+#include "game_data.h"
+#include "file_buf.h"
+#include "arena.h"
+#include "strings.h"
+#include "util.h"
+
+#define CACHE_MAGIC		"RCMPGAME"
+#define CACHE_VERSION		7
+#define CACHE_ALIGN		8
+
+/* String table entry for a missing string */
+#define CACHE_NO_STRING		0xffffffff
+
+enum {
+	CACHE_INFO,
+	CACHE_ROOMS,
+	CACHE_ITEMS,
+	CACHE_WORDS,
+	CACHE_WORD_MAPS,
+	CACHE_ACTIONS,
+	CACHE_FUNCTIONS,
+	CACHE_INSTRUCTIONS,
+	CACHE_STRINGS,
+	CACHE_STRINGS2,
+	CACHE_REPLACE_WORDS,
+	NR_CACHE_SECTIONS,
+};
+
+struct cache_section {
+	uint64_t		offset;
+	uint64_t		count;
+};
+
+struct cache_header {
+	char			magic[8];
+	uint32_t		version;
+	uint32_t		header_size;
+	uint64_t		source_hash;
+	uint64_t		payload_hash;
+	struct cache_section	section[NR_CACHE_SECTIONS];
+};
+
+static const char *cache_filename;
+
+void game_cache_set_file(const char *filename)
+{
+	cache_filename = filename;
+}
+
+static uint64_t hash_file(uint64_t hash, struct file_cache *files,
+			  const char *dirname, const char *filename)
+{
+	const struct file_buf *fb;
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/%s", dirname, filename);
+	fb = file_cache_map(files, path);
+
+	hash = hash_data(hash, filename, strlen(filename) + 1);
+	hash = hash_data(hash, &fb->size, sizeof(fb->size));
+	hash = hash_data(hash, fb->data, fb->size);
+
+	return hash;
+}
+
+/*
+ * Hash everything the parsed game_info is derived from: the contents of
+ * the game data file and the extra string files, and the sizes of the
+ * structures stored in the cache. Several string tables can come from the
+ * same file, each file's contents are only hashed once.
+ */
+static uint64_t hash_game_files(struct comprehend_game *game,
+				const char *dirname)
+{
+	static const size_t layout[] = {
+		sizeof(struct game_info),
+		sizeof(struct room),
+		sizeof(struct item),
+		sizeof(struct word),
+		sizeof(struct word_map),
+		sizeof(struct action),
+		sizeof(struct function),
+		sizeof(struct instruction),
+	};
+	struct string_file *string_file;
+	struct file_cache files = {0};
+	uint64_t hash = FNV_OFFSET_BASIS;
+	int i, j;
+
+	hash = hash_data(hash, layout, sizeof(layout));
+	hash = hash_data(hash, game->short_name, strlen(game->short_name) + 1);
+	hash = hash_file(hash, &files, dirname, game->game_data_file);
+
+	for (i = 0; i < ARRAY_SIZE(game->string_files); i++) {
+		string_file = &game->string_files[i];
+		if (!string_file->filename)
+			break;
+
+		for (j = 0; j < i; j++)
+			if (strcmp(game->string_files[j].filename,
+				   string_file->filename) == 0)
+				break;
+
+		if (j == i && strcmp(game->game_data_file,
+				     string_file->filename) != 0)
+			hash = hash_file(hash, &files, dirname,
+					 string_file->filename);
+		else
+			hash = hash_data(hash, string_file->filename,
+					 strlen(string_file->filename) + 1);
+
+		hash = hash_data(hash, &string_file->base_offset,
+				 sizeof(string_file->base_offset));
+		hash = hash_data(hash, &string_file->end_offset,
+				 sizeof(string_file->end_offset));
+	}
+
+	file_cache_free(&files);
+	return hash;
+}
+
+/*
+ * Returns the hash of the files the game was loaded from. It is computed
+ * once per load and shared by the cache and native code checks.
+ */
+uint64_t game_cache_hash(struct comprehend_game *game)
+{
+	if (!game->source_hashed) {
+		game->source_hash = hash_game_files(game, game->game_dir);
+		game->source_hashed = true;
+	}
+
+	return game->source_hash;
+}
+
+/*
+ * Hash the section table and everything after the header. The records are
+ * used in place without checking them, so the hash is what keeps a damaged
+ * cache from being used.
+ */
+static uint64_t hash_payload(const struct cache_header *header,
+			     const struct file_buf *fb)
+{
+	uint64_t hash = FNV_OFFSET_BASIS;
+
+	hash = hash_data(hash, header->section, sizeof(header->section));
+	return hash_data(hash, fb->data + sizeof(*header),
+			 fb->size - sizeof(*header));
+}
+
+static void write_padding(FILE *fd)
+{
+	while (ftell(fd) % CACHE_ALIGN)
+		fputc(0, fd);
+}
+
+static void write_section(FILE *fd, struct cache_section *section,
+			  const void *data, size_t entry_size, size_t count)
+{
+	write_padding(fd);
+	section->offset = ftell(fd);
+	section->count = count;
+
+	if (count && fwrite(data, entry_size, count, fd) != count)
+		fatal_strerror(errno, "Cannot write game cache");
+}
+
+/*
+ * String tables are written as the string data followed by an array of
+ * file offsets, one per string.
+ */
+static void write_strings(FILE *fd, struct cache_section *section,
+			  const char **strings, size_t nr_strings)
+{
+	uint32_t *offsets;
+	size_t i;
+
+	offsets = xmalloc(nr_strings * sizeof(*offsets));
+	for (i = 0; i < nr_strings; i++) {
+		if (!strings[i]) {
+			offsets[i] = CACHE_NO_STRING;
+			continue;
+		}
+
+		offsets[i] = ftell(fd);
+		fwrite(strings[i], 1, strlen(strings[i]) + 1, fd);
+	}
+
+	write_section(fd, section, offsets, sizeof(*offsets), nr_strings);
+	free(offsets);
+}
+
+static void write_string_table(FILE *fd, struct cache_section *section,
+			       struct string_table *table)
+{
+	struct string_cache cache;
+	const char **strings;
+	size_t i;
+
+	/* The cache stores the decoded strings */
+	memset(&cache, 0, sizeof(cache));
+	string_table_decode_all(table, &cache);
+
+	strings = xmalloc(table->nr_strings * sizeof(*strings));
+	for (i = 0; i < table->nr_strings; i++)
+		strings[i] = string_table_lookup(table, &cache, i);
+
+	write_strings(fd, section, strings, table->nr_strings);
+	free(strings);
+	string_cache_free(&cache);
+}
+
+static void clear_string_table(struct string_table *table)
+{
+	size_t nr_strings = table->nr_strings;
+
+	memset(table, 0, sizeof(*table));
+	table->nr_strings = nr_strings;
+}
+
+void game_cache_write(struct comprehend_game *game, const char *dirname,
+		      const char *filename)
+{
+	struct game_info *info = game->info, cached_info;
+	struct cache_header header;
+	char tmp_filename[PATH_MAX];
+	struct file_buf fb;
+	FILE *fd;
+
+	/* Pointers are fixed up when the cache is loaded */
+	memcpy(&cached_info, info, sizeof(cached_info));
+	cached_info.rooms = NULL;
+	cached_info.item = NULL;
+	cached_info.words = NULL;
+	memset(&cached_info.word_hash, 0, sizeof(cached_info.word_hash));
+	cached_info.word_table = NULL;
+	cached_info.word_map = NULL;
+	memset(&cached_info.word_pair_hash, 0,
+	       sizeof(cached_info.word_pair_hash));
+	clear_string_table(&cached_info.strings);
+	clear_string_table(&cached_info.strings2);
+	cached_info.action = NULL;
+	memset(&cached_info.action_index, 0, sizeof(cached_info.action_index));
+	cached_info.functions = NULL;
+	cached_info.instructions = NULL;
+	memset(&cached_info.room_images, 0, sizeof(cached_info.room_images));
+	memset(&cached_info.item_images, 0, sizeof(cached_info.item_images));
+	cached_info.replace_words = NULL;
+	cached_info.initial_state = NULL;
+	memset(&cached_info.arena, 0, sizeof(cached_info.arena));
+	memset(&cached_info.files, 0, sizeof(cached_info.files));
+	memset(&cached_info.cache, 0, sizeof(cached_info.cache));
+	cached_info.native = NULL;
+	cached_info.native_handle = NULL;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+	header.version = CACHE_VERSION;
+	header.header_size = sizeof(header);
+	header.source_hash = game_cache_hash(game);
+
+	/*
+	 * Write to a temporary file and rename it into place so that
+	 * interpreters started while the cache is being written never see
+	 * a partial file.
+	 */
+	snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", filename);
+	fd = fopen(tmp_filename, "wb");
+	if (!fd)
+		fatal_strerror(errno, "Cannot create game cache '%s'",
+			       tmp_filename);
+
+	/* Header is rewritten once the section offsets are known */
+	fwrite(&header, sizeof(header), 1, fd);
+
+	write_section(fd, &header.section[CACHE_INFO], &cached_info,
+		      sizeof(cached_info), 1);
+	write_section(fd, &header.section[CACHE_ROOMS], info->rooms,
+		      sizeof(*info->rooms), info->nr_rooms + 1);
+	write_section(fd, &header.section[CACHE_ITEMS], info->item,
+		      sizeof(*info->item), info->header.nr_items);
+	write_section(fd, &header.section[CACHE_WORDS], info->words,
+		      sizeof(*info->words), info->nr_words);
+	write_section(fd, &header.section[CACHE_WORD_MAPS], info->word_map,
+		      sizeof(*info->word_map), info->nr_word_maps);
+	write_section(fd, &header.section[CACHE_ACTIONS], info->action,
+		      sizeof(*info->action), info->nr_actions);
+	write_section(fd, &header.section[CACHE_FUNCTIONS], info->functions,
+		      sizeof(*info->functions), info->nr_functions);
+	write_section(fd, &header.section[CACHE_INSTRUCTIONS],
+		      info->instructions, sizeof(*info->instructions),
+		      info->nr_instructions);
+	write_string_table(fd, &header.section[CACHE_STRINGS],
+			   &info->strings);
+	write_string_table(fd, &header.section[CACHE_STRINGS2],
+			   &info->strings2);
+	write_strings(fd, &header.section[CACHE_REPLACE_WORDS],
+		      (const char **)info->replace_words,
+		      info->nr_replace_words);
+
+	/* Hash what was written, and then rewrite the header */
+	if (fflush(fd) != 0)
+		fatal_strerror(errno, "Cannot write game cache '%s'",
+			       tmp_filename);
+	file_buf_map(tmp_filename, &fb);
+	header.payload_hash = hash_payload(&header, &fb);
+	file_buf_unmap(&fb);
+
+	rewind(fd);
+	fwrite(&header, sizeof(header), 1, fd);
+
+	if (ferror(fd) || fclose(fd) != 0)
+		fatal_strerror(errno, "Cannot write game cache '%s'",
+			       tmp_filename);
+
+	if (rename(tmp_filename, filename) != 0)
+		fatal_strerror(errno, "Cannot rename game cache '%s'",
+			       tmp_filename);
+}
+
+/*
+ * Returns a pointer to a section of the mapped cache, or NULL if the
+ * section does not have the expected number of entries or does not fit
+ * in the file.
+ */
+static void *cache_section_data(struct file_buf *fb,
+				struct cache_section *section,
+				size_t entry_size, size_t count)
+{
+	if (section->count != count || section->offset > fb->size ||
+	    section->count > (fb->size - section->offset) / entry_size)
+		return NULL;
+
+	return (void *)(fb->data + section->offset);
+}
+
+/*
+ * Point strings at the strings in the cache. Returns false if a string
+ * does not end within the file.
+ */
+static bool cache_strings(struct file_buf *fb, struct cache_section *section,
+			  char **strings, size_t nr_strings)
+{
+	uint32_t *offsets;
+	size_t i;
+
+	offsets = cache_section_data(fb, section, sizeof(*offsets),
+				     nr_strings);
+	if (!offsets)
+		return false;
+
+	for (i = 0; i < nr_strings; i++) {
+		if (offsets[i] == CACHE_NO_STRING) {
+			strings[i] = NULL;
+			continue;
+		}
+
+		if (offsets[i] >= fb->size ||
+		    !memchr(fb->data + offsets[i], '\0',
+			    fb->size - offsets[i]))
+			return false;
+
+		strings[i] = (char *)fb->data + offsets[i];
+	}
+
+	return true;
+}
+
+/*
+ * Strings in the cache are already decoded, so the table entries point
+ * straight at them and have no file to decode from.
+ */
+static bool cache_string_table(struct game_info *info, struct file_buf *fb,
+			       struct cache_section *section,
+			       struct string_table *table)
+{
+	char **strings;
+	size_t i;
+
+	strings = xmalloc(table->nr_strings * sizeof(*strings));
+	if (!cache_strings(fb, section, strings, table->nr_strings)) {
+		free(strings);
+		return false;
+	}
+
+	table->entries = arena_alloc(&info->arena, table->nr_strings *
+				     sizeof(*table->entries));
+	table->nr_allocated = table->nr_strings;
+	for (i = 0; i < table->nr_strings; i++)
+		table->entries[i].string = strings[i];
+
+	free(strings);
+	return true;
+}
+
+/*
+ * Load the game info from the cache file, if one was given and it is
+ * valid for the game files in dirname. Returns false if the game data
+ * needs to be parsed instead.
+ */
+bool game_cache_load(struct comprehend_game *game, const char *dirname)
+{
+	struct game_info *info = game->info, *cached_info;
+	struct cache_section *section;
+	struct cache_header *header;
+	struct file_buf fb;
+
+	if (!cache_filename)
+		return false;
+
+	if (file_buf_map_may_fail(cache_filename, &fb) != 0) {
+		debug_printf(DEBUG_GAME_STATE, "No game cache '%s'\n",
+			     cache_filename);
+		return false;
+	}
+
+	header = (struct cache_header *)fb.data;
+	if (fb.size < sizeof(*header) ||
+	    memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+	    header->version != CACHE_VERSION ||
+	    header->header_size != sizeof(*header) ||
+	    header->source_hash != game_cache_hash(game) ||
+	    header->payload_hash != hash_payload(header, &fb))
+		goto stale;
+
+	section = header->section;
+	cached_info = cache_section_data(&fb, &section[CACHE_INFO],
+					 sizeof(*cached_info), 1);
+	if (!cached_info)
+		goto stale;
+
+	memcpy(info, cached_info, sizeof(*info));
+
+	info->rooms = cache_section_data(&fb, &section[CACHE_ROOMS],
+					 sizeof(*info->rooms),
+					 info->nr_rooms + 1);
+	info->item = cache_section_data(&fb, &section[CACHE_ITEMS],
+					sizeof(*info->item),
+					info->header.nr_items);
+	info->words = cache_section_data(&fb, &section[CACHE_WORDS],
+					 sizeof(*info->words),
+					 info->nr_words);
+	info->word_map = cache_section_data(&fb, &section[CACHE_WORD_MAPS],
+					    sizeof(*info->word_map),
+					    info->nr_word_maps);
+	info->action = cache_section_data(&fb, &section[CACHE_ACTIONS],
+					  sizeof(*info->action),
+					  info->nr_actions);
+	info->functions = cache_section_data(&fb, &section[CACHE_FUNCTIONS],
+					     sizeof(*info->functions),
+					     info->nr_functions);
+	info->instructions = cache_section_data(&fb,
+						&section[CACHE_INSTRUCTIONS],
+						sizeof(*info->instructions),
+						info->nr_instructions);
+	if (!info->rooms || !info->item || !info->words || !info->word_map ||
+	    !info->action || !info->functions || !info->instructions)
+		goto stale;
+
+	info->replace_words = arena_alloc(&info->arena,
+					  info->nr_replace_words *
+					  sizeof(*info->replace_words));
+
+	if (!cache_string_table(info, &fb, &section[CACHE_STRINGS],
+				&info->strings) ||
+	    !cache_string_table(info, &fb, &section[CACHE_STRINGS2],
+				&info->strings2) ||
+	    !cache_strings(&fb, &section[CACHE_REPLACE_WORDS],
+			   info->replace_words, info->nr_replace_words))
+		goto stale;
+
+	/* The cache stays mapped until the game is unloaded */
+	info->cache = fb;
+	return true;
+
+stale:
+	debug_printf(DEBUG_GAME_STATE, "Ignoring stale game cache '%s'\n",
+		     cache_filename);
+	arena_free(&info->arena);
+	memset(info, 0, sizeof(*info));
+	file_buf_unmap(&fb);
+	return false;
+}
@@ -0,0 +1,30 @@
+/*
+ * This file is part of Re-Comprehend
+ *
+ * Ryan Mallon, 2015, <rmallon@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to
+ * the public domain worldwide. This software is distributed without
+ * any warranty.  You should have received a copy of the CC0 Public
+ * Domain Dedication along with this software. If not, see
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ */
+
+#ifndef _RECOMPREHEND_GAME_CACHE_H
+#define _RECOMPREHEND_GAME_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct comprehend_game;
+
+void game_cache_set_file(const char *filename);
+bool game_cache_load(struct comprehend_game *game, const char *dirname);
+void game_cache_write(struct comprehend_game *game, const char *dirname,
+		      const char *filename);
+uint64_t game_cache_hash(struct comprehend_game *game);
+
+#endif /* _RECOMPREHEND_GAME_CACHE_H */
@@ -23,8 +23,8 @@
 static void cc_clear_companion_flags(struct comprehend_game *game)
 {
 	/* Clear the Sabrina/Erik action flags */
-	game->info->flags[0xa] = 0;
-	game->info->flags[0xb] = 0;
+	game->state->flags[0xa] = 0;
+	game->state->flags[0xb] = 0;
 }
 
 static bool cc_common_handle_special_opcode(struct comprehend_game *game,
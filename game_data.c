@@ -23,16 +23,18 @@
 #include "recomprehend.h"
 #include "dump_game_data.h"
 #include "dictionary.h"
+#include "arena.h"
+#include "game_cache.h"
 #include "game_data.h"
+#include "game_native.h"
+#include "opcode_map.h"
 #include "file_buf.h"
 #include "strings.h"
 #include "graphics.h"
+#include "thread_pool.h"
 #include "game.h"
 #include "util.h"
 
-static char charset[] = "..abcdefghijklmnopqrstuvwxyz .";
-static char special_charset[] = "[]\n!\"#$%&'(),-/0123456789:;?<>";
-
 static uint16_t magic_offset;
 
 static void parse_header_le16(struct file_buf *fb, uint16_t *val)
@@ -58,7 +60,8 @@ static uint8_t parse_vm_instruction(struct file_buf *fb,
 {
 	int i;
 
-	/* Get the opcode */
+	/* Get the opcode, unused operands are zero */
+	memset(instr->operand, 0, sizeof(instr->operand));
 	file_buf_get_u8(fb, &instr->opcode);
 	instr->nr_operands = opcode_nr_operands(instr->opcode);
 
@@ -71,47 +74,84 @@ static uint8_t parse_vm_instruction(struct file_buf *fb,
 	return instr->opcode;
 }
 
-static void parse_function(struct file_buf *fb, struct function *func)
+static void parse_function(struct comprehend_game *game, struct file_buf *fb,
+			   struct function *func, size_t *nr_allocated)
 {
+	struct game_info *info = game->info;
 	struct instruction *instruction;
-	uint8_t *p, opcode;
+	const uint8_t *p;
+	uint8_t opcode;
 
 	p = memchr(file_buf_data_pointer(fb), 0x00,
 		   fb->size - file_buf_get_pos(fb));
 	if (!p)
 		fatal_error("bad function @ %.4x", file_buf_get_pos(fb));
 
+	/*
+	 * Instructions are appended to the shared instruction array. The
+	 * terminating zero opcode is parsed into the next free slot but is
+	 * not kept.
+	 */
+	func->first_instruction = info->nr_instructions;
+	func->nr_instructions = 0;
 	while (1) {
-		instruction = &func->instructions[func->nr_instructions];
+		info->instructions = grow_array(info->instructions,
+						nr_allocated,
+						info->nr_instructions + 1,
+						sizeof(*info->instructions));
+		instruction = &info->instructions[info->nr_instructions];
 
 		opcode = parse_vm_instruction(fb, instruction);
 		if (opcode == 0)
 			break;
 
+		info->nr_instructions++;
 		func->nr_instructions++;
-		if (func->nr_instructions >= ARRAY_SIZE(func->instructions))
-			fatal_error("Function has too many instructions");
 	}
 }
 
 static void parse_vm(struct comprehend_game *game, struct file_buf *fb)
 {
+	struct game_info *info = game->info;
+	size_t nr_functions_allocated = 0, nr_instructions_allocated = 0;
 	struct function *func;
 
-	file_buf_set_pos(fb, game->info->header.addr_vm);
+	file_buf_set_pos(fb, info->header.addr_vm);
 	while (1) {
-		func = &game->info->functions[game->info->nr_functions];
+		info->functions = grow_array(info->functions,
+					     &nr_functions_allocated,
+					     info->nr_functions + 1,
+					     sizeof(*info->functions));
+		func = &info->functions[info->nr_functions];
 
-		parse_function(fb, func);
+		parse_function(game, fb, func, &nr_instructions_allocated);
 		if (func->nr_instructions == 0)
 			break;
 
-		game->info->nr_functions++;
+		info->nr_functions++;
 	}
+
+	/* Move the arrays into the arena now that they are complete */
+	info->functions = arena_move(&info->arena, info->functions,
+				     info->nr_functions *
+				     sizeof(*info->functions));
+	info->instructions = arena_move(&info->arena, info->instructions,
+					info->nr_instructions *
+					sizeof(*info->instructions));
+}
+
+static struct action *new_action(struct comprehend_game *game,
+				 size_t *nr_allocated)
+{
+	struct game_info *info = game->info;
+
+	info->action = grow_array(info->action, nr_allocated,
+				  info->nr_actions + 1, sizeof(*info->action));
+	return &info->action[info->nr_actions++];
 }
 
 static void parse_action_table_vvnn(struct comprehend_game *game,
-				    struct file_buf *fb, size_t *index)
+				    struct file_buf *fb, size_t *nr_allocated)
 {
 	struct action *action;
 	uint8_t verb, count;
@@ -135,7 +175,7 @@ static void parse_action_table_vvnn(struct comprehend_game *game,
 		file_buf_get_u8(fb, &count);
 
 		for (i = 0; i < count; i++) {
-			action = &game->info->action[*index];
+			action = new_action(game, nr_allocated);
 			action->type = ACTION_VERB_VERB_NOUN_NOUN;
 
 			action->nr_words = 4;
@@ -149,14 +189,12 @@ static void parse_action_table_vvnn(struct comprehend_game *game,
 			for (j = 0; j < 3; j++)
 				file_buf_get_u8(fb, &action->word[j + 1]);
 			file_buf_get_le16(fb, &action->function);
-
-			(*index)++;
 		}
 	}
 }
 
 static void parse_action_table_vnjn(struct comprehend_game *game,
-				    struct file_buf *fb, size_t *index)
+				    struct file_buf *fb, size_t *nr_allocated)
 {
 	struct action *action;
 	uint8_t join, count;
@@ -180,7 +218,7 @@ static void parse_action_table_vnjn(struct comprehend_game *game,
 		file_buf_get_u8(fb, &count);
 
 		for (i = 0; i < count; i++) {
-			action = &game->info->action[*index];
+			action = new_action(game, nr_allocated);
 			action->type = ACTION_VERB_NOUN_JOIN_NOUN;
 
 			action->nr_words = 4;
@@ -195,14 +233,12 @@ static void parse_action_table_vnjn(struct comprehend_game *game,
 			file_buf_get_u8(fb, &action->word[1]);
 			file_buf_get_u8(fb, &action->word[3]);
 			file_buf_get_le16(fb, &action->function);
-
-			(*index)++;
 		}
 	}
 }
 
 static void parse_action_table_vjn(struct comprehend_game *game,
-				   struct file_buf *fb, size_t *index)
+				   struct file_buf *fb, size_t *nr_allocated)
 {
 	struct action *action;
 	uint8_t join, count;
@@ -225,7 +261,7 @@ static void parse_action_table_vjn(struct comprehend_game *game,
 		file_buf_get_u8(fb, &count);
 
 		for (i = 0; i < count; i++) {
-			action = &game->info->action[*index];
+			action = new_action(game, nr_allocated);
 			action->type = ACTION_VERB_JOIN_NOUN;
 			action->word[1] = join;
 
@@ -237,14 +273,12 @@ static void parse_action_table_vjn(struct comprehend_game *game,
 			file_buf_get_u8(fb, &action->word[0]);
 			file_buf_get_u8(fb, &action->word[2]);
 			file_buf_get_le16(fb, &action->function);
-
-			(*index)++;
 		}
 	}
 }
 
 static void parse_action_table_vdn(struct comprehend_game *game,
-				   struct file_buf *fb, size_t *index)
+				   struct file_buf *fb, size_t *nr_allocated)
 {
 	struct action *action;
 	uint8_t verb, count;
@@ -267,7 +301,7 @@ static void parse_action_table_vdn(struct comprehend_game *game,
 		file_buf_get_u8(fb, &count);
 
 		for (i = 0; i < count; i++) {
-			action = &game->info->action[*index];
+			action = new_action(game, nr_allocated);
 			action->type = ACTION_VERB_JOIN_NOUN;
 			action->word[0] = verb;
 
@@ -279,14 +313,12 @@ static void parse_action_table_vdn(struct comprehend_game *game,
 			file_buf_get_u8(fb, &action->word[1]);
 			file_buf_get_u8(fb, &action->word[2]);
 			file_buf_get_le16(fb, &action->function);
-
-			(*index)++;
 		}
 	}
 }
 
 static void parse_action_table_vnn(struct comprehend_game *game,
-				   struct file_buf *fb, size_t *index)
+				   struct file_buf *fb, size_t *nr_allocated)
 {
 	struct action *action;
 	uint8_t verb, count;
@@ -310,7 +342,7 @@ static void parse_action_table_vnn(struct comprehend_game *game,
 		file_buf_get_u8(fb, &count);
 
 		for (i = 0; i < count; i++) {
-			action = &game->info->action[*index];
+			action = new_action(game, nr_allocated);
 			action->type = ACTION_VERB_NOUN_NOUN;
 			action->word[0] = verb;
 
@@ -322,14 +354,12 @@ static void parse_action_table_vnn(struct comprehend_game *game,
 			file_buf_get_u8(fb, &action->word[1]);
 			file_buf_get_u8(fb, &action->word[2]);
 			file_buf_get_le16(fb, &action->function);
-
-			(*index)++;
 		}
 	}
 }
 
 static void parse_action_table_vn(struct comprehend_game *game,
-				  struct file_buf *fb, size_t *index)
+				  struct file_buf *fb, size_t *nr_allocated)
 {
 	struct action *action;
 	uint8_t verb, count;
@@ -352,7 +382,7 @@ static void parse_action_table_vn(struct comprehend_game *game,
 		file_buf_get_u8(fb, &count);
 
 		for (i = 0; i < count; i++) {
-			action = &game->info->action[*index];
+			action = new_action(game, nr_allocated);
 			action->type = ACTION_VERB_NOUN;
 			action->word[0] = verb;
 
@@ -362,14 +392,12 @@ static void parse_action_table_vn(struct comprehend_game *game,
 
 			file_buf_get_u8(fb, &action->word[1]);
 			file_buf_get_le16(fb, &action->function);
-
-			(*index)++;
 		}
 	}
 }
 
 static void parse_action_table_v(struct comprehend_game *game,
-				 struct file_buf *fb, size_t *index)
+				 struct file_buf *fb, size_t *nr_allocated)
 {
 	struct action *action;
 	uint8_t verb, nr_funcs;
@@ -389,7 +417,7 @@ static void parse_action_table_v(struct comprehend_game *game,
 		if (verb == 0)
 			break;
 
-		action = &game->info->action[*index];
+		action = new_action(game, nr_allocated);
 		action->type = ACTION_VERB_OPT_NOUN;
 		action->word[0] = verb;
 
@@ -407,28 +435,32 @@ static void parse_action_table_v(struct comprehend_game *game,
 			if (i == 0)
 				action->function = func;
 		}
-
-		(*index)++;
 	}
 }
 
 static void parse_action_table(struct comprehend_game *game,
 			       struct file_buf *fb)
 {
+	size_t nr_allocated = 0;
+
 	game->info->nr_actions = 0;
 
 	if (game->info->comprehend_version == 1) {
-		parse_action_table_vvnn(game, fb, &game->info->nr_actions);
-		parse_action_table_vdn(game, fb, &game->info->nr_actions);
+		parse_action_table_vvnn(game, fb, &nr_allocated);
+		parse_action_table_vdn(game, fb, &nr_allocated);
 	}
 	if (game->info->comprehend_version >= 2) {
-		parse_action_table_vnn(game, fb, &game->info->nr_actions);
+		parse_action_table_vnn(game, fb, &nr_allocated);
 	}
 
-	parse_action_table_vnjn(game, fb, &game->info->nr_actions);
-	parse_action_table_vjn(game, fb, &game->info->nr_actions);
-	parse_action_table_vn(game, fb, &game->info->nr_actions);
-	parse_action_table_v(game, fb, &game->info->nr_actions);
+	parse_action_table_vnjn(game, fb, &nr_allocated);
+	parse_action_table_vjn(game, fb, &nr_allocated);
+	parse_action_table_vn(game, fb, &nr_allocated);
+	parse_action_table_v(game, fb, &nr_allocated);
+
+	game->info->action = arena_move(&game->info->arena, game->info->action,
+					game->info->nr_actions *
+					sizeof(*game->info->action));
 }
 
 static void parse_dictionary(struct comprehend_game *game, struct file_buf *fb)
@@ -437,7 +469,8 @@ static void parse_dictionary(struct comprehend_game *game, struct file_buf *fb)
 	int i, j;
 
 	// FIXME - fixed size 0xff array?
-	game->info->words = xmalloc(game->info->nr_words * sizeof(struct word));
+	game->info->words = arena_alloc(&game->info->arena,
+					game->info->nr_words * sizeof(struct word));
 
 	file_buf_set_pos(fb, game->info->header.addr_dictionary);
 	for (i = 0; i < game->info->nr_words; i++) {
@@ -455,41 +488,62 @@ static void parse_dictionary(struct comprehend_game *game, struct file_buf *fb)
 	}
 }
 
+/*
+ * Count the entries in the word pair table, which is terminated by an
+ * entry with a zero first word.
+ */
+static size_t count_word_maps(struct comprehend_game *game,
+			      struct file_buf *fb)
+{
+	struct file_buf pos = *fb;
+	uint8_t index, type;
+	size_t count = 0;
+
+	file_buf_set_pos(&pos, game->info->header.addr_word_map);
+	while (1) {
+		file_buf_get_u8(&pos, &index);
+		file_buf_get_u8(&pos, &type);
+		if (type == 0 && index == 0)
+			break;
+
+		file_buf_get_data(&pos, NULL, 3);
+		count++;
+	}
+
+	return count;
+}
+
 static void parse_word_map(struct comprehend_game *game, struct file_buf *fb)
 {
 	struct word_map	*map;
-	uint8_t index, type, dummy;
+	uint8_t index, type;
 	int i;
 
-	game->info->nr_word_maps = 0;
+	game->info->nr_word_maps = count_word_maps(game, fb);
+	game->info->word_map = arena_alloc(&game->info->arena,
+					   game->info->nr_word_maps *
+					   sizeof(*game->info->word_map));
 	file_buf_set_pos(fb, game->info->header.addr_word_map);
 
 	/*
 	 * Parse the word pair table. Each entry has a pair of dictionary
 	 * index/type values for a first and second word.
 	 */
-	while (1) {
-		map = &game->info->word_map[game->info->nr_word_maps];
+	for (i = 0; i < game->info->nr_word_maps; i++) {
+		map = &game->info->word_map[i];
 
 		file_buf_get_u8(fb, &index);
 		file_buf_get_u8(fb, &type);
-		if (type == 0 && index == 0) {
-			/* End of pairs */
-			break;
-		}
 
 		map->word[0].index = index;
 		map->word[0].type = type;
 		file_buf_get_u8(fb, &map->flags);
 		file_buf_get_u8(fb, &map->word[1].index);
 		file_buf_get_u8(fb, &map->word[1].type);
-
-		game->info->nr_word_maps++;
 	}
 
-	/* Consume two more null bytes (type and index were also null) */
-	file_buf_get_u8(fb, &dummy);
-	file_buf_get_u8(fb, &dummy);
+	/* Skip the null index and type ending the pairs, and two more nulls */
+	file_buf_get_data(fb, NULL, 4);
 
 	/*
 	 * Parse the target word table. Each entry has a dictionary
@@ -508,6 +562,9 @@ static void parse_items(struct comprehend_game *game, struct file_buf *fb)
 {
 	size_t nr_items = game->info->header.nr_items;
 
+	game->info->item = arena_alloc(&game->info->arena,
+				       nr_items * sizeof(*game->info->item));
+
 	/* Item descriptions */
 	file_buf_set_pos(fb, game->info->header.addr_item_strings);
 	file_buf_get_array_le16(fb, 0, game->info->item, string_desc, nr_items);
@@ -541,6 +598,9 @@ static void parse_rooms(struct comprehend_game *game, struct file_buf *fb)
 	size_t nr_rooms = game->info->nr_rooms;
 	int i;
 
+	game->info->rooms = arena_alloc(&game->info->arena, (nr_rooms + 1) *
+					sizeof(*game->info->rooms));
+
 	/* Room exit directions */
 	for (i = 0; i < NR_DIRECTIONS; i++) {
 		file_buf_set_pos(fb, game->info->header.room_direction_table[i]);
@@ -561,134 +621,44 @@ static void parse_rooms(struct comprehend_game *game, struct file_buf *fb)
 	file_buf_get_array_u8(fb, 1, game->info->rooms, graphic, nr_rooms);
 }
 
-static uint64_t string_get_chunk(uint8_t *string)
-{
-	uint64_t c, val = 0;
-	int i;
-
-	for (i = 0; i < 5; i++) {
-		c = string[i] & 0xff;
-		val |= (c << ((4 - i) * 8));
-	}
-
-	return val;
-}
-
-static char decode_string_elem(uint8_t c, bool capital, bool special)
-{
-	if (special) {
-		if (c < sizeof(special_charset) - 1)
-			return special_charset[c];
-	} else {
-		if (c < sizeof(charset) - 1) {
-			c = charset[c];
-			if (capital) {
-				/*
-				 * A capital space means that the character
-				 * is dynamically replaced by at runtime.
-				 * We use the character '@' since it cannot
-				 * otherwise appear in strings.
-				 */
-				if (c == ' ')
-					return '@';
-				return c - 0x20;
-			} else {
-				return c;
-			}
-		}
-	}
-
-	/* Unknown character */
-	printf("Unknown char %d, caps=%d, special=%d\n", c, capital, special);
-	return '*';
-}
-
-/*
- * Game strings are stored using 5-bit characters. By default a character
- * value maps to the lower-case letter table. If a character has the value 0x1e
- * then the next character is upper-case. An upper-case space is used to
- * specify that the character should be replaced at runtime (like a '%s'
- * specifier). If a character has the value 0x1f then the next character is
- * taken from the symbols table.
- */
-static char *parse_string(struct file_buf *fb)
+static void parse_string_table(const struct file_buf *file,
+			       unsigned start_addr, uint32_t end_addr,
+			       struct string_table *table)
 {
-	bool capital_next = false, special_next = false;
-	unsigned i, j, k = 0;
-	uint64_t chunk;
-	uint8_t elem, *encoded;
-	char *string, c;
-	size_t encoded_len;
-
-	encoded_len = file_buf_strlen(fb, NULL);
-	string = xmalloc(encoded_len * 2);
-
-	/* Get the encoded string */
-	encoded = xmalloc(encoded_len + 5);
-	memset(encoded, 0, encoded_len);
-	file_buf_get_data(fb, encoded, encoded_len);
-
-	/* Skip over the zero byte */
-	if (file_buf_get_pos(fb) < fb->size)
-		file_buf_get_u8(fb, NULL);
-
-	for (i = 0; i < encoded_len; i += 5) {
-		chunk = string_get_chunk(&encoded[i]);
-
-		for (j = 0; j < 8; j++) {
-			elem = (chunk >> (35 - (5 * j))) & 0x1f;
-
-			if (elem == 0)
-				goto done;
-			if (elem == 0x1e) {
-				capital_next = true;
-			} else if (elem == 0x1f) {
-				special_next = true;
-			} else {
-				c = decode_string_elem(elem, capital_next,
-						       special_next);
-				special_next = false;
-				capital_next = false;
-				string[k++] = c;
-			}
-		}
-	}
-
-done:
-	string[k] = '\0';
-	free(encoded);
-
-	return string;
-}
+	struct file_buf fb = *file;
+	unsigned pos;
 
-static void parse_string_table(struct file_buf *fb, unsigned start_addr,
-			       uint32_t end_addr, struct string_table *table)
-{
-	file_buf_set_pos(fb, start_addr);
+	/*
+	 * Only the location of each string is recorded here. The strings
+	 * are decoded when they are first looked up.
+	 */
+	file_buf_set_pos(&fb, start_addr);
 	while (1) {
-		table->strings[table->nr_strings++] = parse_string(fb);
-		if (file_buf_get_pos(fb) >= end_addr)
+		pos = file_buf_get_pos(&fb);
+		string_table_add(table, file, pos);
+		string_skip(&fb);
+		if (file_buf_get_pos(&fb) >= end_addr)
 			break;
 	}
 }
 
-static void parse_variables(struct comprehend_game *game, struct file_buf *fb)
+static void parse_variables(struct file_buf *fb, uint16_t *variable)
 {
 	int i;
 
-	for (i = 0; i < ARRAY_SIZE(game->info->variable); i++)
-		file_buf_get_le16(fb, &game->info->variable[i]);
+	for (i = 0; i < MAX_VARIABLES; i++)
+		file_buf_get_le16(fb, &variable[i]);
 }
 
-static void parse_flags(struct comprehend_game *game, struct file_buf *fb)
+static void parse_flags(struct file_buf *fb, bool *flags)
 {
 	int i, bit, flag_index = 0;
 	uint8_t bitmask;
 
-	for (i = 0; i < ARRAY_SIZE(game->info->flags) / 8; i++) {
+	for (i = 0; i < MAX_FLAGS / 8; i++) {
 		file_buf_get_u8(fb, &bitmask);
 		for (bit = 7; bit >= 0; bit--) {
-			game->info->flags[flag_index] = !!(bitmask & (1 << bit));
+			flags[flag_index] = !!(bitmask & (1 << bit));
 			flag_index++;
 		}
 	}
@@ -697,10 +667,10 @@ static void parse_flags(struct comprehend_game *game, struct file_buf *fb)
 static void parse_replace_words(struct comprehend_game *game,
 				struct file_buf *fb)
 {
+	struct file_buf pos;
+	size_t len, count, i;
 	uint16_t dummy;
-	size_t len;
 	bool eof;
-	int i;
 
 	/* FIXME - Rename addr_strings_end */
 	file_buf_set_pos(fb, game->info->header.addr_strings_end);
@@ -708,17 +678,29 @@ static void parse_replace_words(struct comprehend_game *game,
 	/* FIXME - what is this for */
 	file_buf_get_le16(fb, &dummy);
 
-	for (i = 0; ; i++) {
-		len = file_buf_strlen(fb, &eof);
+	/* Count the words first so the table can be sized */
+	pos = *fb;
+	for (count = 0; ; count++) {
+		len = file_buf_strlen(&pos, &eof);
 		if (len == 0)
 			break;
 
-		game->info->replace_words[i] = xstrndup((char *)fb->p, len);
-		file_buf_get_data(fb, NULL, len + (eof ? 0 : 1));
+		/* A word which runs into the end of the file is not used */
 		if (eof)
 			break;
+		file_buf_get_data(&pos, NULL, len + 1);
 	}
-	game->info->nr_replace_words = i;
+
+	game->info->replace_words = arena_alloc(&game->info->arena, count *
+						sizeof(char *));
+	for (i = 0; i < count; i++) {
+		len = file_buf_strlen(fb, NULL);
+		game->info->replace_words[i] =
+			arena_strndup(&game->info->arena,
+				      (const char *)fb->p, len);
+		file_buf_get_data(fb, NULL, len + 1);
+	}
+	game->info->nr_replace_words = count;
 }
 
 /*
@@ -833,70 +815,107 @@ static void parse_header(struct comprehend_game *game, struct file_buf *fb)
 	file_buf_get_u8(fb, &game->info->start_room);
 	file_buf_get_u8(fb, &dummy8);
 
-	parse_variables(game, fb);
-	parse_flags(game, fb);
+	parse_variables(fb, game->info->variable);
+	parse_flags(fb, game->info->flags);
 
 	game->info->nr_rooms = header->room_direction_table[DIRECTION_SOUTH] -
 		header->room_direction_table[DIRECTION_NORTH];
+	if (game->info->start_room == 0 ||
+	    game->info->start_room > game->info->nr_rooms)
+		fatal_error("Start room %d is invalid\n", game->info->start_room);
 
 	game->info->nr_words = (addr_dictionary_end -
 				header->addr_dictionary) / 8;
 }
 
-static void load_extra_string_file(struct comprehend_game *game,
-				   const char *dirname,
-				   struct string_file *string_file)
+/*
+ * An extra string file is scanned into its own table on the loader
+ * threads, and the tables are added to strings2 in order afterwards.
+ */
+struct string_file_load {
+	struct file_cache	*files;
+	struct string_file	*string_file;
+	char			filename[PATH_MAX];
+	struct string_table	table;
+};
+
+static void load_extra_string_file(void *data)
 {
-	char filename[PATH_MAX];
-	struct file_buf fb;
+	struct string_file_load *load = data;
+	const struct file_buf *fb;
 	unsigned end;
 
-	snprintf(filename, sizeof(filename), "%s/%s", dirname,
-		 string_file->filename);
-	file_buf_map(filename, &fb);
+	fb = file_cache_map(load->files, load->filename);
 
-	if (string_file->end_offset)
-		end = string_file->end_offset;
+	if (load->string_file->end_offset)
+		end = load->string_file->end_offset;
 	else
-		end = fb.size;
-
-	parse_string_table(&fb, string_file->base_offset,
-			   end, &game->info->strings2);
+		end = fb->size;
 
-	file_buf_unmap(&fb);
+	parse_string_table(fb, load->string_file->base_offset,
+			   end, &load->table);
 }
 
-static void load_extra_string_files(struct comprehend_game *game,
-				    const char *dirname)
+static void queue_extra_string_files(struct comprehend_game *game,
+				     const char *dirname,
+				     struct string_file_load *loads,
+				     struct thread_pool *pool)
 {
+	struct string_file_load *load;
 	int i;
 
-	memset(&game->info->strings2, 0, sizeof(game->info->strings2));
+	for (i = 0; i < ARRAY_SIZE(game->string_files); i++) {
+		if (!game->string_files[i].filename)
+			break;
+
+		load = &loads[i];
+		load->files = &game->info->files;
+		load->string_file = &game->string_files[i];
+		snprintf(load->filename, sizeof(load->filename), "%s/%s",
+			 dirname, load->string_file->filename);
+		thread_pool_add(pool, load_extra_string_file, load);
+	}
+}
+
+static void add_extra_string_files(struct comprehend_game *game,
+				   struct string_file_load *loads)
+{
+	struct string_table *table = &game->info->strings2;
+	struct string_entry *entry;
+	size_t i, j;
+
+	memset(table, 0, sizeof(*table));
 
 	for (i = 0; i < ARRAY_SIZE(game->string_files); i++) {
 		if (!game->string_files[i].filename)
 			break;
 
 		// HACK - get string offsets correct
-		game->info->strings2.nr_strings = 0x40 * i;
-		if (game->info->strings2.nr_strings == 0)
-			game->info->strings2.nr_strings++;
+		table->nr_strings = 0x40 * i;
+		if (table->nr_strings == 0)
+			table->nr_strings++;
 
-		load_extra_string_file(game, dirname, &game->string_files[i]);
+		for (j = 0; j < loads[i].table.nr_strings; j++) {
+			entry = &loads[i].table.entries[j];
+			string_table_add(table, entry->file, entry->offset);
+		}
+		free(loads[i].table.entries);
 	}
+
+	string_table_trim(table, &game->info->arena);
 }
 
 static void load_game_data(struct comprehend_game *game, const char *dirname)
 {
 	char data_file[PATH_MAX];
+	const struct file_buf *file;
 	struct file_buf fb;
 
 	snprintf(data_file, sizeof(data_file), "%s/%s",
 		 dirname, game->game_data_file);
 
-	memset(game->info, 0, sizeof(*game->info));
-
-	file_buf_map(data_file, &fb);
+	file = file_cache_map(&game->info->files, data_file);
+	fb = *file;
 
 	parse_header(game, &fb);
 	parse_rooms(game, &fb);
@@ -904,32 +923,219 @@ static void load_game_data(struct comprehend_game *game, const char *dirname)
 	parse_dictionary(game, &fb);
 	parse_word_map(game, &fb);
 	memset(&game->info->strings, 0, sizeof(game->info->strings));
-	parse_string_table(&fb, game->info->header.addr_strings,
+	parse_string_table(file, game->info->header.addr_strings,
 			   game->info->header.addr_strings_end,
 			   &game->info->strings);
-	load_extra_string_files(game, dirname);
+	string_table_trim(&game->info->strings, &game->info->arena);
 	parse_vm(game, &fb);
 	parse_action_table(game, &fb);
 	parse_replace_words(game, &fb);
+}
 
-	file_buf_unmap(&fb);
+/*
+ * Take a snapshot of the initial play state from the loaded game data.
+ * New sessions and restarts just copy the snapshot.
+ */
+static void capture_initial_state(struct game_info *info)
+{
+	struct game_state *state;
+
+	state = arena_alloc(&info->arena, sizeof(*state));
+
+	/* The game info is never modified, so its tables can be shared */
+	state->rooms = info->rooms;
+	state->item = info->item;
+	state->replace_words = info->replace_words;
+	state->nr_replace_words = info->nr_replace_words;
+	memcpy(state->flags, info->flags, sizeof(state->flags));
+	memcpy(state->variable, info->variable, sizeof(state->variable));
+
+	state->current_room = info->start_room;
+	state->update_flags = UPDATE_ALL;
+
+	info->initial_state = state;
 }
 
 void comprehend_load_game(struct comprehend_game *game, const char *dirname)
 {
+	struct string_file_load string_loads[MAX_FILES] = {0};
+	struct thread_pool *pool;
+	bool cached;
+
+	/* Release everything from a previous load of the game */
+	if (game->state)
+		comprehend_unload_game(game);
+
 	game->game_dir = dirname;
+	game->source_hashed = false;
+	cached = game_cache_load(game, dirname);
+
+	/*
+	 * The extra string files and the image files are independent of
+	 * each other and of the main game data file, so load them on the
+	 * pool while the main game data file is parsed here. Nothing else
+	 * may allocate from the game's arena until the pool is done.
+	 */
+	pool = thread_pool_create();
 
-	/* Load the main game data file */
-	load_game_data(game, dirname);
+	if (!cached) {
+		memset(game->info, 0, sizeof(*game->info));
+		queue_extra_string_files(game, dirname, string_loads, pool);
+	}
 
 	if (g_enabled()) {
-		comprehend_load_images(game, dirname);
+		comprehend_load_images(game, dirname, pool);
 		if (game->color_table)
 			g_set_color_table(game->color_table);
 	}
 
-	/* FIXME - This can be merged, don't need to keep start room around */
-	game->info->current_room = game->info->start_room;
+	/* Load the main game data file, unless there is a compiled cache */
+	if (!cached)
+		load_game_data(game, dirname);
+
+	thread_pool_wait(pool);
+	thread_pool_free(pool);
+
+	/* A compiled cache already holds the decoded instructions */
+	if (!cached) {
+		add_extra_string_files(game, string_loads);
+		decode_instructions(game);
+	}
+
+	dict_build_index(game);
+	build_action_index(game);
+	capture_initial_state(game->info);
+	game->state = comprehend_alloc_state(game);
+
+	game_native_load(game, dirname);
+}
+
+/*
+ * Free everything created by comprehend_load_game, leaving game->info
+ * ready to load a game into again.
+ */
+void comprehend_unload_game(struct comprehend_game *game)
+{
+	struct game_info *info = game->info;
+
+	comprehend_free_state(game->state);
+	game->state = NULL;
+
+	game_native_unload(game);
+	comprehend_free_images(&info->room_images);
+	comprehend_free_images(&info->item_images);
+
+	file_cache_free(&info->files);
+	if (info->cache.data)
+		file_buf_unmap(&info->cache);
+
+	arena_free(&info->arena);
+	memset(info, 0, sizeof(*info));
+}
+
+static void free_replace_words(struct game_state *state)
+{
+	size_t i;
+
+	for (i = 0; i < state->nr_replace_words; i++) {
+		free(state->replace_words[i]);
+		state->replace_words[i] = NULL;
+	}
+}
+
+/*
+ * Reset a session to the start of the game. This is a copy of the
+ * initial state snapshot, and does not touch the game files.
+ */
+void comprehend_reset_state(struct comprehend_game *game,
+			    struct game_state *state)
+{
+	struct game_info *info = game->info;
+	struct game_state *initial = info->initial_state;
+	struct room *rooms = state->rooms;
+	struct item *item = state->item;
+	char **replace_words = state->replace_words;
+	struct item_links *item_links = state->item_links;
+	void *hook_state = state->hook_state;
+	struct function_frame *frames = state->frames;
+	size_t nr_frames = state->nr_frames;
+	size_t nr_frames_allocated = state->nr_frames_allocated;
+	struct string_cache strings = state->strings;
+	struct string_cache strings2 = state->strings2;
+	size_t i;
+
+	free_replace_words(state);
+	memcpy(state, initial, sizeof(*state));
+
+	/* The session has its own copy of the tables which can be modified */
+	state->rooms = rooms;
+	memcpy(rooms, initial->rooms, (info->nr_rooms + 1) * sizeof(*rooms));
+	state->item = item;
+	memcpy(item, initial->item, info->header.nr_items * sizeof(*item));
+	state->item_links = item_links;
+	build_item_index(game, state);
+
+	/* Replace words are modified by some games, so each session owns them */
+	state->replace_words = replace_words;
+	for (i = 0; i < state->nr_replace_words; i++)
+		state->replace_words[i] =
+			xstrndup(initial->replace_words[i],
+				 strlen(initial->replace_words[i]));
+
+	state->hook_state = hook_state;
+	if (hook_state)
+		memset(hook_state, 0, game->ops->hook_state_size);
+
+	/* A reset from within a function returns to its callers */
+	state->frames = frames;
+	state->nr_frames = nr_frames;
+	state->nr_frames_allocated = nr_frames_allocated;
+
+	/* Decoded strings don't depend on the game state */
+	state->strings = strings;
+	state->strings2 = strings2;
+}
+
+/*
+ * Create a new play session for a loaded game. The game info is treated
+ * as read-only once loaded, so any number of sessions can share it. All
+ * of the state which the game can modify while being played is copied
+ * into the session from the initial state snapshot.
+ */
+struct game_state *comprehend_alloc_state(struct comprehend_game *game)
+{
+	struct game_info *info = game->info;
+	struct game_state *state;
+
+	state = xmalloc(sizeof(*state));
+	state->rooms = xmalloc((info->nr_rooms + 1) * sizeof(*state->rooms));
+	state->item = xmalloc(info->header.nr_items * sizeof(*state->item));
+	state->item_links = xmalloc(info->header.nr_items *
+				    sizeof(*state->item_links));
+	state->replace_words = xmalloc(info->nr_replace_words *
+				       sizeof(*state->replace_words));
+	if (game->ops->hook_state_size)
+		state->hook_state = xmalloc(game->ops->hook_state_size);
+	state->frames = NULL;
+	state->nr_frames = 0;
+	state->nr_frames_allocated = 0;
+
+	comprehend_reset_state(game, state);
+	return state;
+}
+
+void comprehend_free_state(struct game_state *state)
+{
+	free_replace_words(state);
+	free(state->replace_words);
+	free(state->item_links);
+	free(state->item);
+	free(state->rooms);
+	free(state->hook_state);
+	free(state->frames);
+	string_cache_free(&state->strings);
+	string_cache_free(&state->strings2);
+	free(state);
 }
 
 static void patch_string_desc(uint16_t *desc)
@@ -964,18 +1170,18 @@ void comprehend_save_game(struct comprehend_game *game, const char *filename)
 	nr_items = game->info->header.nr_items;
 
 	file_buf_put_u8(fd, 0);
-	file_buf_put_u8(fd, game->info->current_room);
+	file_buf_put_u8(fd, game->state->current_room);
 	file_buf_put_u8(fd, 0);
 
 	/* Variables */
-	for (i = 0; i < ARRAY_SIZE(game->info->variable); i++)
-		file_buf_put_le16(fd, game->info->variable[i]);
+	for (i = 0; i < ARRAY_SIZE(game->state->variable); i++)
+		file_buf_put_le16(fd, game->state->variable[i]);
 
 	/* Flags */
-	for (flag_index = 0, i = 0; i < ARRAY_SIZE(game->info->flags) / 8; i++) {
+	for (flag_index = 0, i = 0; i < ARRAY_SIZE(game->state->flags) / 8; i++) {
 		bitmask = 0;
 		for (bit = 7; bit >= 0; bit--) {
-			bitmask |= (!!game->info->flags[flag_index]) << bit;
+			bitmask |= (!!game->state->flags[flag_index]) << bit;
 			flag_index++;
 		}
 
@@ -996,13 +1202,13 @@ void comprehend_save_game(struct comprehend_game *game, const char *filename)
 		file_buf_put_skip(fd, 0x130 - ftell(fd));
 
 	/* Rooms */
-	file_buf_put_array_le16(fd, 1, game->info->rooms,
+	file_buf_put_array_le16(fd, 1, game->state->rooms,
 				string_desc, nr_rooms);
 	for (dir = 0; dir < NR_DIRECTIONS; dir++)
-		file_buf_put_array_u8(fd, 1, game->info->rooms,
+		file_buf_put_array_u8(fd, 1, game->state->rooms,
 				      direction[dir], nr_rooms);
-	file_buf_put_array_u8(fd, 1, game->info->rooms, flags, nr_rooms);
-	file_buf_put_array_u8(fd, 1, game->info->rooms, graphic, nr_rooms);
+	file_buf_put_array_u8(fd, 1, game->state->rooms, flags, nr_rooms);
+	file_buf_put_array_u8(fd, 1, game->state->rooms, graphic, nr_rooms);
 
 	/*
 	 * Objects
@@ -1010,18 +1216,18 @@ void comprehend_save_game(struct comprehend_game *game, const char *filename)
 	 * Layout differs depending on Comprehend version. Version 2 also
 	 * has long string descriptions for each object.
 	 */
-	file_buf_put_array_le16(fd, 0, game->info->item, string_desc, nr_items);
+	file_buf_put_array_le16(fd, 0, game->state->item, string_desc, nr_items);
 	if (game->info->comprehend_version == 1) {
-		file_buf_put_array_u8(fd, 0, game->info->item, room, nr_items);
-		file_buf_put_array_u8(fd, 0, game->info->item, flags, nr_items);
-		file_buf_put_array_u8(fd, 0, game->info->item, word, nr_items);
-		file_buf_put_array_u8(fd, 0, game->info->item, graphic, nr_items);
+		file_buf_put_array_u8(fd, 0, game->state->item, room, nr_items);
+		file_buf_put_array_u8(fd, 0, game->state->item, flags, nr_items);
+		file_buf_put_array_u8(fd, 0, game->state->item, word, nr_items);
+		file_buf_put_array_u8(fd, 0, game->state->item, graphic, nr_items);
 	} else {
-		file_buf_put_array_le16(fd, 0, game->info->item, long_string, nr_items);
-		file_buf_put_array_u8(fd, 0, game->info->item, word, nr_items);
-		file_buf_put_array_u8(fd, 0, game->info->item, room, nr_items);
-		file_buf_put_array_u8(fd, 0, game->info->item, flags, nr_items);
-		file_buf_put_array_u8(fd, 0, game->info->item, graphic, nr_items);
+		file_buf_put_array_le16(fd, 0, game->state->item, long_string, nr_items);
+		file_buf_put_array_u8(fd, 0, game->state->item, word, nr_items);
+		file_buf_put_array_u8(fd, 0, game->state->item, room, nr_items);
+		file_buf_put_array_u8(fd, 0, game->state->item, flags, nr_items);
+		file_buf_put_array_u8(fd, 0, game->state->item, graphic, nr_items);
 	}
 
 	fclose(fd);
@@ -1031,6 +1237,7 @@ void comprehend_restore_game(struct comprehend_game *game, const char *filename)
 {
 	struct file_buf fb;
 	size_t nr_rooms, nr_items;
+	uint8_t current_room;
 	int err, dir, i;
 
 	err = file_buf_map_may_fail(filename, &fb);
@@ -1045,12 +1252,19 @@ void comprehend_restore_game(struct comprehend_game *game, const char *filename)
 
 	/* Restore starting room */
 	file_buf_set_pos(&fb, 1);
-	file_buf_get_u8(&fb, &game->info->current_room);
+	file_buf_get_u8(&fb, &current_room);
+	if (current_room == 0 || current_room > nr_rooms) {
+		printf("Error: Bad current room %d in save file '%s'\n",
+		       current_room, filename);
+		file_buf_unmap(&fb);
+		return;
+	}
+	game->state->current_room = current_room;
 
 	/* Restore flags and variables */
 	file_buf_set_pos(&fb, 3);
-	parse_variables(game, &fb);
-	parse_flags(game, &fb);
+	parse_variables(&fb, game->state->variable);
+	parse_flags(&fb, game->state->flags);
 
 	/* FIXME - unknown restore data, skip over it */
 	if (game->info->comprehend_version == 1)
@@ -1059,13 +1273,13 @@ void comprehend_restore_game(struct comprehend_game *game, const char *filename)
 		file_buf_set_pos(&fb, 0x130);
 
 	/* Restore rooms */
-	file_buf_get_array_le16(&fb, 1, game->info->rooms,
+	file_buf_get_array_le16(&fb, 1, game->state->rooms,
 				string_desc, nr_rooms);
 	for (dir = 0; dir < NR_DIRECTIONS; dir++)
-		file_buf_get_array_u8(&fb, 1, game->info->rooms,
+		file_buf_get_array_u8(&fb, 1, game->state->rooms,
 			      direction[dir], nr_rooms);
-	file_buf_get_array_u8(&fb, 1, game->info->rooms, flags, nr_rooms);
-	file_buf_get_array_u8(&fb, 1, game->info->rooms, graphic, nr_rooms);
+	file_buf_get_array_u8(&fb, 1, game->state->rooms, flags, nr_rooms);
+	file_buf_get_array_u8(&fb, 1, game->state->rooms, graphic, nr_rooms);
 
 	/*
 	 * Restore objects
@@ -1073,18 +1287,18 @@ void comprehend_restore_game(struct comprehend_game *game, const char *filename)
 	 * Layout differs depending on Comprehend version. Version 2 also
 	 * has long string descriptions for each object.
 	 */
-	file_buf_get_array_le16(&fb, 0, game->info->item, string_desc, nr_items);
+	file_buf_get_array_le16(&fb, 0, game->state->item, string_desc, nr_items);
 	if (game->info->comprehend_version == 1) {
-		file_buf_get_array_u8(&fb, 0, game->info->item, room, nr_items);
-		file_buf_get_array_u8(&fb, 0, game->info->item, flags, nr_items);
-		file_buf_get_array_u8(&fb, 0, game->info->item, word, nr_items);
-		file_buf_get_array_u8(&fb, 0, game->info->item, graphic, nr_items);
+		file_buf_get_array_u8(&fb, 0, game->state->item, room, nr_items);
+		file_buf_get_array_u8(&fb, 0, game->state->item, flags, nr_items);
+		file_buf_get_array_u8(&fb, 0, game->state->item, word, nr_items);
+		file_buf_get_array_u8(&fb, 0, game->state->item, graphic, nr_items);
 	} else {
-		file_buf_get_array_le16(&fb, 0, game->info->item, long_string, nr_items);
-		file_buf_get_array_u8(&fb, 0, game->info->item, word, nr_items);
-		file_buf_get_array_u8(&fb, 0, game->info->item, room, nr_items);
-		file_buf_get_array_u8(&fb, 0, game->info->item, flags, nr_items);
-		file_buf_get_array_u8(&fb, 0, game->info->item, graphic, nr_items);
+		file_buf_get_array_le16(&fb, 0, game->state->item, long_string, nr_items);
+		file_buf_get_array_u8(&fb, 0, game->state->item, word, nr_items);
+		file_buf_get_array_u8(&fb, 0, game->state->item, room, nr_items);
+		file_buf_get_array_u8(&fb, 0, game->state->item, flags, nr_items);
+		file_buf_get_array_u8(&fb, 0, game->state->item, graphic, nr_items);
 	}
 
 	/*
@@ -1092,9 +1306,10 @@ void comprehend_restore_game(struct comprehend_game *game, const char *filename)
 	 *         Not sure what this means, so just mask it out for now.
 	 */
 	for (i = 1; i <= nr_rooms; i++)
-		patch_string_desc(&game->info->rooms[i].string_desc);
+		patch_string_desc(&game->state->rooms[i].string_desc);
 	for (i = 0; i < nr_items; i++)
-		patch_string_desc(&game->info->item[i].string_desc);
+		patch_string_desc(&game->state->item[i].string_desc);
+	build_item_index(game, game->state);
 
 	file_buf_unmap(&fb);
 }
@@ -20,9 +20,14 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include "recomprehend.h"
 #include "image_data.h"
+#include "arena.h"
+#include "file_buf.h"
+#include "hash_index.h"
 
 struct comprehend_game;
+struct native_module;
 
 #define MAX_FLAGS	64
 #define MAX_VARIABLES	128
@@ -48,6 +53,37 @@ struct function_state {
 	bool		executed;
 };
 
+/*
+ * Combine the result of a test instruction with the function's test
+ * result. Tests are and-ed together unless an OPCODE_OR is in effect.
+ */
+static inline void func_set_test_result(struct function_state *func_state,
+					bool value)
+{
+	if (func_state->or_count == 0) {
+		/* And */
+		if (func_state->and) {
+			if (!value)
+				func_state->test_result = false;
+		} else {
+			func_state->test_result = value;
+			func_state->and = true;
+		}
+
+	} else {
+		/* Or */
+		if (value)
+			func_state->test_result = value;
+	}
+}
+
+/* A caller suspended by OPCODE_CALL_FUNC, see eval_function */
+struct function_frame {
+	struct function_state	func_state;
+	struct instruction	*instr;
+	struct instruction	*end;
+};
+
 struct room {
 	uint8_t			direction[NR_DIRECTIONS];
 	uint8_t			flags;
@@ -75,6 +111,17 @@ struct word_index {
 	uint8_t			type;
 };
 
+/*
+ * Dictionary words by word index, built by dict_build_index. Words with
+ * the same index are chained in dictionary order, by_type has the first
+ * word with each type bit set.
+ */
+struct word_index_table {
+	uint32_t		first[0x100];
+	uint32_t		by_type[0x100][8];
+	uint32_t		*next;
+};
+
 struct word_map {
 	/* <word[0]>, <word[1]> == <word[2]> */
 	struct word_index	word[3];
@@ -90,21 +137,68 @@ struct action {
 	uint16_t		function;
 };
 
+/*
+ * The raw opcode and operands are kept for dumping. The VM only uses the
+ * decoded generic opcode and arguments, see decode_instructions.
+ *
+ * For command instructions, skip is the number of command instructions
+ * from this one to the end of its command block. The VM uses it to jump
+ * over the rest of a block whose tests failed.
+ */
 struct instruction {
 	uint8_t			opcode;
-	size_t			nr_operands;
+	uint8_t			nr_operands;
 	uint8_t			operand[3];
 	bool			is_command;
+
+	uint8_t			op;
+	uint16_t		arg[2];
+	uint16_t		skip;
 };
 
+/*
+ * The instructions for all functions are stored back to back in a single
+ * array in the game_info. Functions refer to their instructions by index
+ * so that the array can be resized while the functions are being parsed.
+ */
 struct function {
-	struct instruction	instructions[0x100];
+	size_t			first_instruction;
 	size_t			nr_instructions;
 };
 
+/*
+ * Strings are decoded from the game files the first time they are looked
+ * up. Entries record where each encoded string is, or point at the
+ * already decoded string for games loaded from a compiled cache. Entries
+ * with neither are unused.
+ */
+struct string_entry {
+	const char		*string;
+	const struct file_buf	*file;
+	uint32_t		offset;
+};
+
 struct string_table {
-	char			*strings[0xffff];
+	struct string_entry	*entries;
+	size_t			nr_strings;
+	size_t			nr_allocated;
+};
+
+/*
+ * A session's decoded strings and templates for one string table, indexed
+ * like the table's entries. The decoded array is a ring of entry indexes,
+ * oldest first, used to limit the memory used by decoded strings.
+ */
+struct string_cache {
+	char			**strings;
+	struct string_template	**tmpls;
 	size_t			nr_strings;
+
+	size_t			*decoded;
+	size_t			decoded_first;
+	size_t			nr_decoded;
+	size_t			decoded_size;
+	bool			keep_decoded;
 };
 
 struct game_header {
@@ -140,6 +234,12 @@ struct game_header {
 	uint16_t		addr_vm; // FIXME - functions
 };
 
+/*
+ * Loaded game image. This is filled in by comprehend_load_game() and is
+ * not modified afterwards, so it can be shared by several game sessions.
+ * See struct game_state for the parts which change during play, which
+ * include the lazily decoded strings.
+ */
 struct game_info {
 	struct game_header	header;
 
@@ -147,38 +247,114 @@ struct game_info {
 
 	uint8_t			start_room;
 
-	struct room		rooms[0x100];
+	/* Rooms are numbered from one, room zero is the player's inventory */
+	struct room		*rooms;
 	size_t			nr_rooms;
-	uint8_t			current_room;
 
-	struct item		item[0xff];
+	/* Number of items is in the header */
+	struct item		*item;
 
 	struct word		*words;
 	size_t			nr_words;
+	struct hash_index	word_hash;
+	struct word_index_table	*word_table;
 
-	struct word_map		word_map[0xff];
+	struct word_map		*word_map;
 	size_t			nr_word_maps;
+	struct hash_index	word_pair_hash;
 
 	struct string_table	strings;
 	struct string_table	strings2;
 
-	struct action		action[0xffff];
+	struct action		*action;
 	size_t			nr_actions;
+	struct hash_index	action_index;
 
-	struct function		functions[0xffff];
+	struct function		*functions;
 	size_t			nr_functions;
 
+	struct instruction	*instructions;
+	size_t			nr_instructions;
+
 	struct image_data	room_images;
 	struct image_data	item_images;
 
 	bool			flags[MAX_FLAGS];
 	uint16_t		variable[MAX_VARIABLES];
 
-	char			*replace_words[256];
+	char			**replace_words;
 	size_t			nr_replace_words;
 
+	/* Play state at the start of the game */
+	struct game_state	*initial_state;
+
+	/* Memory for everything allocated while loading the game */
+	struct arena		arena;
+
+	/* Game, string and image files, mapped until the game is unloaded */
+	struct file_cache	files;
+
+	/* Compiled cache the game was loaded from, if any */
+	struct file_buf		cache;
+
+	/* Native code for the game's functions, if any, see game_native.c */
+	const struct native_module *native;
+	void			*native_handle;
+};
+
+#define NO_ITEM			UINT32_MAX
+
+struct item_links {
+	uint32_t		noun_next;
+	uint32_t		room_next;
+	uint32_t		room_prev;
+};
+
+/*
+ * Per-session play state. The rooms, items, flags, variables and replace
+ * words in struct game_info hold the initial values from the game data
+ * file. A snapshot of the initial state is taken when the game is loaded
+ * and copied here when a session is started or restarted.
+ */
+struct game_state {
+	struct room		*rooms;
+	uint8_t			current_room;
+
+	struct item		*item;
+
+	bool			flags[MAX_FLAGS];
+	uint16_t		variable[MAX_VARIABLES];
+
+	char			**replace_words;
+	size_t			nr_replace_words;
 	uint8_t			current_replace_word;
+
+	/*
+	 * Items by noun word index and by room, each chained in item order
+	 * through item_links. Item words only change when a game is
+	 * restored, so the noun chains are rebuilt then and when the session
+	 * is reset. The room chains are also updated by move_object.
+	 */
+	uint32_t		noun_items[0x100];
+	uint32_t		room_items[0x100];
+	struct item_links	*item_links;
+
 	unsigned		update_flags;
+
+	/* Private state for the game's hooks, see game_ops.hook_state_size */
+	void			*hook_state;
+
+	/*
+	 * The VM's stack of suspended callers. This is not game state and is
+	 * kept when the session is reset, which games do from functions.
+	 */
+	struct function_frame	*frames;
+	size_t			nr_frames;
+	size_t			nr_frames_allocated;
+
+	/* Decoded strings, which are also kept when the session is reset */
+	struct string_cache	strings;
+	struct string_cache	strings2;
 };
 
 enum {
@@ -250,6 +426,11 @@ enum {
 	OPCODE_DRAW_ROOM,
 	OPCODE_DRAW_OBJECT,
 	OPCODE_WAIT_KEY,
+
+	/* Decoded instruction with an out of range operand */
+	OPCODE_BAD_OPERAND,
+
+	NR_OPCODES
 };
 
 /* Game state update flags */
@@ -304,8 +485,14 @@ enum {
 				 WORD_TYPE_NOUN | WORD_TYPE_NOUN_PLURAL)
 
 void comprehend_load_game(struct comprehend_game *game, const char *dirname);
+void comprehend_unload_game(struct comprehend_game *game);
 void comprehend_restore_game(struct comprehend_game *game,
 			     const char *filename);
 void comprehend_save_game(struct comprehend_game *game, const char *filename);
 
+struct game_state *comprehend_alloc_state(struct comprehend_game *game);
+void comprehend_reset_state(struct comprehend_game *game,
+			    struct game_state *state);
+void comprehend_free_state(struct game_state *state);
+
 #endif /* _RECOMPREHEND_GAME_DATA_H */
@@ -0,0 +1,1062 @@
+/*
+ * This file is part of Re-Comprehend
+ *
+ * Ryan Mallon, 2015, <rmallon@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to
+ * the public domain worldwide. This software is distributed without
+ * any warranty.  You should have received a copy of the CC0 Public
+ * Domain Dedication along with this software. If not, see
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ */
+
+/*
+ * Native code for a game's functions. game_native_write translates every
+ * function to a C function which does the same as eval_function would for
+ * it. The tests and commands become straight line code, and the skips over
+ * failed command blocks become gotos. The generated file is built as a
+ * shared object and loaded with --native.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+
+#include "recomprehend.h"
+#include "game_cache.h"
+#include "game_data.h"
+#include "game_native.h"
+#include "game.h"
+#include "util.h"
+
+/* Builds without the Makefile's build ID never load native code */
+#ifndef NATIVE_BUILD_ID
+#define NATIVE_BUILD_ID		0
+#endif
+
+static const char *native_filename;
+static bool native_check;
+
+void game_native_set_file(const char *filename)
+{
+	native_filename = filename;
+}
+
+void game_native_set_check(bool check)
+{
+	native_check = check;
+}
+
+/* Declares the item for the current noun in a generated block */
+#define NOUN_ITEM \
+	"\t\tstruct item *item = get_item_by_noun(game, noun);\n\n"
+
+/*
+ * Write the body of a single instruction. fs is the function state, and
+ * the instruction's operands are written as constants.
+ */
+static void write_instruction(FILE *fd, struct comprehend_game *game,
+			      struct instruction *instr, bool checked)
+{
+	unsigned a = instr->arg[0], b = instr->arg[1];
+
+	switch (instr->op) {
+	case OPCODE_VAR_ADD:
+		fprintf(fd, "\tgame->state->variable[%u] += "
+			"game->state->variable[%u];\n", a, b);
+		break;
+
+	case OPCODE_VAR_SUB:
+		fprintf(fd, "\tgame->state->variable[%u] -= "
+			"game->state->variable[%u];\n", a, b);
+		break;
+
+	case OPCODE_VAR_INC:
+		fprintf(fd, "\tgame->state->variable[%u]++;\n", a);
+		break;
+
+	case OPCODE_VAR_DEC:
+		fprintf(fd, "\tgame->state->variable[%u]--;\n", a);
+		break;
+
+	case OPCODE_VAR_EQ:
+		fprintf(fd, "\tfunc_set_test_result(&fs, "
+			"game->state->variable[%u] == "
+			"game->state->variable[%u]);\n", a, b);
+		break;
+
+	case OPCODE_TURN_TICK:
+		fprintf(fd, "\tgame->state->variable[VAR_TURN_COUNT]++;\n");
+		break;
+
+	case OPCODE_PRINT:
+		fprintf(fd, "\tconsole_println_string(game, 0x%x);\n", a);
+		break;
+
+	case OPCODE_TEST_NOT_ROOM_FLAG:
+		fprintf(fd, "\tfunc_set_test_result(&fs, !(game->state->rooms["
+			"game->state->current_room].flags & 0x%x));\n", a);
+		break;
+
+	case OPCODE_TEST_ROOM_FLAG:
+		fprintf(fd, "\tfunc_set_test_result(&fs, game->state->rooms["
+			"game->state->current_room].flags & 0x%x);\n", a);
+		break;
+
+	case OPCODE_NOT_IN_ROOM:
+		fprintf(fd, "\tfunc_set_test_result(&fs, "
+			"game->state->current_room != 0x%x);\n", a);
+		break;
+
+	case OPCODE_IN_ROOM:
+		fprintf(fd, "\tfunc_set_test_result(&fs, "
+			"game->state->current_room == 0x%x);\n", a);
+		break;
+
+	case OPCODE_MOVE_TO_ROOM:
+		/* Room 0xff is ignored, see eval_function */
+		if (a != 0xff)
+			fprintf(fd, "\tmove_to(game, 0x%x);\n", (uint8_t)a);
+		break;
+
+	case OPCODE_MOVE:
+		fprintf(fd,
+			"\t{\n"
+			"\t\tstruct room *room = &game->state->rooms["
+			"game->state->current_room];\n\n"
+			"\t\tif (verb->index - 1 >= NR_DIRECTIONS)\n"
+			"\t\t\tfatal_error(\"Bad verb %%d:%%d in move\", "
+			"verb->index, verb->type);\n\n"
+			"\t\tif (room->direction[verb->index - 1])\n"
+			"\t\t\tmove_to(game, "
+			"room->direction[verb->index - 1]);\n"
+			"\t\telse\n"
+			"\t\t\tconsole_println_string(game, STRING_CANT_GO);\n"
+			"\t}\n");
+		break;
+
+	case OPCODE_MOVE_DIRECTION:
+		fprintf(fd,
+			"\t{\n"
+			"\t\tstruct room *room = &game->state->rooms["
+			"game->state->current_room];\n\n"
+			"\t\tif (room->direction[%u])\n"
+			"\t\t\tmove_to(game, room->direction[%u]);\n"
+			"\t\telse\n"
+			"\t\t\tconsole_println_string(game, STRING_CANT_GO);\n"
+			"\t}\n", a, a);
+		break;
+
+	case OPCODE_ELSE:
+		fprintf(fd, "\tfs.test_result = fs.else_result;\n");
+		break;
+
+	case OPCODE_MOVE_OBJECT_TO_CURRENT_ROOM:
+	case OPCODE_DROP_OBJECT:
+		fprintf(fd, "\tmove_object(game, &game->state->item[%u], "
+			"game->state->current_room);\n", a);
+		break;
+
+	case OPCODE_OBJECT_IN_ROOM:
+		fprintf(fd, "\tfunc_set_test_result(&fs, "
+			"game->state->item[%u].room == 0x%x);\n", a, b);
+		break;
+
+	case OPCODE_OBJECT_NOT_IN_ROOM:
+		fprintf(fd, "\tfunc_set_test_result(&fs, "
+			"game->state->item[%u].room != 0x%x);\n", a, b);
+		break;
+
+	case OPCODE_MOVE_OBJECT_TO_ROOM:
+		fprintf(fd, "\tmove_object(game, &game->state->item[%u], "
+			"0x%x);\n", a, b);
+		break;
+
+	case OPCODE_INVENTORY_FULL:
+		fprintf(fd,
+			"\t{\n"
+			NOUN_ITEM
+			"\t\tfunc_set_test_result(&fs, "
+			"game->state->variable[VAR_INVENTORY_WEIGHT] +\n"
+			"\t\t\t(item->flags & ITEMF_WEIGHT_MASK) >\n"
+			"\t\t\tgame->state->variable[VAR_INVENTORY_LIMIT]);\n"
+			"\t}\n");
+		break;
+
+	case OPCODE_DESCRIBE_CURRENT_OBJECT:
+		fprintf(fd, "\tprintf(\"%%s\\n\", string_lookup(game, "
+			"get_item_by_noun(game, noun)->long_string));\n");
+		break;
+
+	case OPCODE_CURRENT_OBJECT_IN_ROOM:
+		fprintf(fd,
+			"\t{\n"
+			"\t\tstruct item *item;\n"
+			"\t\tbool test = false;\n\n"
+			"\t\tif (noun) {\n"
+			"\t\t\tfor (item = first_item_with_word(game, "
+			"noun->index);\n"
+			"\t\t\t     item; item = next_item_by_noun(game, "
+			"item)) {\n"
+			"\t\t\t\tif (item->room == 0x%x) {\n"
+			"\t\t\t\t\ttest = true;\n"
+			"\t\t\t\t\tbreak;\n"
+			"\t\t\t\t}\n"
+			"\t\t\t}\n"
+			"\t\t}\n\n"
+			"\t\tfunc_set_test_result(&fs, test);\n"
+			"\t}\n", a);
+		break;
+
+	case OPCODE_CURRENT_OBJECT_NOT_PRESENT:
+		fprintf(fd,
+			"\t{\n"
+			NOUN_ITEM
+			"\t\tfunc_set_test_result(&fs, !item || item->room != "
+			"game->state->current_room);\n"
+			"\t}\n");
+		break;
+
+	case OPCODE_CURRENT_OBJECT_PRESENT:
+		fprintf(fd,
+			"\t{\n"
+			NOUN_ITEM
+			"\t\tfunc_set_test_result(&fs, item && item->room == "
+			"game->state->current_room);\n"
+			"\t}\n");
+		break;
+
+	case OPCODE_HAVE_OBJECT:
+		fprintf(fd, "\tfunc_set_test_result(&fs, "
+			"game->state->item[%u].room == ROOM_INVENTORY);\n", a);
+		break;
+
+	case OPCODE_NOT_HAVE_CURRENT_OBJECT:
+		fprintf(fd,
+			"\t{\n"
+			NOUN_ITEM
+			"\t\tfunc_set_test_result(&fs, !item || item->room != "
+			"ROOM_INVENTORY);\n"
+			"\t}\n");
+		break;
+
+	case OPCODE_HAVE_CURRENT_OBJECT:
+		fprintf(fd, "\tfunc_set_test_result(&fs, "
+			"get_item_by_noun(game, noun)->room == "
+			"ROOM_INVENTORY);\n");
+		break;
+
+	case OPCODE_NOT_HAVE_OBJECT:
+		fprintf(fd, "\tfunc_set_test_result(&fs, "
+			"game->state->item[%u].room != ROOM_INVENTORY);\n", a);
+		break;
+
+	case OPCODE_CURRENT_OBJECT_TAKEABLE:
+		fprintf(fd,
+			"\t{\n"
+			NOUN_ITEM
+			"\t\tfunc_set_test_result(&fs, item && "
+			"(item->flags & ITEMF_CAN_TAKE));\n"
+			"\t}\n");
+		break;
+
+	case OPCODE_CURRENT_OBJECT_NOT_TAKEABLE:
+		fprintf(fd,
+			"\t{\n"
+			NOUN_ITEM
+			"\t\tfunc_set_test_result(&fs, !item || "
+			"!(item->flags & ITEMF_CAN_TAKE));\n"
+			"\t}\n");
+		break;
+
+	case OPCODE_CURRENT_OBJECT_IS_NOWHERE:
+		fprintf(fd,
+			"\t{\n"
+			NOUN_ITEM
+			"\t\tfunc_set_test_result(&fs, item && item->room == "
+			"ROOM_NOWHERE);\n"
+			"\t}\n");
+		break;
+
+	case OPCODE_OBJECT_IS_NOWHERE:
+		fprintf(fd, "\tfunc_set_test_result(&fs, "
+			"game->state->item[%u].room == ROOM_NOWHERE);\n", a);
+		break;
+
+	case OPCODE_OBJECT_IS_NOT_NOWHERE:
+		fprintf(fd, "\tfunc_set_test_result(&fs, "
+			"game->state->item[%u].room != ROOM_NOWHERE);\n", a);
+		break;
+
+	case OPCODE_OBJECT_NOT_PRESENT:
+		fprintf(fd, "\tfunc_set_test_result(&fs, "
+			"game->state->item[%u].room != "
+			"game->state->current_room);\n", a);
+		break;
+
+	case OPCODE_OBJECT_PRESENT:
+		fprintf(fd, "\tfunc_set_test_result(&fs, "
+			"game->state->item[%u].room == "
+			"game->state->current_room);\n", a);
+		break;
+
+	case OPCODE_OBJECT_NOT_VALID:
+		fprintf(fd, "\tfunc_set_test_result(&fs, !noun || "
+			"(noun->type & WORD_TYPE_NOUN_MASK) == 0);\n");
+		break;
+
+	case OPCODE_CURRENT_IS_OBJECT:
+		fprintf(fd, "\tfunc_set_test_result(&fs, "
+			"get_item_by_noun(game, noun) != NULL);\n");
+		break;
+
+	case OPCODE_CURRENT_NOT_OBJECT:
+		fprintf(fd, "\tfunc_set_test_result(&fs, "
+			"get_item_by_noun(game, noun) == NULL);\n");
+		break;
+
+	case OPCODE_REMOVE_OBJECT:
+		fprintf(fd, "\tmove_object(game, &game->state->item[%u], "
+			"ROOM_NOWHERE);\n", a);
+		break;
+
+	case OPCODE_REMOVE_CURRENT_OBJECT:
+		fprintf(fd, "\tmove_object(game, get_item_by_noun(game, noun), "
+			"ROOM_NOWHERE);\n");
+		break;
+
+	case OPCODE_INVENTORY:
+	case OPCODE_INVENTORY_ROOM:
+		if (instr->op == OPCODE_INVENTORY)
+			fprintf(fd, "\tinventory(game, ROOM_INVENTORY, "
+				"STRING_INVENTORY, STRING_INVENTORY_EMPTY);\n");
+		else
+			fprintf(fd, "\tinventory(game, 0x%x, 0x%x, 0x%x);\n",
+				(uint8_t)a, b, (uint16_t)(b + 1));
+		break;
+
+	case OPCODE_MOVE_CURRENT_OBJECT_TO_ROOM:
+		fprintf(fd,
+			"\t{\n"
+			NOUN_ITEM
+			"\t\tif (!item)\n"
+			"\t\t\tfatal_error(\"Bad current object\\n\");\n\n"
+			"\t\tmove_object(game, item, 0x%x);\n"
+			"\t}\n", a);
+		break;
+
+	case OPCODE_DROP_CURRENT_OBJECT:
+	case OPCODE_TAKE_CURRENT_OBJECT:
+		fprintf(fd,
+			"\t{\n"
+			NOUN_ITEM
+			"\t\tif (!item)\n"
+			"\t\t\tfatal_error(\"Attempt to take object "
+			"failed\\n\");\n\n"
+			"\t\tmove_object(game, item, %s);\n"
+			"\t}\n",
+			instr->op == OPCODE_TAKE_CURRENT_OBJECT ?
+			"ROOM_INVENTORY" : "game->state->current_room");
+		break;
+
+	case OPCODE_TAKE_OBJECT:
+		fprintf(fd, "\tmove_object(game, &game->state->item[%u], "
+			"ROOM_INVENTORY);\n", a);
+		break;
+
+	case OPCODE_TEST_FLAG:
+		fprintf(fd, "\tfunc_set_test_result(&fs, "
+			"game->state->flags[%u]);\n", a);
+		break;
+
+	case OPCODE_TEST_NOT_FLAG:
+		fprintf(fd, "\tfunc_set_test_result(&fs, "
+			"!game->state->flags[%u]);\n", a);
+		break;
+
+	case OPCODE_CLEAR_FLAG:
+		fprintf(fd, "\tgame->state->flags[%u] = false;\n", a);
+		break;
+
+	case OPCODE_SET_FLAG:
+		fprintf(fd, "\tgame->state->flags[%u] = true;\n", a);
+		break;
+
+	case OPCODE_OR:
+		fprintf(fd,
+			"\tif (fs.or_count) {\n"
+			"\t\tfs.or_count += 2;\n"
+			"\t} else {\n"
+			"\t\tfs.test_result = false;\n"
+			"\t\tfs.or_count += 3;\n"
+			"\t}\n");
+		break;
+
+	case OPCODE_SET_OBJECT_DESCRIPTION:
+		fprintf(fd, "\tgame->state->item[%u].string_desc = 0x%x;\n",
+			a, b);
+		break;
+
+	case OPCODE_SET_OBJECT_LONG_DESCRIPTION:
+		fprintf(fd, "\tgame->state->item[%u].long_string = 0x%x;\n",
+			a, b);
+		break;
+
+	case OPCODE_SET_ROOM_DESCRIPTION:
+		fprintf(fd, "\tgame->state->rooms[%u].string_desc = 0x%x;\n",
+			a, b);
+		break;
+
+	case OPCODE_SET_OBJECT_GRAPHIC:
+		fprintf(fd,
+			"\tgame->state->item[%u].graphic = 0x%x;\n"
+			"\tif (game->state->item[%u].room == "
+			"game->state->current_room)\n"
+			"\t\tgame->state->update_flags |= UPDATE_GRAPHICS;\n",
+			a, (uint8_t)b, a);
+		break;
+
+	case OPCODE_SET_ROOM_GRAPHIC:
+		fprintf(fd,
+			"\tgame->state->rooms[%u].graphic = 0x%x;\n"
+			"\tif (game->state->current_room == 0x%x)\n"
+			"\t\tgame->state->update_flags |= UPDATE_GRAPHICS;\n",
+			a, (uint8_t)b, a);
+		break;
+
+	case OPCODE_CALL_FUNC:
+		if (a >= game->info->nr_functions) {
+			fprintf(fd, "\tfatal_error(\"Call to bad function "
+				"%.4x\\n\");\n", a);
+			break;
+		}
+
+		fprintf(fd,
+			"\tif (!eval_enter_call(game, 0x%x))\n"
+			"\t\treturn false;\n"
+			"\tok = f_%.4x%s(game, verb, noun);\n"
+			"\tgame->state->nr_frames--;\n"
+			"\tif (!ok)\n"
+			"\t\treturn false;\n",
+			a, a, checked ? "_checked" : "");
+		break;
+
+	case OPCODE_TEST_FALSE:
+		fprintf(fd, "\tfunc_set_test_result(&fs, false);\n");
+		break;
+
+	case OPCODE_SAVE_ACTION:
+		/* Not implemented, see eval_function */
+		break;
+
+	case OPCODE_SET_STRING_REPLACEMENT:
+		fprintf(fd, "\tgame->state->current_replace_word = %u;\n",
+			(uint8_t)a);
+		break;
+
+	case OPCODE_SET_CURRENT_NOUN_STRING_REPLACEMENT:
+		fprintf(fd,
+			"\tif (noun && (noun->type & WORD_TYPE_NOUN_PLURAL))\n"
+			"\t\tgame->state->current_replace_word = 3;\n"
+			"\telse if (noun && (noun->type & WORD_TYPE_FEMALE))\n"
+			"\t\tgame->state->current_replace_word = 0;\n"
+			"\telse if (noun && (noun->type & WORD_TYPE_MALE))\n"
+			"\t\tgame->state->current_replace_word = 1;\n"
+			"\telse\n"
+			"\t\tgame->state->current_replace_word = 2;\n");
+		break;
+
+	case OPCODE_DRAW_ROOM:
+		fprintf(fd, "\tdraw_location_image(&game->info->room_images, "
+			"%uu);\n", a - 1);
+		break;
+
+	case OPCODE_DRAW_OBJECT:
+		fprintf(fd, "\tdraw_image(&game->info->item_images, %uu);\n",
+			a - 1);
+		break;
+
+	case OPCODE_WAIT_KEY:
+		fprintf(fd, "\tconsole_wait_key();\n");
+		break;
+
+	case OPCODE_BAD_OPERAND:
+		fprintf(fd, "\tfatal_error(\"Bad operand in instruction "
+			"%.2x(%.2x, %.2x, %.2x)\\n\");\n", instr->opcode,
+			instr->operand[0], instr->operand[1],
+			instr->operand[2]);
+		break;
+
+	case OPCODE_SPECIAL:
+		fprintf(fd,
+			"\tif (game->ops->handle_special_opcode)\n"
+			"\t\tgame->ops->handle_special_opcode(game, 0x%x);\n",
+			(uint8_t)a);
+		break;
+
+	default:
+		/* Unhandled tests are false, unhandled commands do nothing */
+		if (!(instr->opcode & 0x80))
+			fprintf(fd, "\tfunc_set_test_result(&fs, false);\n");
+		break;
+	}
+}
+
+/*
+ * Write the prologue of an instruction, which is what next_instruction
+ * does in eval_function.h. A failed command block jumps to the instruction
+ * after it.
+ */
+static void write_prologue(FILE *fd, struct instruction *instr,
+			   size_t i, size_t nr_instructions)
+{
+	size_t skip;
+
+	if (!instr->is_command) {
+		fprintf(fd,
+			"\tif (fs.executed)\n"
+			"\t\treturn true;\n"
+			"\tif (fs.or_count)\n"
+			"\t\tfs.or_count--;\n"
+			"\tif (fs.in_command) {\n"
+			"\t\tfs.in_command = false;\n"
+			"\t\tfs.test_result = false;\n"
+			"\t\tfs.and = false;\n"
+			"\t}\n");
+		return;
+	}
+
+	skip = instr->skip;
+	if (skip > nr_instructions - i)
+		skip = nr_instructions - i;
+
+	fprintf(fd,
+		"\tif (fs.or_count)\n"
+		"\t\tfs.or_count--;\n"
+		"\tfs.in_command = true;\n"
+		"\tif (fs.or_count != 0)\n"
+		"\t\tprintf(\"Warning: or_count == %%d\\n\", fs.or_count);\n"
+		"\tfs.or_count = 0;\n"
+		"\tif (!fs.test_result)\n"
+		"\t\tgoto i_%zu;\n"
+		"\tfs.else_result = false;\n"
+		"\tfs.executed = true;\n", i + skip);
+}
+
+static void write_function(FILE *fd, struct comprehend_game *game,
+			   size_t index, bool checked)
+{
+	struct function *func = &game->info->functions[index];
+	struct instruction *instr;
+	bool *is_target;
+	size_t i, skip;
+
+	/* Only the targets of skips need labels */
+	is_target = xmalloc(func->nr_instructions + 1);
+	memset(is_target, 0, func->nr_instructions + 1);
+	for (i = 0; i < func->nr_instructions; i++) {
+		instr = &game->info->instructions[func->first_instruction + i];
+		if (!instr->is_command)
+			continue;
+
+		skip = instr->skip;
+		if (skip > func->nr_instructions - i)
+			skip = func->nr_instructions - i;
+		is_target[i + skip] = true;
+	}
+
+	fprintf(fd, "static bool f_%.4zx%s(struct comprehend_game *game, "
+		"struct word *verb,\n"
+		"\t\t\t  struct word *noun)\n"
+		"{\n"
+		"\tstruct function_state fs = {\n"
+		"\t\t.test_result = true,\n"
+		"\t\t.else_result = true,\n"
+		"\t};\n"
+		"\tbool ok;\n",
+		index, checked ? "_checked" : "");
+
+	for (i = 0; i < func->nr_instructions; i++) {
+		instr = &game->info->instructions[func->first_instruction + i];
+
+		fprintf(fd, "\n\t/* %.2x", instr->opcode);
+		if (instr->nr_operands)
+			fprintf(fd, "(%.2x, %.2x, %.2x)", instr->operand[0],
+				instr->operand[1], instr->operand[2]);
+		fprintf(fd, " */\n");
+		if (is_target[i])
+			fprintf(fd, "i_%zu:\n", i);
+
+		write_prologue(fd, instr, i, func->nr_instructions);
+		write_instruction(fd, game, instr, checked);
+		if (checked)
+			fprintf(fd, "\tnative_check_step(game, &fs, "
+				"&game->info->instructions[%zu]);\n",
+				func->first_instruction + i);
+	}
+
+	fprintf(fd, "\n");
+	if (is_target[func->nr_instructions])
+		fprintf(fd, "i_%zu:\n", func->nr_instructions);
+	fprintf(fd, "\t(void)ok;\n"
+		"\treturn true;\n"
+		"}\n\n");
+
+	free(is_target);
+}
+
+static void write_function_table(FILE *fd, struct comprehend_game *game,
+				 bool checked)
+{
+	size_t i;
+
+	fprintf(fd, "static const native_function_fn %sfunctions[] = {\n",
+		checked ? "checked_" : "");
+	for (i = 0; i < game->info->nr_functions; i++)
+		fprintf(fd, "\tf_%.4zx%s,\n", i, checked ? "_checked" : "");
+	fprintf(fd, "};\n\n");
+}
+
+/*
+ * Translate the game's functions to C. The checked versions of the
+ * functions are written as well, and the module records which game files
+ * the code was generated from.
+ */
+void game_native_write(struct comprehend_game *game, const char *dirname,
+		       const char *filename)
+{
+	struct game_info *info = game->info;
+	FILE *fd;
+	size_t i;
+
+	fd = fopen(filename, "w");
+	if (!fd)
+		fatal_strerror(errno, "Cannot create native code '%s'",
+			       filename);
+
+	fprintf(fd,
+		"/*\n"
+		" * Native code for %s, generated by recomprehend.\n"
+		" * Do not edit.\n"
+		" */\n\n"
+		"#include <stdbool.h>\n"
+		"#include <stdint.h>\n"
+		"#include <stdio.h>\n\n"
+		"#include \"recomprehend.h\"\n"
+		"#include \"game_data.h\"\n"
+		"#include \"game_native.h\"\n"
+		"#include \"image_data.h\"\n"
+		"#include \"strings.h\"\n"
+		"#include \"game.h\"\n"
+		"#include \"util.h\"\n\n", game->game_name);
+
+	for (i = 0; i < info->nr_functions; i++) {
+		fprintf(fd, "static bool f_%.4zx(struct comprehend_game *game, "
+			"struct word *verb,\n"
+			"\t\t   struct word *noun);\n", i);
+		fprintf(fd, "static bool f_%.4zx_checked("
+			"struct comprehend_game *game, struct word *verb,\n"
+			"\t\t\t   struct word *noun);\n", i);
+	}
+
+	fprintf(fd,
+		"\n"
+		"static void inventory(struct comprehend_game *game, "
+		"uint8_t room,\n"
+		"\t\t      uint16_t string, uint16_t string_empty)\n"
+		"{\n"
+		"\tstruct item *item;\n\n"
+		"\tif (num_objects_in_room(game, room) == 0) {\n"
+		"\t\tconsole_println_string(game, string_empty);\n"
+		"\t\treturn;\n"
+		"\t}\n\n"
+		"\tconsole_println_string(game, string);\n"
+		"\tfor (item = first_item_in_room(game, room); item;\n"
+		"\t     item = next_item_in_room(game, item))\n"
+		"\t\tprintf(\"%%s\\n\", string_lookup(game, "
+		"item->string_desc));\n"
+		"}\n\n");
+
+	for (i = 0; i < info->nr_functions; i++) {
+		write_function(fd, game, i, false);
+		write_function(fd, game, i, true);
+	}
+
+	write_function_table(fd, game, false);
+	write_function_table(fd, game, true);
+
+	fprintf(fd,
+		"const struct native_module %s = {\n"
+		"\t.version\t\t= NATIVE_VERSION,\n"
+		"\t.build_id\t\t= 0x%.16llxULL,\n"
+		"\t.layout\t\t\t= NATIVE_LAYOUT,\n"
+		"\t.game_hash\t\t= 0x%.16llxULL,\n"
+		"\t.nr_functions\t\t= %zu,\n"
+		"\t.functions\t\t= functions,\n"
+		"\t.checked_functions\t= checked_functions,\n"
+		"};\n", NATIVE_MODULE_SYMBOL,
+		(unsigned long long)NATIVE_BUILD_ID,
+		(unsigned long long)game_cache_hash(game),
+		info->nr_functions);
+
+	if (fclose(fd) != 0)
+		fatal_strerror(errno, "Cannot write native code '%s'",
+			       filename);
+}
+
+/*
+ * Load the native code set with --native. It is only used if it was built
+ * for this game's files and this build of the interpreter, otherwise the
+ * interpreter is used.
+ */
+void game_native_load(struct comprehend_game *game, const char *dirname)
+{
+	static const size_t layout[NATIVE_NR_LAYOUT] = NATIVE_LAYOUT;
+	const struct native_module *native;
+	struct game_info *info = game->info;
+	char path[PATH_MAX];
+	void *handle;
+
+	if (!native_filename)
+		return;
+
+	/* dlopen searches the library path for names without a slash */
+	snprintf(path, sizeof(path), "%s%s",
+		 strchr(native_filename, '/') ? "" : "./", native_filename);
+
+	handle = dlopen(path, RTLD_NOW);
+	if (!handle) {
+		debug_printf(DEBUG_GAME_STATE, "No native code: %s\n",
+			     dlerror());
+		return;
+	}
+
+	native = dlsym(handle, NATIVE_MODULE_SYMBOL);
+	if (!native || native->version != NATIVE_VERSION ||
+	    NATIVE_BUILD_ID == 0 || native->build_id != NATIVE_BUILD_ID ||
+	    memcmp(native->layout, layout, sizeof(layout)) != 0 ||
+	    native->game_hash != game_cache_hash(game) ||
+	    native->nr_functions != info->nr_functions) {
+		debug_printf(DEBUG_GAME_STATE,
+			     "Ignoring stale native code '%s'\n",
+			     native_filename);
+		dlclose(handle);
+		return;
+	}
+
+	info->native = native;
+	info->native_handle = handle;
+}
+
+void game_native_unload(struct comprehend_game *game)
+{
+	struct game_info *info = game->info;
+
+	if (info->native_handle)
+		dlclose(info->native_handle);
+	info->native = NULL;
+	info->native_handle = NULL;
+}
+
+/*
+ * Check mode. Each function is run twice from the same state, first by the
+ * native code and then by the interpreter, and a digest of the state is
+ * recorded after every instruction. The runs must execute the same
+ * instructions with the same results.
+ */
+struct native_step {
+	size_t		instr;
+	uint64_t	digest;
+};
+
+struct native_log {
+	struct native_step	*steps;
+	size_t			nr_steps;
+	size_t			nr_allocated;
+};
+
+static struct native_log *check_log;
+
+/* The parts of the session which the functions can modify */
+struct state_snapshot {
+	struct game_state	state;
+	struct room		*rooms;
+	struct item		*item;
+	struct item_links	*item_links;
+	char			**replace_words;
+	void			*hook_state;
+};
+
+static void *copy_data(const void *data, size_t size)
+{
+	void *copy = xmalloc(size);
+
+	memcpy(copy, data, size);
+	return copy;
+}
+
+static void snapshot_save(struct comprehend_game *game,
+			  struct state_snapshot *snap)
+{
+	struct game_state *state = game->state;
+	struct game_info *info = game->info;
+	size_t i;
+
+	snap->state = *state;
+	snap->rooms = copy_data(state->rooms,
+				(info->nr_rooms + 1) * sizeof(*state->rooms));
+	snap->item = copy_data(state->item,
+			       info->header.nr_items * sizeof(*state->item));
+	snap->item_links = copy_data(state->item_links,
+				     info->header.nr_items *
+				     sizeof(*state->item_links));
+
+	snap->replace_words = xmalloc(state->nr_replace_words *
+				      sizeof(*snap->replace_words));
+	for (i = 0; i < state->nr_replace_words; i++)
+		snap->replace_words[i] =
+			xstrndup(state->replace_words[i],
+				 strlen(state->replace_words[i]));
+
+	snap->hook_state = NULL;
+	if (game->ops->hook_state_size)
+		snap->hook_state = copy_data(state->hook_state,
+					     game->ops->hook_state_size);
+}
+
+static void snapshot_restore(struct comprehend_game *game,
+			     struct state_snapshot *snap)
+{
+	struct game_state *state = game->state;
+	struct game_state saved = *state;
+	struct game_info *info = game->info;
+	size_t i;
+
+	*state = snap->state;
+
+	state->rooms = saved.rooms;
+	memcpy(state->rooms, snap->rooms,
+	       (info->nr_rooms + 1) * sizeof(*state->rooms));
+	state->item = saved.item;
+	memcpy(state->item, snap->item,
+	       info->header.nr_items * sizeof(*state->item));
+	state->item_links = saved.item_links;
+	memcpy(state->item_links, snap->item_links,
+	       info->header.nr_items * sizeof(*state->item_links));
+
+	state->replace_words = saved.replace_words;
+	for (i = 0; i < state->nr_replace_words; i++) {
+		free(state->replace_words[i]);
+		state->replace_words[i] =
+			xstrndup(snap->replace_words[i],
+				 strlen(snap->replace_words[i]));
+	}
+
+	state->hook_state = saved.hook_state;
+	if (game->ops->hook_state_size)
+		memcpy(state->hook_state, snap->hook_state,
+		       game->ops->hook_state_size);
+
+	state->frames = saved.frames;
+	state->nr_frames = saved.nr_frames;
+	state->nr_frames_allocated = saved.nr_frames_allocated;
+	state->strings = saved.strings;
+	state->strings2 = saved.strings2;
+}
+
+static void snapshot_free(struct state_snapshot *snap)
+{
+	size_t i;
+
+	for (i = 0; i < snap->state.nr_replace_words; i++)
+		free(snap->replace_words[i]);
+	free(snap->replace_words);
+	free(snap->item_links);
+	free(snap->item);
+	free(snap->rooms);
+	free(snap->hook_state);
+}
+
+static uint64_t state_digest(struct comprehend_game *game,
+			     struct function_state *func_state)
+{
+	struct game_state *state = game->state;
+	struct game_info *info = game->info;
+	uint64_t hash = FNV_OFFSET_BASIS;
+	size_t i;
+
+	hash = hash_data(hash, state->rooms,
+			 (info->nr_rooms + 1) * sizeof(*state->rooms));
+	hash = hash_data(hash, state->item,
+			 info->header.nr_items * sizeof(*state->item));
+	hash = hash_data(hash, state->flags, sizeof(state->flags));
+	hash = hash_data(hash, state->variable, sizeof(state->variable));
+	hash = hash_data(hash, &state->current_room,
+			 sizeof(state->current_room));
+	hash = hash_data(hash, &state->current_replace_word,
+			 sizeof(state->current_replace_word));
+	hash = hash_data(hash, &state->update_flags,
+			 sizeof(state->update_flags));
+	hash = hash_data(hash, &state->nr_frames, sizeof(state->nr_frames));
+	for (i = 0; i < state->nr_replace_words; i++)
+		hash = hash_data(hash, state->replace_words[i],
+				 strlen(state->replace_words[i]) + 1);
+	if (game->ops->hook_state_size)
+		hash = hash_data(hash, state->hook_state,
+				 game->ops->hook_state_size);
+
+	/* The function state has padding, so hash each field */
+	hash = hash_data(hash, &func_state->test_result,
+			 sizeof(func_state->test_result));
+	hash = hash_data(hash, &func_state->else_result,
+			 sizeof(func_state->else_result));
+	hash = hash_data(hash, &func_state->or_count,
+			 sizeof(func_state->or_count));
+	hash = hash_data(hash, &func_state->and, sizeof(func_state->and));
+	hash = hash_data(hash, &func_state->in_command,
+			 sizeof(func_state->in_command));
+	hash = hash_data(hash, &func_state->executed,
+			 sizeof(func_state->executed));
+
+	return hash;
+}
+
+/*
+ * Called after every instruction by the checked versions of the native
+ * code and the interpreter.
+ */
+void native_check_step(struct comprehend_game *game,
+		       struct function_state *func_state,
+		       struct instruction *instr)
+{
+	struct native_log *log = check_log;
+	struct native_step *step;
+
+	if (!log)
+		return;
+
+	log->steps = grow_array(log->steps, &log->nr_allocated,
+				log->nr_steps + 1, sizeof(*log->steps));
+	step = &log->steps[log->nr_steps++];
+	step->instr = instr - game->info->instructions;
+	step->digest = state_digest(game, func_state);
+}
+
+static int mute_stdout(void)
+{
+	int fd, saved;
+
+	fflush(stdout);
+	saved = dup(STDOUT_FILENO);
+	fd = open("/dev/null", O_WRONLY);
+	if (saved < 0 || fd < 0 || dup2(fd, STDOUT_FILENO) < 0)
+		fatal_strerror(errno, "Cannot redirect output");
+
+	close(fd);
+	return saved;
+}
+
+static void unmute_stdout(int saved)
+{
+	fflush(stdout);
+	if (dup2(saved, STDOUT_FILENO) < 0)
+		fatal_strerror(errno, "Cannot restore output");
+	close(saved);
+}
+
+static void compare_logs(size_t index, struct native_log *native,
+			 struct native_log *interp, bool native_ret, bool ret)
+{
+	struct native_step *a, *b;
+	size_t i;
+
+	for (i = 0; i < native->nr_steps && i < interp->nr_steps; i++) {
+		a = &native->steps[i];
+		b = &interp->steps[i];
+
+		if (a->instr != b->instr)
+			fatal_error("Function %.4zx step %zu: native code ran instruction %.4zx, interpreter ran %.4zx\n",
+				    index, i, a->instr, b->instr);
+		if (a->digest != b->digest)
+			fatal_error("Function %.4zx step %zu: state differs after instruction %.4zx\n",
+				    index, i, a->instr);
+	}
+
+	if (native->nr_steps != interp->nr_steps)
+		fatal_error("Function %.4zx: native code ran %zu instructions, interpreter ran %zu\n",
+			    index, native->nr_steps, interp->nr_steps);
+	if (native_ret != ret)
+		fatal_error("Function %.4zx: native code returned %d, interpreter returned %d\n",
+			    index, native_ret, ret);
+}
+
+/*
+ * The native code runs first with its output discarded, so that the
+ * interpreter's output is what is seen. Any input it reads is replayed to
+ * the interpreter. Anything else the functions do outside of the game
+ * state, such as drawing or writing a saved game, happens twice.
+ */
+static bool check_function(struct comprehend_game *game,
+			   struct function *func,
+			   struct word *verb, struct word *noun,
+			   eval_function_fn interpret_checked)
+{
+	const struct native_module *native = game->info->native;
+	size_t index = func - game->info->functions;
+	struct native_log *saved_log = check_log;
+	struct native_log native_log = {0}, interp_log = {0};
+	struct console_input input;
+	struct state_snapshot snap;
+	bool native_ret, ret;
+	int saved_stdout;
+
+	snapshot_save(game, &snap);
+
+	saved_stdout = mute_stdout();
+	console_input_record(&input);
+	check_log = &native_log;
+	native_ret = native->checked_functions[index](game, verb, noun);
+	unmute_stdout(saved_stdout);
+
+	snapshot_restore(game, &snap);
+	console_input_replay(&input);
+	check_log = &interp_log;
+	ret = interpret_checked(game, func, verb, noun);
+	check_log = saved_log;
+	console_input_end(&input);
+
+	compare_logs(index, &native_log, &interp_log, native_ret, ret);
+
+	free(native_log.steps);
+	free(interp_log.steps);
+	snapshot_free(&snap);
+	return ret;
+}
+
+/*
+ * Run a function with the loaded native code. In check mode it is also run
+ * by interpret_checked, the checked version of the interpreter, and the
+ * two are compared.
+ */
+bool native_eval_function(struct comprehend_game *game, struct function *func,
+			  struct word *verb, struct word *noun,
+			  eval_function_fn interpret_checked)
+{
+	const struct native_module *native = game->info->native;
+
+	if (native_check)
+		return check_function(game, func, verb, noun,
+				      interpret_checked);
+	return native->functions[func - game->info->functions](game, verb,
+								noun);
+}
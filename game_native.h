@@ -0,0 +1,96 @@
+/*
+ * This file is part of Re-Comprehend
+ *
+ * Ryan Mallon, 2015, <rmallon@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to
+ * the public domain worldwide. This software is distributed without
+ * any warranty.  You should have received a copy of the CC0 Public
+ * Domain Dedication along with this software. If not, see
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ */
+
+#ifndef _RECOMPREHEND_GAME_NATIVE_H
+#define _RECOMPREHEND_GAME_NATIVE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct comprehend_game;
+struct function;
+struct function_state;
+struct instruction;
+struct word;
+
+/*
+ * A game's functions can be translated to C with --compile-native and
+ * built as a shared object, which is then loaded in place of the
+ * interpreter. The generated code includes the engine headers and calls
+ * back into the engine, so it is only used if it was generated by an
+ * interpreter built from the same sources, for the same structure layouts
+ * and the same game files. The build ID is a checksum of the engine
+ * sources set by the Makefile, so any change to the engine's structures or
+ * functions makes older native code stale.
+ */
+#define NATIVE_VERSION		2
+#define NATIVE_MODULE_SYMBOL	"comprehend_native_module"
+
+#define NATIVE_LAYOUT {				\
+		sizeof(struct comprehend_game),	\
+		sizeof(struct game_info),	\
+		sizeof(struct game_state),	\
+		sizeof(struct function_state),	\
+		sizeof(struct instruction),	\
+		sizeof(struct room),		\
+		sizeof(struct item),		\
+		sizeof(struct word),		\
+	}
+
+#define NATIVE_NR_LAYOUT	8
+
+/*
+ * Runs one function. Returns false if the call depth limit was exceeded,
+ * like eval_function.
+ */
+typedef bool (*native_function_fn)(struct comprehend_game *game,
+				   struct word *verb, struct word *noun);
+
+/* An interpreter version of eval_function */
+typedef bool (*eval_function_fn)(struct comprehend_game *game,
+				 struct function *func,
+				 struct word *verb, struct word *noun);
+
+struct native_module {
+	uint32_t			version;
+	uint64_t			build_id;
+	size_t				layout[NATIVE_NR_LAYOUT];
+	uint64_t			game_hash;
+
+	/*
+	 * The checked versions report the state after every instruction,
+	 * for --native-check.
+	 */
+	size_t				nr_functions;
+	const native_function_fn	*functions;
+	const native_function_fn	*checked_functions;
+};
+
+void game_native_set_file(const char *filename);
+void game_native_set_check(bool check);
+void game_native_load(struct comprehend_game *game, const char *dirname);
+void game_native_unload(struct comprehend_game *game);
+void game_native_write(struct comprehend_game *game, const char *dirname,
+		       const char *filename);
+
+bool native_eval_function(struct comprehend_game *game, struct function *func,
+			  struct word *verb, struct word *noun,
+			  eval_function_fn interpret_checked);
+void native_check_step(struct comprehend_game *game,
+		       struct function_state *func_state,
+		       struct instruction *instr);
+
+#endif /* _RECOMPREHEND_GAME_NATIVE_H */
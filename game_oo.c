@@ -29,11 +29,11 @@ static int oo_room_is_special(struct comprehend_game *game,
 			      unsigned room_index,
 			      unsigned *room_desc_string)
 {
-	struct room *room = &game->info->rooms[room_index];
+	struct room *room = &game->state->rooms[room_index];
 
 	/* Is the room dark */
 	if ((room->flags & OO_ROOM_FLAG_DARK) &&
-	    !(game->info->flags[OO_FLAG_FLASHLIGHT_ON])) {
+	    !(game->state->flags[OO_FLAG_FLASHLIGHT_ON])) {
 		if (room_desc_string)
 			*room_desc_string = 0xb3; 
 		return ROOM_IS_DARK;
@@ -41,7 +41,7 @@ static int oo_room_is_special(struct comprehend_game *game,
 
 	/* Is the room too bright */
 	if (room_index == OO_BRIGHT_ROOM && 
-	    !game->info->flags[OO_FLAG_WEARING_GOGGLES]) {
+	    !game->state->flags[OO_FLAG_WEARING_GOGGLES]) {
 		if (room_desc_string)
 			*room_desc_string = 0x1c;
 		return ROOM_IS_TOO_BRIGHT;
@@ -50,30 +50,35 @@ static int oo_room_is_special(struct comprehend_game *game,
 	return ROOM_IS_NORMAL;
 }
 
+struct oo_state {
+	bool			flashlight_was_on;
+	bool			goggles_were_worn;
+};
+
 static bool oo_before_turn(struct comprehend_game *game)
 {
 	/* FIXME - probably doesn't work correctly with restored games */
-	static bool flashlight_was_on = false, googles_were_worn = false;
-	struct room *room = &game->info->rooms[game->info->current_room];
+	struct oo_state *oo = game->state->hook_state;
+	struct room *room = &game->state->rooms[game->state->current_room];
 
 	/* 
 	 * Check if the room needs to be redrawn because the flashlight
 	 * was switch off or on.
 	 */
-	if (game->info->flags[OO_FLAG_FLASHLIGHT_ON] != flashlight_was_on &&
+	if (game->state->flags[OO_FLAG_FLASHLIGHT_ON] != oo->flashlight_was_on &&
 	    (room->flags & OO_ROOM_FLAG_DARK)) {
-		flashlight_was_on = game->info->flags[OO_FLAG_FLASHLIGHT_ON];
-		game->info->update_flags |= UPDATE_GRAPHICS | UPDATE_ROOM_DESC;
+		oo->flashlight_was_on = game->state->flags[OO_FLAG_FLASHLIGHT_ON];
+		game->state->update_flags |= UPDATE_GRAPHICS | UPDATE_ROOM_DESC;
 	}
 
 	/*
 	 * Check if the room needs to be redrawn because the goggles were
 	 * put on or removed.
 	 */
-	if (game->info->flags[OO_FLAG_WEARING_GOGGLES] != googles_were_worn &&
-	    game->info->current_room == OO_BRIGHT_ROOM) {
-		googles_were_worn = game->info->flags[OO_FLAG_WEARING_GOGGLES];
-		game->info->update_flags |= UPDATE_GRAPHICS | UPDATE_ROOM_DESC;
+	if (game->state->flags[OO_FLAG_WEARING_GOGGLES] != oo->goggles_were_worn &&
+	    game->state->current_room == OO_BRIGHT_ROOM) {
+		oo->goggles_were_worn = game->state->flags[OO_FLAG_WEARING_GOGGLES];
+		game->state->update_flags |= UPDATE_GRAPHICS | UPDATE_ROOM_DESC;
 	}
 
 	return false;
@@ -108,6 +113,7 @@ static struct game_ops oo_ops = {
 	.before_turn		= oo_before_turn,	
 	.room_is_special	= oo_room_is_special,
 	.handle_special_opcode	= oo_handle_special_opcode,
+	.hook_state_size	= sizeof(struct oo_state),
 };
 
 struct comprehend_game game_oo_topos = {
@@ -22,6 +22,7 @@
 
 #include "recomprehend.h"
 #include "game_data.h"
+#include "strings.h"
 #include "game.h"
 #include "util.h"
 
@@ -56,17 +57,17 @@ static void tr_update_monster(struct comprehend_game *game,
 	struct room *room;
 	uint16_t turn_count;
 
-	room = &game->info->rooms[game->info->current_room];
-	turn_count = game->info->variable[VAR_TURN_COUNT];
+	room = &game->state->rooms[game->state->current_room];
+	turn_count = game->state->variable[VAR_TURN_COUNT];
 
 	monster = get_item(game, monster_info->object);
-	if (monster->room == game->info->current_room) {
+	if (monster->room == game->state->current_room) {
 		/* The monster is in the current room - leave it there */
 		return;
 	}
 
 	if ((room->flags & monster_info->room_allow_flag) &&
-	    !game->info->flags[monster_info->dead_flag] &&
+	    !game->state->flags[monster_info->dead_flag] &&
 	    turn_count > monster_info->min_turns_before) {
 		/*
 		 * The monster is alive and allowed to move to the current
@@ -74,8 +75,8 @@ static void tr_update_monster(struct comprehend_game *game,
 		 * it back to limbo.
 		 */
 		if ((rand() % monster_info->randomness) == 0) {
-			move_object(game, monster, game->info->current_room);
-			game->info->variable[0xf] = turn_count + 1;
+			move_object(game, monster, game->state->current_room);
+			game->state->variable[0xf] = turn_count + 1;
 		} else {
 			move_object(game, monster, ROOM_NOWHERE);
 		}
@@ -85,7 +86,7 @@ static void tr_update_monster(struct comprehend_game *game,
 static int tr_room_is_special(struct comprehend_game *game, unsigned room_index,
 			      unsigned *room_desc_string)
 {
-	struct room *room = &game->info->rooms[room_index];
+	struct room *room = &game->state->rooms[room_index];
 
 	if (room_index == 0x28) {
 		if (room_desc_string)
@@ -141,8 +142,8 @@ static void tr_handle_special_opcode(struct comprehend_game *game,
 		 * evening' in his cabin.
 		 */
 		draw_location_image(&game->info->room_images, 41);
-		console_get_key();
-		game->info->update_flags |= UPDATE_GRAPHICS;
+		console_wait_key();
+		game->state->update_flags |= UPDATE_GRAPHICS;
 		break;
 	}
 }
@@ -152,7 +153,7 @@ static void read_string(char *buffer, size_t size)
 	char *p;
 
 	printf("> ");
-	fgets(buffer, size, stdin);
+	console_get_line(buffer, size);
 
 	/* Remove trailing newline */
 	p = strchr(buffer, '\n');
@@ -166,7 +167,7 @@ static void tr_before_game(struct comprehend_game *game)
 	char buffer[128];
 
 	/* Welcome to Transylvania - sign your name */
-	console_println(game, game->info->strings.strings[0x20]);
+	console_println_string(game, 0x20);
 	read_string(buffer, sizeof(buffer));
 
 	/*
@@ -175,15 +176,13 @@ static void tr_before_game(struct comprehend_game *game)
 	 * limited (the original game will break if you put a name in that
 	 * is too long).
 	 */
-	if (!game->info->replace_words[0])
-		game->info->replace_words[0] = xstrndup(buffer, strlen(buffer));
-	else
-		snprintf(game->info->replace_words[0],
-			 strlen(game->info->replace_words[0]),
+	if (game->state->nr_replace_words)
+		snprintf(game->state->replace_words[0],
+			 strlen(game->state->replace_words[0]),
 			 "%s", buffer);
 
 	/* And your next of kin - This isn't store by the game */
-	console_println(game, game->info->strings.strings[0x21]);
+	console_println_string(game, 0x21);
 	read_string(buffer, sizeof(buffer));
 }
 
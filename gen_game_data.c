@@ -0,0 +1,1949 @@
+/*
+ * This file is part of Re-Comprehend
+ *
+ * Ryan Mallon, 2015, <rmallon@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to
+ * the public domain worldwide. This software is distributed without
+ * any warranty.  You should have received a copy of the CC0 Public
+ * Domain Dedication along with this software. If not, see
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ */
+
+/*
+ * Synthetic game data generator.
+ *
+ * Writes a complete set of Comprehend game files (game data file, string
+ * files and image files) using the same layout as one of the supported
+ * games, so that the result can be loaded with the matching short name. The
+ * content is random but well formed: every operand references a valid room,
+ * item, flag, variable, string or function, function calls are acyclic, and
+ * instructions which need a current object are only used by actions which
+ * are guaranteed to have one. A command script exercising the parser and VM
+ * is written alongside the game files.
+ */
+
+#include <sys/stat.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include "game_data.h"
+#include "image_data.h"
+#include "util.h"
+
+#define STRINGS_PER_FILE	0x40
+
+#define MAX_ROOMS		0xfe
+#define MAX_ITEMS		0xff
+#define MAX_WORDS		0xfe
+#define MAX_STRINGS		0x200
+#define MAX_FUNCTIONS		0x200
+
+struct gen_layout {
+	const char		*short_name;
+	unsigned		version;
+	const char		*game_data_file;
+	const char		*string_files[5];
+	uint32_t		string_base[5];
+	uint32_t		string_end[5];
+	const char		*room_image_files[5];
+	const char		*item_image_files[5];
+	uint8_t			special_save;
+	uint8_t			special_restore;
+	uint8_t			special_restart;
+	bool			asks_name;
+};
+
+static struct gen_layout layouts[] = {
+	{
+		.short_name		= "tr",
+		.version		= 1,
+		.game_data_file		= "TR.GDA",
+		.string_files		= {"MA.MS1", "MB.MS1", "MC.MS1",
+					   "MD.MS1", "ME.MS1"},
+		.string_base		= {0x88, 0x88, 0x88, 0x88, 0x88},
+		.room_image_files	= {"RA.MS1", "RB.MS1", "RC.MS1"},
+		.item_image_files	= {"OA.MS1", "OB.MS1", "OC.MS1"},
+		.special_save		= 0x06,
+		.special_restore	= 0x07,
+		.special_restart	= 0x08,
+		.asks_name		= true,
+	},
+	{
+		.short_name		= "cc1",
+		.version		= 1,
+		.game_data_file		= "CC1.GDA",
+		.string_files		= {"MA.MS1"},
+		.string_base		= {0x89},
+		.room_image_files	= {"RA.MS1", "RB.MS1", "RC.MS1"},
+		.item_image_files	= {"OA.MS1", "OB.MS1"},
+		.special_save		= 0x06,
+		.special_restore	= 0x07,
+		.special_restart	= 0x03,
+	},
+	{
+		.short_name		= "oo",
+		.version		= 2,
+		.game_data_file		= "G0",
+		.string_files		= {"NOVEL.EXE", "NOVEL.EXE", "NOVEL.EXE",
+					   "NOVEL.EXE", "NOVEL.EXE"},
+		.string_base		= {0x16564, 0x17702, 0x186b2,
+					   0x19c62, 0x1a634},
+		.string_end		= {0x17640, 0x18600, 0x19b80,
+					   0x1a590, 0x1b080},
+		.room_image_files	= {"RA", "RB", "RC", "RD", "RE"},
+		.item_image_files	= {"OA", "OB", "OC", "OD"},
+		.special_save		= 0x06,
+		.special_restore	= 0x07,
+	},
+};
+
+struct gen_params {
+	struct gen_layout	*layout;
+	const char		*out_dir;
+	unsigned		nr_rooms;
+	unsigned		nr_items;
+	unsigned		nr_words;
+	unsigned		nr_strings;
+	unsigned		nr_functions;
+	unsigned		nr_commands;
+	uint32_t		seed;
+};
+
+struct out_buf {
+	uint8_t			*data;
+	size_t			size;
+	size_t			alloc;
+};
+
+/* Generic opcode flags */
+#define OPF_TEST		(1 << 0)
+#define OPF_NEEDS_NOUN		(1 << 1)
+#define OPF_NEEDS_DIR_VERB	(1 << 2)
+#define OPF_RARE		(1 << 3)
+
+/* Operand kinds */
+enum {
+	ARG_NONE,
+	ARG_ITEM,	/* Item index + 1 */
+	ARG_ROOM,	/* Room index */
+	ARG_ROOM_ANY,	/* Room index, inventory or nowhere */
+	ARG_FLAG,
+	ARG_VAR,
+	ARG_MASK,
+	ARG_DIR,	/* Direction + 1 */
+	ARG_STR_INDEX,
+	ARG_STR_TABLE,
+	ARG_STR_TABLE_MAIN,
+	ARG_REPLACE,
+	ARG_GRAPHIC,
+	ARG_ITEM_GRAPHIC,
+	ARG_FUNC,
+	ARG_FUNC_BANK,
+	ARG_ANY,
+};
+
+struct gen_opcode {
+	uint8_t			opcode;
+	uint8_t			raw[2];		/* Version 1, version 2 */
+	unsigned		flags;
+	uint8_t			args[3];
+};
+
+/* A raw opcode of zero means the opcode is not available in that version */
+static struct gen_opcode gen_opcodes[] = {
+	{OPCODE_HAVE_OBJECT,		{0x01, 0x01}, OPF_TEST,
+	 {ARG_ITEM}},
+	{OPCODE_IN_ROOM,		{0x05, 0x05}, OPF_TEST,
+	 {ARG_ROOM}},
+	{OPCODE_VAR_EQ,			{0x06, 0x06}, OPF_TEST,
+	 {ARG_VAR, ARG_VAR}},
+	{OPCODE_OBJECT_PRESENT,		{0x09, 0x21}, OPF_TEST,
+	 {ARG_ITEM}},
+	{OPCODE_OBJECT_IN_ROOM,		{0x0e, 0x22}, OPF_TEST,
+	 {ARG_ITEM, ARG_ROOM_ANY}},
+	{OPCODE_OBJECT_NOT_VALID,	{0x14, 0x14}, OPF_TEST},
+	{OPCODE_TEST_FLAG,		{0x19, 0x19}, OPF_TEST,
+	 {ARG_FLAG}},
+	{OPCODE_CURRENT_OBJECT_IN_ROOM,	{0x1d, 0x00}, OPF_TEST,
+	 {ARG_ROOM_ANY}},
+	{OPCODE_OBJECT_IS_NOT_NOWHERE,	{0x21, 0x00}, OPF_TEST,
+	 {ARG_ITEM}},
+	{OPCODE_CURRENT_OBJECT_PRESENT,	{0x24, 0x30}, OPF_TEST},
+	{OPCODE_TEST_ROOM_FLAG,		{0x31, 0x1d}, OPF_TEST,
+	 {ARG_MASK}},
+	{OPCODE_NOT_HAVE_OBJECT,	{0x41, 0x41}, OPF_TEST,
+	 {ARG_ITEM}},
+	{OPCODE_NOT_IN_ROOM,		{0x45, 0x45}, OPF_TEST,
+	 {ARG_ROOM}},
+	{OPCODE_CURRENT_OBJECT_IS_NOWHERE, {0x48, 0x48}, OPF_TEST},
+	{OPCODE_OBJECT_NOT_PRESENT,	{0x49, 0x61}, OPF_TEST,
+	 {ARG_ITEM}},
+	{OPCODE_OBJECT_NOT_IN_ROOM,	{0x43, 0x43}, OPF_TEST,
+	 {ARG_ITEM, ARG_ROOM_ANY}},
+	{OPCODE_TEST_FALSE,		{0x50, 0x00}, OPF_TEST},
+	{OPCODE_TEST_NOT_FLAG,		{0x59, 0x59}, OPF_TEST,
+	 {ARG_FLAG}},
+	{OPCODE_NOT_HAVE_CURRENT_OBJECT, {0x60, 0x60}, OPF_TEST},
+	{OPCODE_OBJECT_IS_NOWHERE,	{0x61, 0x11}, OPF_TEST,
+	 {ARG_ITEM}},
+	{OPCODE_CURRENT_OBJECT_NOT_PRESENT, {0x64, 0x70}, OPF_TEST},
+	{OPCODE_TEST_NOT_ROOM_FLAG,	{0x71, 0x5d}, OPF_TEST,
+	 {ARG_MASK}},
+	{OPCODE_CURRENT_OBJECT_TAKEABLE, {0x08, 0x00}, OPF_TEST},
+	{OPCODE_CURRENT_OBJECT_NOT_TAKEABLE, {0x68, 0x00}, OPF_TEST},
+	{OPCODE_CURRENT_IS_OBJECT,	{0x00, 0x08}, OPF_TEST},
+	{OPCODE_CURRENT_NOT_OBJECT,	{0x00, 0x74}, OPF_TEST},
+	{OPCODE_HAVE_CURRENT_OBJECT,	{0x20, 0x20},
+	 OPF_TEST | OPF_NEEDS_NOUN},
+	{OPCODE_INVENTORY_FULL,		{0x18, 0x38},
+	 OPF_TEST | OPF_NEEDS_NOUN},
+
+	{OPCODE_INVENTORY,		{0x80, 0x80}, 0},
+	{OPCODE_TAKE_OBJECT,		{0x81, 0x81}, 0,
+	 {ARG_ITEM}},
+	{OPCODE_MOVE_OBJECT_TO_ROOM,	{0x82, 0x82}, 0,
+	 {ARG_ITEM, ARG_ROOM_ANY}},
+	{OPCODE_SAVE_ACTION,		{0x84, 0x84}, 0},
+	{OPCODE_MOVE_TO_ROOM,		{0x85, 0x85}, 0,
+	 {ARG_ROOM}},
+	{OPCODE_VAR_ADD,		{0x86, 0x86}, 0,
+	 {ARG_VAR, ARG_VAR}},
+	{OPCODE_SET_ROOM_DESCRIPTION,	{0x87, 0x87}, 0,
+	 {ARG_ROOM, ARG_STR_INDEX, ARG_STR_TABLE_MAIN}},
+	{OPCODE_MOVE_OBJECT_TO_CURRENT_ROOM, {0x89, 0xe1}, 0,
+	 {ARG_ITEM}},
+	{OPCODE_VAR_SUB,		{0x8a, 0x8a}, 0,
+	 {ARG_VAR, ARG_VAR}},
+	{OPCODE_SET_OBJECT_DESCRIPTION,	{0x8b, 0x8b}, 0,
+	 {ARG_ITEM, ARG_STR_INDEX, ARG_STR_TABLE}},
+	{OPCODE_PRINT,			{0x8e, 0x8e}, 0,
+	 {ARG_STR_INDEX, ARG_STR_TABLE}},
+	{OPCODE_REMOVE_OBJECT,		{0x95, 0xed}, 0,
+	 {ARG_ITEM}},
+	{OPCODE_SET_FLAG,		{0x99, 0x99}, 0,
+	 {ARG_FLAG}},
+	{OPCODE_CALL_FUNC,		{0x92, 0x92}, 0,
+	 {ARG_FUNC, ARG_FUNC_BANK}},
+	{OPCODE_TURN_TICK,		{0x98, 0x98}, 0},
+	{OPCODE_CLEAR_FLAG,		{0x9d, 0x9d}, 0,
+	 {ARG_FLAG}},
+	{OPCODE_INVENTORY_ROOM,		{0x9e, 0x9e}, 0,
+	 {ARG_ROOM_ANY, ARG_STR_INDEX}},
+	{OPCODE_SET_ROOM_GRAPHIC,	{0xa2, 0xc2}, 0,
+	 {ARG_ROOM, ARG_GRAPHIC}},
+	{OPCODE_SET_OBJECT_GRAPHIC,	{0x00, 0xc6}, 0,
+	 {ARG_ITEM, ARG_ITEM_GRAPHIC}},
+	{OPCODE_DO_VERB,		{0xb1, 0xb1}, 0},
+	{OPCODE_SET_STRING_REPLACEMENT,	{0xb9, 0xcd}, 0,
+	 {ARG_REPLACE}},
+	{OPCODE_VAR_INC,		{0xbd, 0xdd}, 0,
+	 {ARG_VAR}},
+	{OPCODE_VAR_DEC,		{0xc1, 0xc1}, 0,
+	 {ARG_VAR}},
+	{OPCODE_SET_OBJECT_LONG_DESCRIPTION, {0x00, 0x8f}, 0,
+	 {ARG_ITEM, ARG_STR_INDEX, ARG_STR_TABLE}},
+	{OPCODE_MOVE_DIRECTION,		{0x00, 0xd1}, 0,
+	 {ARG_DIR}},
+	{OPCODE_SET_CURRENT_NOUN_STRING_REPLACEMENT, {0x00, 0xc5}, 0,
+	 {ARG_ANY}},
+	{OPCODE_TAKE_CURRENT_OBJECT,	{0xa0, 0xa0}, OPF_NEEDS_NOUN},
+	{OPCODE_DROP_CURRENT_OBJECT,	{0xa4, 0xf0}, OPF_NEEDS_NOUN},
+	{OPCODE_REMOVE_CURRENT_OBJECT,	{0xb0, 0xfc}, OPF_NEEDS_NOUN},
+	{OPCODE_MOVE_CURRENT_OBJECT_TO_ROOM, {0xc9, 0xc9}, OPF_NEEDS_NOUN,
+	 {ARG_ROOM_ANY}},
+	{OPCODE_DESCRIBE_CURRENT_OBJECT, {0x00, 0xb5}, OPF_NEEDS_NOUN,
+	 {ARG_ANY}},
+	{OPCODE_MOVE,			{0x8c, 0x8c}, OPF_NEEDS_DIR_VERB},
+};
+
+#define FIRST_RANDOM_FUNCTION	7
+
+#define RAW_OPCODE_OR		0x04
+#define RAW_OPCODE_ELSE		0x0c
+#define RAW_OPCODE_SPECIAL_V1	0xa1
+#define RAW_OPCODE_SPECIAL_V2	0x89
+#define RAW_OPCODE_UNKNOWN_TEST	0x10
+#define RAW_OPCODE_UNKNOWN_CMD	0xb4
+
+static const char *direction_words[NR_DIRECTIONS] = {
+	"north", "south", "east", "west", "up", "down", "in", "out",
+};
+
+static const char *verb_words[] = {
+	"get", "drop", "look", "examin", "open", "close", "push", "pull",
+	"read", "eat", "throw", "wait", "go", "pick", "put", "inv",
+	"save", "load", "restar",
+};
+
+enum {
+	VERB_GET = NR_DIRECTIONS + 1,
+	VERB_DROP,
+	VERB_LOOK,
+	VERB_EXAMINE,
+	VERB_OPEN,
+	VERB_CLOSE,
+	VERB_PUSH,
+	VERB_PULL,
+	VERB_READ,
+	VERB_EAT,
+	VERB_THROW,
+	VERB_WAIT,
+	VERB_GO,
+	VERB_PICK,
+	VERB_PUT,
+	VERB_INVENTORY,
+	VERB_SAVE,
+	VERB_LOAD,
+	VERB_RESTART,
+	VERB_PUTIN,	/* Target of the "put in" word pair */
+	VERB_PICKUP,	/* Target of the "pick up" word pair */
+	NR_FIXED_VERBS,
+};
+
+static const char *join_words[] = {
+	"into", "on", "with", "at",
+};
+
+static const char *syllables[] = {
+	"ka", "lo", "mi", "ne", "ru", "sa", "to", "vi", "ze", "bo",
+	"dra", "gul", "hex", "qua", "wyn", "jor", "fen", "pix", "om", "ay",
+};
+
+static const char *string_words[] = {
+	"the", "a", "dark", "old", "room", "door", "you", "see", "small",
+	"strange", "light", "is", "here", "there", "cold", "wall", "of",
+	"stone", "and", "in", "corner", "quietly", "something", "moves",
+	"nothing", "happens", "it", "opens", "closed", "locked", "north",
+	"south", "passage", "key", "lamp", "box", "gold", "coin", "book",
+};
+
+static uint32_t rand_state;
+
+static uint32_t gen_rand(void)
+{
+	/* xorshift32 - deterministic across platforms */
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state;
+}
+
+static unsigned gen_rand_range(unsigned min, unsigned max)
+{
+	return min + (gen_rand() % (max - min + 1));
+}
+
+static bool gen_chance(unsigned percent)
+{
+	return (gen_rand() % 100) < percent;
+}
+
+static void out_reserve(struct out_buf *out, size_t size)
+{
+	if (out->alloc >= size)
+		return;
+
+	while (out->alloc < size)
+		out->alloc = out->alloc ? out->alloc * 2 : 0x1000;
+	out->data = xrealloc(out->data, out->alloc);
+}
+
+static void out_put_u8(struct out_buf *out, uint8_t val)
+{
+	out_reserve(out, out->size + 1);
+	out->data[out->size++] = val;
+}
+
+static void out_put_le16(struct out_buf *out, uint16_t val)
+{
+	out_put_u8(out, val & 0xff);
+	out_put_u8(out, val >> 8);
+}
+
+static void out_put_data(struct out_buf *out, const void *data, size_t size)
+{
+	out_reserve(out, out->size + size);
+	memcpy(out->data + out->size, data, size);
+	out->size += size;
+}
+
+static void out_patch_le16(struct out_buf *out, size_t pos, uint16_t val)
+{
+	out->data[pos] = val & 0xff;
+	out->data[pos + 1] = val >> 8;
+}
+
+static void out_pad_to(struct out_buf *out, size_t pos)
+{
+	while (out->size < pos)
+		out_put_u8(out, 0);
+}
+
+static void out_write(struct out_buf *out, const struct gen_params *params,
+		      const char *filename)
+{
+	char path[PATH_MAX];
+	FILE *fd;
+
+	snprintf(path, sizeof(path), "%s/%s", params->out_dir, filename);
+	fd = fopen(path, "wb");
+	if (!fd)
+		fatal_strerror(errno, "Cannot create '%s'", path);
+	if (fwrite(out->data, 1, out->size, fd) != out->size)
+		fatal_strerror(errno, "Cannot write '%s'", path);
+	fclose(fd);
+}
+
+static void out_free(struct out_buf *out)
+{
+	free(out->data);
+	memset(out, 0, sizeof(*out));
+}
+
+/*
+ * Packed string encoding. This is the inverse of the decoder in the engine:
+ * lower-case letters, space and full stop are stored directly, upper-case
+ * letters are prefixed with 0x1e and symbols with 0x1f. An upper-case space
+ * encodes the '@' replacement word marker.
+ */
+static const char special_charset[] = "[]\n!\"#$%&'(),-/0123456789:;?<>";
+
+static size_t encode_elems(const char *text, uint8_t *elems, size_t max)
+{
+	const char *p;
+	size_t n = 0;
+
+	for (p = text; *p && n + 2 < max; p++) {
+		if (*p == '@') {
+			elems[n++] = 0x1e;
+			elems[n++] = 28;
+		} else if (*p == '.') {
+			/* Index 1 would risk a zero byte in the output */
+			elems[n++] = 29;
+		} else if (*p == ' ') {
+			elems[n++] = 28;
+		} else if (*p >= 'a' && *p <= 'z') {
+			elems[n++] = *p - 'a' + 2;
+		} else if (*p >= 'A' && *p <= 'Z') {
+			elems[n++] = 0x1e;
+			elems[n++] = *p - 'A' + 2;
+		} else {
+			const char *s = strchr(special_charset + 1, *p);
+
+			/* '[' has index zero and cannot be encoded */
+			if (!s)
+				continue;
+			elems[n++] = 0x1f;
+			elems[n++] = s - special_charset;
+		}
+	}
+
+	return n;
+}
+
+static size_t encode_string(const char *text, uint8_t *buf, size_t max)
+{
+	uint8_t elems[4096];
+	size_t nr_elems, nr_bytes, i;
+	unsigned bit, elem;
+	bool retry;
+
+	nr_elems = encode_elems(text, elems, sizeof(elems));
+	do {
+		nr_bytes = (nr_elems * 5 + 7) / 8;
+		if (nr_bytes + 1 > max)
+			fatal_error("String too long");
+
+		memset(buf, 0, nr_bytes + 1);
+		for (i = 0; i < nr_elems; i++) {
+			for (bit = 0; bit < 5; bit++) {
+				unsigned pos = i * 5 + bit;
+
+				if (elems[i] & (0x10 >> bit))
+					buf[pos / 8] |= 0x80 >> (pos % 8);
+			}
+		}
+
+		/*
+		 * A zero byte would terminate the string early. Insert a
+		 * space before the element which starts in that byte to
+		 * shift the bits along (double spaces are not printed).
+		 */
+		retry = false;
+		for (i = 0; i < nr_bytes; i++) {
+			if (buf[i] != 0)
+				continue;
+
+			elem = (i * 8) / 5;
+			if (nr_elems + 1 >= sizeof(elems))
+				fatal_error("Cannot encode '%s'", text);
+			memmove(&elems[elem + 1], &elems[elem],
+				nr_elems - elem);
+			elems[elem] = 28;
+			nr_elems++;
+			retry = true;
+			break;
+		}
+	} while (retry);
+
+	return nr_bytes + 1;
+}
+
+static void out_put_string(struct out_buf *out, const char *text)
+{
+	uint8_t buf[4096];
+	size_t len;
+
+	len = encode_string(text, buf, sizeof(buf));
+	out_put_data(out, buf, len);
+}
+
+static void gen_word(char *buf, size_t size, unsigned min_syllables,
+		     unsigned max_syllables)
+{
+	unsigned i, n;
+
+	buf[0] = '\0';
+	n = gen_rand_range(min_syllables, max_syllables);
+	for (i = 0; i < n; i++)
+		strncat(buf, syllables[gen_rand() % ARRAY_SIZE(syllables)],
+			size - strlen(buf) - 1);
+}
+
+static void gen_sentence(char *buf, size_t size, unsigned nr_words)
+{
+	unsigned i;
+
+	buf[0] = '\0';
+	for (i = 0; i < nr_words; i++) {
+		const char *word = string_words[gen_rand() %
+						ARRAY_SIZE(string_words)];
+
+		if (i)
+			strncat(buf, " ", size - strlen(buf) - 1);
+		strncat(buf, word, size - strlen(buf) - 1);
+	}
+}
+
+/*
+ * Game model
+ */
+struct gen_word {
+	char		word[7];
+	uint8_t		index;
+	uint8_t		type;
+};
+
+struct gen_instruction {
+	uint8_t		raw;
+	uint8_t		operand[3];
+};
+
+struct gen_function {
+	struct gen_instruction	*instructions;
+	size_t			nr_instructions;
+};
+
+struct gen_action {
+	unsigned	type;
+	uint8_t		word[4];
+	uint16_t	function;
+};
+
+struct gen_game {
+	const struct gen_params	*params;
+	unsigned		version;
+
+	char			**strings;
+	size_t			nr_strings;
+	char			**strings2;
+	size_t			nr_strings2;
+
+	struct gen_word		*words;
+	size_t			nr_words;
+	unsigned		nr_nouns;
+	unsigned		first_noun;
+
+	uint8_t			room_dir[MAX_ROOMS + 1][NR_DIRECTIONS];
+	uint8_t			room_flags[MAX_ROOMS + 1];
+	uint8_t			room_graphic[MAX_ROOMS + 1];
+	uint16_t		room_desc[MAX_ROOMS + 1];
+
+	uint16_t		item_desc[MAX_ITEMS];
+	uint16_t		item_long_desc[MAX_ITEMS];
+	uint8_t			item_flags[MAX_ITEMS];
+	uint8_t			item_word[MAX_ITEMS];
+	uint8_t			item_room[MAX_ITEMS];
+	uint8_t			item_graphic[MAX_ITEMS];
+
+	struct gen_function	functions[MAX_FUNCTIONS];
+	size_t			nr_functions;
+	unsigned		move_function;
+	unsigned		first_noun_function;
+
+	struct gen_action	*actions;
+	size_t			nr_actions;
+
+	char			*replace_words[8];
+	size_t			nr_replace_words;
+
+	unsigned		nr_room_images;
+	unsigned		nr_item_images;
+};
+
+static void add_word(struct gen_game *g, const char *text, uint8_t index,
+		     uint8_t type)
+{
+	struct gen_word *word;
+
+	g->words = xrealloc(g->words, (g->nr_words + 1) * sizeof(*g->words));
+
+	word = &g->words[g->nr_words++];
+	memset(word, 0, sizeof(*word));
+	strncpy(word->word, text, 6);
+	word->index = index;
+	word->type = type;
+}
+
+static void gen_dictionary(struct gen_game *g)
+{
+	const struct gen_params *params = g->params;
+	char buf[32];
+	unsigned i, index;
+
+	for (i = 0; i < NR_DIRECTIONS; i++)
+		add_word(g, direction_words[i], i + 1, WORD_TYPE_VERB);
+	add_word(g, "n", DIRECTION_NORTH + 1, WORD_TYPE_VERB);
+	add_word(g, "s", DIRECTION_SOUTH + 1, WORD_TYPE_VERB);
+
+	for (i = 0; i < ARRAY_SIZE(verb_words); i++)
+		add_word(g, verb_words[i], VERB_GET + i, WORD_TYPE_VERB);
+	add_word(g, "take", VERB_GET, WORD_TYPE_VERB);
+	add_word(g, "i", VERB_INVENTORY, WORD_TYPE_VERB);
+	add_word(g, "putin", VERB_PUTIN, WORD_TYPE_VERB);
+	add_word(g, "pickup", VERB_PICKUP, WORD_TYPE_VERB);
+
+	for (i = 0; i < ARRAY_SIZE(join_words); i++)
+		add_word(g, join_words[i], i + 1, WORD_TYPE_JOIN);
+
+	/* One noun per pair of items, so that some nouns are ambiguous */
+	g->first_noun = 0x40;
+	g->nr_nouns = (params->nr_items + 1) / 2;
+	if (g->first_noun + g->nr_nouns > MAX_WORDS)
+		g->nr_nouns = MAX_WORDS - g->first_noun;
+	for (i = 0; i < g->nr_nouns; i++) {
+		static const uint8_t noun_types[] = {
+			WORD_TYPE_NOUN, WORD_TYPE_NOUN | WORD_TYPE_MALE,
+			WORD_TYPE_NOUN | WORD_TYPE_FEMALE,
+			WORD_TYPE_NOUN_PLURAL,
+		};
+
+		gen_word(buf, sizeof(buf), 2, 3);
+		add_word(g, buf, g->first_noun + i,
+			 noun_types[gen_rand() % ARRAY_SIZE(noun_types)]);
+	}
+
+	/* Filler verbs up to the requested dictionary size */
+	index = NR_FIXED_VERBS;
+	while (g->nr_words < params->nr_words && index < g->first_noun) {
+		gen_word(buf, sizeof(buf), 1, 3);
+		add_word(g, buf, index++, WORD_TYPE_VERB);
+	}
+}
+
+static uint16_t add_string(struct gen_game *g, const char *text)
+{
+	if (g->nr_strings >= MAX_STRINGS)
+		return gen_rand() % g->nr_strings;
+
+	g->strings = xrealloc(g->strings,
+			      (g->nr_strings + 1) * sizeof(*g->strings));
+	g->strings[g->nr_strings] = xstrndup(text, strlen(text));
+	return g->nr_strings++;
+}
+
+static void gen_strings(struct gen_game *g)
+{
+	static const char *fixed_strings[] = {
+		[STRING_CANT_GO]		= "You cant go that way.",
+		[STRING_DONT_UNDERSTAND]	= "I dont understand.",
+		[STRING_YOU_SEE]		= "You see:",
+		[STRING_INVENTORY]		= "You are carrying:",
+		[STRING_INVENTORY_EMPTY]	= "You arent carrying anything.",
+		[STRING_BEFORE_CONTINUE]	= "Before you can continue,",
+		[STRING_SAVE_GAME]		= "Save game (1-3)?",
+		[STRING_RESTORE_GAME]		= "Restore game (1-3)?",
+	};
+	char buf[256];
+	unsigned i;
+
+	for (i = 0; i < ARRAY_SIZE(fixed_strings); i++)
+		add_string(g, fixed_strings[i]);
+
+	while (g->nr_strings < g->params->nr_strings) {
+		switch (gen_rand() % 6) {
+		case 0:
+			/* Replacement word */
+			gen_sentence(buf, sizeof(buf), gen_rand_range(1, 4));
+			strcat(buf, " @ ");
+			gen_sentence(buf + strlen(buf), sizeof(buf) - strlen(buf),
+				     gen_rand_range(1, 4));
+			break;
+
+		case 1:
+			/* Multi-line with capitals and symbols */
+			gen_sentence(buf, sizeof(buf), gen_rand_range(2, 6));
+			buf[0] = buf[0] - 'a' + 'A';
+			strcat(buf, "!\n\"Who goes there?\" (42)");
+			break;
+
+		case 2:
+			/* Long line, for word wrapping */
+			gen_sentence(buf, sizeof(buf), gen_rand_range(20, 30));
+			break;
+
+		default:
+			gen_sentence(buf, sizeof(buf), gen_rand_range(1, 8));
+			buf[0] = buf[0] - 'a' + 'A';
+			strcat(buf, ".");
+			break;
+		}
+
+		add_string(g, buf);
+	}
+
+	/* Transylvania asks for the player's name using these */
+	if (g->params->layout->asks_name && g->nr_strings > 0x21) {
+		free(g->strings[0x20]);
+		g->strings[0x20] = xstrndup("Sign your name", 14);
+		free(g->strings[0x21]);
+		g->strings[0x21] = xstrndup("And your next of kin", 20);
+	}
+}
+
+static uint16_t random_string(struct gen_game *g)
+{
+	return gen_rand_range(STRING_SAVE_GAME + 1, g->nr_strings - 1);
+}
+
+static void gen_rooms_and_items(struct gen_game *g)
+{
+	const struct gen_params *params = g->params;
+	unsigned i, dir;
+
+	for (i = 1; i <= params->nr_rooms; i++) {
+		for (dir = 0; dir < NR_DIRECTIONS; dir++)
+			if (gen_chance(40))
+				g->room_dir[i][dir] =
+					gen_rand_range(1, params->nr_rooms);
+
+		g->room_flags[i] = gen_rand() & 0xff;
+		g->room_graphic[i] = gen_rand_range(1, g->nr_room_images);
+		g->room_desc[i] = random_string(g);
+	}
+
+	for (i = 0; i < params->nr_items; i++) {
+		g->item_desc[i] = gen_chance(90) ? random_string(g) : 0;
+		g->item_long_desc[i] = random_string(g);
+		g->item_flags[i] = gen_rand() & 0xff;
+		g->item_word[i] = g->first_noun + (i / 2) % g->nr_nouns;
+		g->item_graphic[i] = gen_chance(80) ?
+			gen_rand_range(1, g->nr_item_images) : 0;
+
+		switch (gen_rand() % 5) {
+		case 0:
+			g->item_room[i] = ROOM_NOWHERE;
+			break;
+		case 1:
+			g->item_room[i] = ROOM_INVENTORY;
+			break;
+		default:
+			g->item_room[i] = gen_rand_range(1, params->nr_rooms);
+			break;
+		}
+	}
+}
+
+static unsigned func_call_limit(struct gen_game *g, unsigned func_index)
+{
+	if (func_index < g->first_noun_function)
+		return g->first_noun_function - 1;
+	return g->nr_functions - 1;
+}
+
+static uint8_t gen_operand(struct gen_game *g, unsigned kind,
+			   unsigned func_index, uint8_t *operands,
+			   unsigned arg)
+{
+	const struct gen_params *params = g->params;
+	unsigned func;
+
+	switch (kind) {
+	case ARG_ITEM:
+		return gen_rand_range(1, params->nr_items);
+	case ARG_ROOM:
+		return gen_rand_range(1, params->nr_rooms);
+	case ARG_ROOM_ANY:
+		switch (gen_rand() % 4) {
+		case 0:
+			return ROOM_INVENTORY;
+		case 1:
+			return ROOM_NOWHERE;
+		default:
+			return gen_rand_range(1, params->nr_rooms);
+		}
+	case ARG_FLAG:
+		return gen_rand() % MAX_FLAGS;
+	case ARG_VAR:
+		/* Mostly the low variables, so that tests sometimes pass */
+		return gen_rand() % 16;
+	case ARG_MASK:
+		return 1 << (gen_rand() % 8);
+	case ARG_DIR:
+		return gen_rand_range(1, NR_DIRECTIONS);
+	case ARG_STR_INDEX:
+		return gen_rand() & 0xff;
+	case ARG_STR_TABLE:
+		if (gen_chance(25) && g->nr_strings2)
+			return gen_chance(50) ? 0x82 : 0x83;
+		/* Fall-through */
+	case ARG_STR_TABLE_MAIN:
+		if (g->nr_strings > 0x100 && gen_chance(50))
+			return 0x81;
+		return 0x80;
+	case ARG_REPLACE:
+		return gen_rand_range(1, g->nr_replace_words);
+	case ARG_GRAPHIC:
+		return gen_rand_range(1, g->nr_room_images);
+	case ARG_ITEM_GRAPHIC:
+		return gen_rand_range(1, g->nr_item_images);
+	case ARG_FUNC:
+		/*
+		 * Only call later functions so that calls are acyclic, and
+		 * functions without a current noun only call functions which
+		 * don't need one.
+		 */
+		func = gen_rand_range(func_index < FIRST_RANDOM_FUNCTION ?
+				      FIRST_RANDOM_FUNCTION : func_index + 1,
+				      func_call_limit(g, func_index));
+		operands[arg + 1] = func >= 0x100 ? 0x81 : 0x00;
+		return func & 0xff;
+	case ARG_FUNC_BANK:
+		return operands[arg];
+	case ARG_ANY:
+	default:
+		return gen_rand() & 0xff;
+	}
+}
+
+static void add_instruction(struct gen_function *func, uint8_t raw,
+			    const uint8_t *operands)
+{
+	struct gen_instruction *instr;
+
+	func->instructions = xrealloc(func->instructions,
+				      (func->nr_instructions + 1) *
+				      sizeof(*func->instructions));
+
+	instr = &func->instructions[func->nr_instructions++];
+	instr->raw = raw;
+	memset(instr->operand, 0, sizeof(instr->operand));
+	if (operands)
+		memcpy(instr->operand, operands, raw & 0x3);
+}
+
+static bool gen_opcode_usable(struct gen_game *g, struct gen_opcode *op,
+			      unsigned func_index, bool have_noun, bool test)
+{
+	uint8_t raw = op->raw[g->version - 1];
+
+	if (!raw)
+		return false;
+	if (!!(op->flags & OPF_TEST) != test)
+		return false;
+	if ((op->flags & OPF_NEEDS_NOUN) && !have_noun)
+		return false;
+	if (op->flags & OPF_NEEDS_DIR_VERB)
+		return false;
+	if (op->opcode == OPCODE_CALL_FUNC &&
+	    (func_index < FIRST_RANDOM_FUNCTION ? FIRST_RANDOM_FUNCTION :
+	     func_index + 1) > func_call_limit(g, func_index))
+		return false;
+	if ((op->flags & OPF_RARE) && !gen_chance(10))
+		return false;
+
+	return true;
+}
+
+static void gen_random_instruction(struct gen_game *g, struct gen_function *func,
+				   unsigned func_index, bool have_noun,
+				   bool test)
+{
+	struct gen_opcode *op;
+	uint8_t operands[4] = {0};
+	unsigned arg;
+	uint8_t raw;
+
+	do {
+		op = &gen_opcodes[gen_rand() % ARRAY_SIZE(gen_opcodes)];
+	} while (!gen_opcode_usable(g, op, func_index, have_noun, test));
+
+	/* Calls are made less often to keep call trees shallow */
+	if (op->opcode == OPCODE_CALL_FUNC && gen_chance(50))
+		op = &gen_opcodes[0];
+
+	raw = op->raw[g->version - 1];
+	for (arg = 0; arg < 3; arg++)
+		operands[arg] = gen_operand(g, op->args[arg], func_index,
+					    operands, arg);
+
+	add_instruction(func, raw, operands);
+}
+
+static void gen_special(struct gen_game *g, struct gen_function *func,
+			uint8_t special)
+{
+	uint8_t raw = g->version == 1 ? RAW_OPCODE_SPECIAL_V1 :
+		RAW_OPCODE_SPECIAL_V2;
+
+	/* Both special opcodes take a single operand */
+	add_instruction(func, raw, &special);
+}
+
+static void gen_function_body(struct gen_game *g, unsigned func_index,
+			      bool have_noun)
+{
+	struct gen_function *func = &g->functions[func_index];
+	unsigned nr_blocks, block, i, n;
+	uint8_t operands[3];
+
+	nr_blocks = gen_rand_range(1, 4);
+	for (block = 0; block < nr_blocks; block++) {
+		/* Test sequence */
+		n = gen_rand_range(block == 0 ? 0 : 1, 3);
+		if (n >= 2 && gen_chance(30))
+			add_instruction(func, RAW_OPCODE_OR, NULL);
+		for (i = 0; i < n; i++)
+			gen_random_instruction(g, func, func_index,
+					       have_noun, true);
+		if (gen_chance(5))
+			add_instruction(func, RAW_OPCODE_UNKNOWN_TEST, NULL);
+
+		/* Command sequence */
+		n = gen_rand_range(1, 4);
+		for (i = 0; i < n; i++)
+			gen_random_instruction(g, func, func_index,
+					       have_noun, false);
+		if (gen_chance(5))
+			add_instruction(func, RAW_OPCODE_UNKNOWN_CMD, NULL);
+
+		/* Optional else branch */
+		if (gen_chance(20)) {
+			add_instruction(func, RAW_OPCODE_ELSE, NULL);
+			operands[0] = random_string(g) & 0xff;
+			operands[1] = 0x80;
+			add_instruction(func, 0x8e, operands);
+		}
+	}
+}
+
+static void gen_functions(struct gen_game *g)
+{
+	const struct gen_params *params = g->params;
+	struct gen_function *func;
+	uint8_t operands[3];
+	unsigned i;
+
+	g->nr_functions = params->nr_functions;
+	g->first_noun_function = FIRST_RANDOM_FUNCTION +
+		(g->nr_functions - FIRST_RANDOM_FUNCTION) / 2;
+
+	/* Function 0 runs every turn */
+	func = &g->functions[0];
+	add_instruction(func, 0x98, NULL);
+	gen_function_body(g, 0, false);
+
+	/* Movement in the direction of the current verb */
+	g->move_function = 1;
+	func = &g->functions[g->move_function];
+	add_instruction(func, 0x8c, NULL);
+
+	/* Save, restore and restart */
+	gen_special(g, &g->functions[2], params->layout->special_save);
+	gen_special(g, &g->functions[3], params->layout->special_restore);
+	if (params->layout->special_restart)
+		gen_special(g, &g->functions[4],
+			    params->layout->special_restart);
+	else
+		add_instruction(&g->functions[4], 0x98, NULL);
+
+	/* Get and drop for the noun actions */
+	func = &g->functions[5];
+	add_instruction(func, g->version == 1 ? 0x24 : 0x30, NULL);
+	add_instruction(func, 0xa0, NULL);
+	operands[0] = 0x10;
+	operands[1] = 0x80;
+	add_instruction(func, 0x8e, operands);
+
+	func = &g->functions[6];
+	add_instruction(func, 0x20, NULL);
+	add_instruction(func, g->version == 1 ? 0xa4 : 0xf0, NULL);
+
+	/* The rest are random, the second half may use the current noun */
+	for (i = FIRST_RANDOM_FUNCTION; i < g->nr_functions; i++)
+		gen_function_body(g, i, i >= g->first_noun_function);
+}
+
+static void add_action(struct gen_game *g, unsigned type, uint8_t w0,
+		       uint8_t w1, uint8_t w2, uint8_t w3, uint16_t function)
+{
+	struct gen_action *action;
+
+	g->actions = xrealloc(g->actions,
+			      (g->nr_actions + 1) * sizeof(*g->actions));
+
+	action = &g->actions[g->nr_actions++];
+	action->type = type;
+	action->word[0] = w0;
+	action->word[1] = w1;
+	action->word[2] = w2;
+	action->word[3] = w3;
+	action->function = function;
+}
+
+static unsigned random_noun(struct gen_game *g)
+{
+	return g->first_noun + gen_rand() % g->nr_nouns;
+}
+
+static unsigned random_verb(struct gen_game *g)
+{
+	return gen_rand_range(VERB_LOOK, VERB_WAIT);
+}
+
+static unsigned random_generic_function(struct gen_game *g)
+{
+	return gen_rand_range(FIRST_RANDOM_FUNCTION,
+			      g->first_noun_function - 1);
+}
+
+static unsigned random_noun_function(struct gen_game *g)
+{
+	return gen_rand_range(g->first_noun_function, g->nr_functions - 1);
+}
+
+static void gen_actions(struct gen_game *g)
+{
+	unsigned i, noun, nr_nouns;
+
+	/* Verb + noun */
+	nr_nouns = g->nr_nouns;
+	for (i = 0; i < nr_nouns; i++) {
+		noun = g->first_noun + i;
+		add_action(g, ACTION_VERB_NOUN, VERB_GET, noun, 0, 0, 5);
+		add_action(g, ACTION_VERB_NOUN, VERB_PICKUP, noun, 0, 0, 5);
+		add_action(g, ACTION_VERB_NOUN, VERB_DROP, noun, 0, 0, 6);
+		add_action(g, ACTION_VERB_NOUN, random_verb(g), noun, 0, 0,
+			   random_noun_function(g));
+	}
+
+	/* Verb + join + noun */
+	for (i = 0; i < nr_nouns / 2; i++)
+		add_action(g, ACTION_VERB_JOIN_NOUN, VERB_LOOK,
+			   gen_rand_range(1, ARRAY_SIZE(join_words)),
+			   random_noun(g), 0, random_generic_function(g));
+
+	/* Verb + noun + join + noun */
+	for (i = 0; i < nr_nouns / 2; i++)
+		add_action(g, ACTION_VERB_NOUN_JOIN_NOUN, VERB_PUT,
+			   random_noun(g), 1, random_noun(g),
+			   random_noun_function(g));
+
+	if (g->version == 1) {
+		/* Verb + verb + noun + noun, and verb + dir + noun */
+		for (i = 0; i < nr_nouns / 4; i++)
+			add_action(g, ACTION_VERB_VERB_NOUN_NOUN, VERB_THROW,
+				   VERB_EAT, random_noun(g), random_noun(g),
+				   random_generic_function(g));
+		for (i = 0; i < nr_nouns / 4; i++)
+			add_action(g, ACTION_VERB_DIR_NOUN, VERB_PUSH,
+				   gen_rand_range(1, NR_DIRECTIONS),
+				   random_noun(g), 0,
+				   random_generic_function(g));
+	} else {
+		/* Verb + noun + noun */
+		for (i = 0; i < nr_nouns / 2; i++)
+			add_action(g, ACTION_VERB_NOUN_NOUN, VERB_PUTIN,
+				   random_noun(g), random_noun(g), 0,
+				   random_noun_function(g));
+	}
+
+	/* Verb with optional noun */
+	for (i = 1; i <= NR_DIRECTIONS; i++)
+		add_action(g, ACTION_VERB_OPT_NOUN, i, 0, 0, 0,
+			   g->move_function);
+	add_action(g, ACTION_VERB_OPT_NOUN, VERB_SAVE, 0, 0, 0, 2);
+	add_action(g, ACTION_VERB_OPT_NOUN, VERB_LOAD, 0, 0, 0, 3);
+	add_action(g, ACTION_VERB_OPT_NOUN, VERB_RESTART, 0, 0, 0, 4);
+	for (i = VERB_GET; i < NR_FIXED_VERBS; i++)
+		if (i != VERB_SAVE && i != VERB_LOAD && i != VERB_RESTART)
+			add_action(g, ACTION_VERB_OPT_NOUN, i, 0, 0, 0,
+				   random_generic_function(g));
+}
+
+static void gen_replace_words(struct gen_game *g)
+{
+	static const char *words[] = {
+		"XXXXXXXXXXXX", "him", "it", "them", "the thing",
+	};
+	unsigned i;
+
+	for (i = 0; i < ARRAY_SIZE(words); i++)
+		g->replace_words[i] = xstrndup(words[i], strlen(words[i]));
+	g->nr_replace_words = ARRAY_SIZE(words);
+}
+
+/*
+ * File writers
+ */
+static uint16_t header_addr(struct gen_game *g, size_t pos)
+{
+	/* Inverse of the magic offset applied by parse_header() */
+	if (g->version == 1)
+		return pos + 0x5a00 - 0x4;
+	return pos + 0x5a00;
+}
+
+static void patch_addr(struct gen_game *g, struct out_buf *out,
+		       size_t header_pos, size_t pos)
+{
+	if (pos > 0xffff)
+		fatal_error("Game data file too large (%zx)", pos);
+	out_patch_le16(out, header_pos, header_addr(g, pos));
+}
+
+static void write_action_tables(struct gen_game *g, struct out_buf *out,
+				unsigned type, size_t header_pos)
+{
+	struct gen_action *action;
+	uint8_t key;
+	unsigned i, j, count;
+	bool done[256] = {false};
+
+	patch_addr(g, out, header_pos, out->size);
+
+	/*
+	 * Actions are grouped by their first word (the verb, or the join word
+	 * for the join tables). Groups are written in order of first
+	 * appearance.
+	 */
+	for (i = 0; i < g->nr_actions; i++) {
+		action = &g->actions[i];
+		if (action->type != type)
+			continue;
+
+		switch (type) {
+		case ACTION_VERB_NOUN_JOIN_NOUN:
+			key = action->word[2];
+			break;
+		case ACTION_VERB_JOIN_NOUN:
+			key = action->word[1];
+			break;
+		default:
+			key = action->word[0];
+			break;
+		}
+
+		if (done[key])
+			continue;
+		done[key] = true;
+
+		count = 0;
+		for (j = i; j < g->nr_actions; j++)
+			if (g->actions[j].type == type &&
+			    ((type == ACTION_VERB_NOUN_JOIN_NOUN &&
+			      g->actions[j].word[2] == key) ||
+			     (type == ACTION_VERB_JOIN_NOUN &&
+			      g->actions[j].word[1] == key) ||
+			     (type != ACTION_VERB_NOUN_JOIN_NOUN &&
+			      type != ACTION_VERB_JOIN_NOUN &&
+			      g->actions[j].word[0] == key)))
+				count++;
+
+		out_put_u8(out, key);
+		if (type != ACTION_VERB_OPT_NOUN)
+			out_put_u8(out, count);
+
+		for (j = i; j < g->nr_actions; j++) {
+			struct gen_action *a = &g->actions[j];
+
+			if (a->type != type)
+				continue;
+
+			switch (type) {
+			case ACTION_VERB_VERB_NOUN_NOUN:
+				if (a->word[0] != key)
+					continue;
+				out_put_u8(out, a->word[1]);
+				out_put_u8(out, a->word[2]);
+				out_put_u8(out, a->word[3]);
+				break;
+			case ACTION_VERB_NOUN_JOIN_NOUN:
+				if (a->word[2] != key)
+					continue;
+				out_put_u8(out, a->word[0]);
+				out_put_u8(out, a->word[1]);
+				out_put_u8(out, a->word[3]);
+				break;
+			case ACTION_VERB_JOIN_NOUN:
+				if (a->word[1] != key)
+					continue;
+				out_put_u8(out, a->word[0]);
+				out_put_u8(out, a->word[2]);
+				break;
+			case ACTION_VERB_DIR_NOUN:
+			case ACTION_VERB_NOUN_NOUN:
+				if (a->word[0] != key)
+					continue;
+				out_put_u8(out, a->word[1]);
+				out_put_u8(out, a->word[2]);
+				break;
+			case ACTION_VERB_NOUN:
+				if (a->word[0] != key)
+					continue;
+				out_put_u8(out, a->word[1]);
+				break;
+			case ACTION_VERB_OPT_NOUN:
+				if (a->word[0] != key)
+					continue;
+				/* Count of functions, only the first is used */
+				out_put_u8(out, 1);
+				break;
+			}
+
+			out_put_le16(out, a->function);
+			if (type == ACTION_VERB_OPT_NOUN)
+				break;
+		}
+	}
+
+	out_put_u8(out, 0);
+}
+
+static void write_game_data(struct gen_game *g)
+{
+	const struct gen_params *params = g->params;
+	struct out_buf out = {0};
+	size_t h_actions_vvnn = 0, h_actions_vnjn, h_actions_vjn,
+		h_actions_vdn = 0, h_actions_vnn = 0, h_actions_vn,
+		h_actions_v, h_vm, h_dictionary, h_word_map,
+		h_room_desc, h_room_dir, h_room_flags, h_room_graphics,
+		h_item_locations, h_item_flags, h_item_word, h_item_strings,
+		h_item_graphics, h_strings, h_strings_end, pos;
+	unsigned nr_rooms = params->nr_rooms, nr_items = params->nr_items;
+	unsigned i, j, dir;
+
+	/* Header */
+	out_put_le16(&out, g->version == 1 ? 0x2000 : 0x93f0);
+	out_put_le16(&out, 0);
+
+	if (g->version == 1) {
+		h_actions_vvnn = out.size;
+		out_put_le16(&out, 0);
+		out_put_le16(&out, 0);
+		h_actions_vnjn = out.size;
+		out_put_le16(&out, 0);
+		h_actions_vjn = out.size;
+		out_put_le16(&out, 0);
+		h_actions_vdn = out.size;
+		out_put_le16(&out, 0);
+	} else {
+		h_actions_vnjn = out.size;
+		out_put_le16(&out, 0);
+		h_actions_vjn = out.size;
+		out_put_le16(&out, 0);
+		h_actions_vnn = out.size;
+		out_put_le16(&out, 0);
+	}
+	h_actions_vn = out.size;
+	out_put_le16(&out, 0);
+	h_actions_v = out.size;
+	out_put_le16(&out, 0);
+	h_vm = out.size;
+	out_put_le16(&out, 0);
+	h_dictionary = out.size;
+	out_put_le16(&out, 0);
+	h_word_map = out.size;
+	out_put_le16(&out, 0);
+	out_put_le16(&out, 0);
+
+	h_room_desc = out.size;
+	out_put_le16(&out, 0);
+	h_room_dir = out.size;
+	for (dir = 0; dir < NR_DIRECTIONS; dir++)
+		out_put_le16(&out, 0);
+	h_room_flags = out.size;
+	out_put_le16(&out, 0);
+	h_room_graphics = out.size;
+	out_put_le16(&out, 0);
+
+	if (g->version == 1) {
+		h_item_locations = out.size;
+		out_put_le16(&out, 0);
+		h_item_flags = out.size;
+		out_put_le16(&out, 0);
+		h_item_word = out.size;
+		out_put_le16(&out, 0);
+		h_item_strings = out.size;
+		out_put_le16(&out, 0);
+		h_item_graphics = out.size;
+		out_put_le16(&out, 0);
+	} else {
+		h_item_strings = out.size;
+		out_put_le16(&out, 0);
+		h_item_word = out.size;
+		out_put_le16(&out, 0);
+		h_item_locations = out.size;
+		out_put_le16(&out, 0);
+		h_item_flags = out.size;
+		out_put_le16(&out, 0);
+		h_item_graphics = out.size;
+		out_put_le16(&out, 0);
+	}
+
+	h_strings = out.size;
+	out_put_le16(&out, 0);
+	out_put_le16(&out, 0);
+	h_strings_end = out.size;
+	out_put_le16(&out, 0);
+
+	/* Start room */
+	out_put_u8(&out, 0);
+	out_put_u8(&out, 1);
+	out_put_u8(&out, 0);
+
+	/* Variables (inventory limit is variable 1) */
+	for (i = 0; i < MAX_VARIABLES; i++) {
+		if (i == VAR_INVENTORY_LIMIT)
+			out_put_le16(&out, 10);
+		else if (i < 16)
+			out_put_le16(&out, gen_rand() % 4);
+		else
+			out_put_le16(&out, 0);
+	}
+
+	/* Flags */
+	for (i = 0; i < MAX_FLAGS / 8; i++)
+		out_put_u8(&out, gen_rand() & 0xff);
+
+	/* Rooms - the tables are indexed from room 1 */
+	for (dir = 0; dir < NR_DIRECTIONS; dir++) {
+		patch_addr(g, &out, h_room_dir + dir * 2, out.size);
+		for (i = 1; i <= nr_rooms; i++)
+			out_put_u8(&out, g->room_dir[i][dir]);
+	}
+	patch_addr(g, &out, h_room_desc, out.size);
+	for (i = 1; i <= nr_rooms; i++)
+		out_put_le16(&out, g->room_desc[i]);
+	patch_addr(g, &out, h_room_flags, out.size);
+	for (i = 1; i <= nr_rooms; i++)
+		out_put_u8(&out, g->room_flags[i]);
+	patch_addr(g, &out, h_room_graphics, out.size);
+	for (i = 1; i <= nr_rooms; i++)
+		out_put_u8(&out, g->room_graphic[i]);
+
+	/*
+	 * Items. The item count is derived from the distance between two of
+	 * the tables, which differ between versions.
+	 */
+	patch_addr(g, &out, h_item_strings, out.size);
+	for (i = 0; i < nr_items; i++)
+		out_put_le16(&out, g->item_desc[i]);
+	if (g->version == 2)
+		for (i = 0; i < nr_items; i++)
+			out_put_le16(&out, g->item_long_desc[i]);
+
+	if (g->version == 1) {
+		patch_addr(g, &out, h_item_locations, out.size);
+		for (i = 0; i < nr_items; i++)
+			out_put_u8(&out, g->item_room[i]);
+		patch_addr(g, &out, h_item_flags, out.size);
+		for (i = 0; i < nr_items; i++)
+			out_put_u8(&out, g->item_flags[i]);
+		patch_addr(g, &out, h_item_word, out.size);
+		for (i = 0; i < nr_items; i++)
+			out_put_u8(&out, g->item_word[i]);
+	} else {
+		patch_addr(g, &out, h_item_word, out.size);
+		for (i = 0; i < nr_items; i++)
+			out_put_u8(&out, g->item_word[i]);
+		patch_addr(g, &out, h_item_locations, out.size);
+		for (i = 0; i < nr_items; i++)
+			out_put_u8(&out, g->item_room[i]);
+		patch_addr(g, &out, h_item_flags, out.size);
+		for (i = 0; i < nr_items; i++)
+			out_put_u8(&out, g->item_flags[i]);
+	}
+	patch_addr(g, &out, h_item_graphics, out.size);
+	for (i = 0; i < nr_items; i++)
+		out_put_u8(&out, g->item_graphic[i]);
+
+	/* Dictionary, the word map must immediately follow it */
+	patch_addr(g, &out, h_dictionary, out.size);
+	for (i = 0; i < g->nr_words; i++) {
+		for (j = 0; j < 6; j++)
+			out_put_u8(&out, g->words[i].word[j] ^ 0x8a);
+		out_put_u8(&out, g->words[i].index);
+		out_put_u8(&out, g->words[i].type);
+	}
+
+	/* Word pairs: "go <dir>" -> "<dir>", "pick up" and "put in" */
+	patch_addr(g, &out, h_word_map, out.size);
+	for (dir = 0; dir < NR_DIRECTIONS; dir++) {
+		out_put_u8(&out, VERB_GO);
+		out_put_u8(&out, WORD_TYPE_VERB);
+		out_put_u8(&out, 0);
+		out_put_u8(&out, dir + 1);
+		out_put_u8(&out, WORD_TYPE_VERB);
+	}
+	out_put_u8(&out, VERB_PICK);
+	out_put_u8(&out, WORD_TYPE_VERB);
+	out_put_u8(&out, 0);
+	out_put_u8(&out, DIRECTION_UP + 1);
+	out_put_u8(&out, WORD_TYPE_VERB);
+	out_put_u8(&out, VERB_PUT);
+	out_put_u8(&out, WORD_TYPE_VERB);
+	out_put_u8(&out, 0);
+	out_put_u8(&out, 1);
+	out_put_u8(&out, WORD_TYPE_JOIN);
+	for (i = 0; i < 4; i++)
+		out_put_u8(&out, 0);
+	for (dir = 0; dir < NR_DIRECTIONS; dir++) {
+		out_put_u8(&out, dir + 1);
+		out_put_u8(&out, WORD_TYPE_VERB);
+	}
+	out_put_u8(&out, VERB_PICKUP);
+	out_put_u8(&out, WORD_TYPE_VERB);
+	out_put_u8(&out, VERB_PUTIN);
+	out_put_u8(&out, WORD_TYPE_VERB);
+
+	/* Action tables */
+	if (g->version == 1) {
+		write_action_tables(g, &out, ACTION_VERB_VERB_NOUN_NOUN,
+				    h_actions_vvnn);
+		write_action_tables(g, &out, ACTION_VERB_DIR_NOUN,
+				    h_actions_vdn);
+	} else {
+		write_action_tables(g, &out, ACTION_VERB_NOUN_NOUN,
+				    h_actions_vnn);
+	}
+	write_action_tables(g, &out, ACTION_VERB_NOUN_JOIN_NOUN,
+			    h_actions_vnjn);
+	write_action_tables(g, &out, ACTION_VERB_JOIN_NOUN, h_actions_vjn);
+	write_action_tables(g, &out, ACTION_VERB_NOUN, h_actions_vn);
+	write_action_tables(g, &out, ACTION_VERB_OPT_NOUN, h_actions_v);
+
+	/* Functions, terminated by an empty function */
+	patch_addr(g, &out, h_vm, out.size);
+	for (i = 0; i < g->nr_functions; i++) {
+		struct gen_function *func = &g->functions[i];
+
+		for (j = 0; j < func->nr_instructions; j++) {
+			struct gen_instruction *instr = &func->instructions[j];
+
+			out_put_u8(&out, instr->raw);
+			out_put_data(&out, instr->operand, instr->raw & 0x3);
+		}
+		out_put_u8(&out, 0);
+	}
+	out_put_u8(&out, 0);
+
+	/* Main string table */
+	patch_addr(g, &out, h_strings, out.size);
+	for (i = 0; i < g->nr_strings; i++)
+		out_put_string(&out, g->strings[i]);
+
+	/* Replacement words follow the string table */
+	pos = out.size;
+	patch_addr(g, &out, h_strings_end, pos);
+	out_put_le16(&out, 0);
+	for (i = 0; i < g->nr_replace_words; i++)
+		out_put_data(&out, g->replace_words[i],
+			     strlen(g->replace_words[i]) + 1);
+	out_put_u8(&out, 0);
+
+	out_write(&out, params, params->layout->game_data_file);
+	out_free(&out);
+}
+
+/*
+ * Fill a string file region with packed strings. The parser reads strings
+ * until it reaches the end of the region, so the last string is sized to
+ * end exactly on the boundary.
+ */
+static void write_string_region(struct gen_game *g, struct out_buf *out,
+				size_t start, size_t end, unsigned nr_strings)
+{
+	char buf[256], filler[1600];
+	size_t remaining, nr_chars;
+	unsigned i;
+
+	out_pad_to(out, start);
+	for (i = 0; i < nr_strings; i++) {
+		gen_sentence(buf, sizeof(buf), gen_rand_range(2, 8));
+		buf[0] = buf[0] - 'a' + 'A';
+		strcat(buf, ".");
+		if (end && out->size + 2 * strlen(buf) + 64 >= end)
+			break;
+		out_put_string(out, buf);
+		g->nr_strings2++;
+	}
+
+	if (!end)
+		return;
+
+	/* 'x' ends in a set bit, so the last byte is never zero */
+	while (1) {
+		remaining = end - out->size - 1;
+		for (nr_chars = 1; (nr_chars * 5 + 7) / 8 < remaining &&
+			     nr_chars < 1000; nr_chars++)
+			;
+		if (nr_chars == 1000 && remaining > 700)
+			nr_chars = 800;
+		if (nr_chars >= sizeof(filler))
+			fatal_error("Cannot fill string region");
+		memset(filler, 'x', nr_chars);
+		filler[nr_chars] = '\0';
+		out_put_string(out, filler);
+		g->nr_strings2++;
+		if (out->size >= end)
+			break;
+	}
+	if (out->size != end)
+		fatal_error("Cannot fill string region");
+}
+
+static void write_string_files(struct gen_game *g)
+{
+	struct gen_layout *layout = g->params->layout;
+	struct out_buf out = {0};
+	unsigned i;
+
+	for (i = 0; i < ARRAY_SIZE(layout->string_files); i++) {
+		if (!layout->string_files[i])
+			break;
+
+		write_string_region(g, &out, layout->string_base[i],
+				    layout->string_end[i],
+				    layout->string_end[i] ?
+				    STRINGS_PER_FILE / 2 : STRINGS_PER_FILE - 2);
+
+		/* Files shared between regions are written once at the end */
+		if (i + 1 < ARRAY_SIZE(layout->string_files) &&
+		    layout->string_files[i + 1] &&
+		    strcmp(layout->string_files[i],
+			   layout->string_files[i + 1]) == 0)
+			continue;
+
+		out_write(&out, g->params, layout->string_files[i]);
+		out_free(&out);
+	}
+}
+
+static void put_image_op(struct out_buf *out, uint8_t opcode, unsigned x,
+			 unsigned y)
+{
+	if (x > 255) {
+		opcode |= 0x1;
+		x -= 255;
+	}
+	out_put_u8(out, opcode);
+	out_put_u8(out, x);
+	out_put_u8(out, y);
+}
+
+static void write_image(struct out_buf *out)
+{
+	unsigned i, n, x, y;
+
+	out_put_u8(out, IMAGE_OP_FILL_COLOR);
+	out_put_u8(out, gen_rand() % 0x70);
+	out_put_u8(out, IMAGE_OP_PEN_COLOR_A + gen_rand() % 8);
+
+	n = gen_rand_range(4, 24);
+	for (i = 0; i < n; i++) {
+		x = gen_rand_range(0, 277);
+		y = gen_rand_range(0, 161);
+
+		switch (gen_rand() % 8) {
+		case 0:
+			put_image_op(out, IMAGE_OP_MOVE_TO, x, y);
+			break;
+		case 1:
+		case 2:
+			put_image_op(out, IMAGE_OP_DRAW_LINE, x, y);
+			break;
+		case 3:
+			put_image_op(out, IMAGE_OP_DRAW_BOX, x, y);
+			break;
+		case 4:
+			out_put_u8(out, IMAGE_OP_SHAPE_PIXEL + gen_rand() % 8);
+			put_image_op(out, IMAGE_OP_DRAW_SHAPE, x, y);
+			break;
+		case 5:
+			out_put_u8(out, IMAGE_OP_FILL_COLOR);
+			out_put_u8(out, gen_rand() % 0x70);
+			put_image_op(out, IMAGE_OP_PAINT, x, y);
+			break;
+		case 6:
+			out_put_u8(out, IMAGE_OP_SET_TEXT_POS);
+			out_put_u8(out, x);
+			out_put_u8(out, y);
+			out_put_u8(out, IMAGE_OP_DRAW_CHAR);
+			out_put_u8(out, 'A' + gen_rand() % 26);
+			break;
+		default:
+			out_put_u8(out, IMAGE_OP_PEN_COLOR_A + gen_rand() % 8);
+			break;
+		}
+	}
+
+	out_put_u8(out, IMAGE_OP_SCENE_END);
+}
+
+static void write_image_file(struct gen_game *g, const char *filename)
+{
+	struct out_buf out = {0};
+	size_t base = 0;
+	unsigned i;
+
+	/*
+	 * Version 1 image files start with 0x1000 and the offsets are four
+	 * bytes in, relative to the end of that header.
+	 */
+	if (g->version == 1) {
+		out_put_le16(&out, 0x1000);
+		out_put_le16(&out, 0);
+		base = 4;
+	}
+
+	for (i = 0; i < IMAGES_PER_FILE; i++)
+		out_put_le16(&out, 0);
+
+	for (i = 0; i < IMAGES_PER_FILE; i++) {
+		out_patch_le16(&out, base + i * 2, out.size - base);
+		write_image(&out);
+	}
+	out_put_u8(&out, IMAGE_OP_EOF);
+
+	out_write(&out, g->params, filename);
+	out_free(&out);
+}
+
+static unsigned count_files(const char **files, size_t max)
+{
+	unsigned count;
+
+	for (count = 0; count < max && files[count]; count++)
+		;
+	return count;
+}
+
+static void write_image_files(struct gen_game *g)
+{
+	struct gen_layout *layout = g->params->layout;
+	unsigned i;
+
+	for (i = 0; i < ARRAY_SIZE(layout->room_image_files); i++)
+		if (layout->room_image_files[i])
+			write_image_file(g, layout->room_image_files[i]);
+	for (i = 0; i < ARRAY_SIZE(layout->item_image_files); i++)
+		if (layout->item_image_files[i])
+			write_image_file(g, layout->item_image_files[i]);
+}
+
+static const char *word_for_index(struct gen_game *g, uint8_t index,
+				  uint8_t type_mask)
+{
+	unsigned i;
+
+	for (i = 0; i < g->nr_words; i++)
+		if (g->words[i].index == index &&
+		    (g->words[i].type & type_mask))
+			return g->words[i].word;
+	return "xyzzy";
+}
+
+/*
+ * Write a command script. Commands are random but biased towards sentences
+ * which match actions, so that most turns run game functions.
+ */
+static void write_script(struct gen_game *g)
+{
+	const struct gen_params *params = g->params;
+	struct gen_action *action;
+	char path[PATH_MAX];
+	unsigned i, j, n;
+	FILE *fd;
+
+	snprintf(path, sizeof(path), "%s/commands.txt", params->out_dir);
+	fd = fopen(path, "w");
+	if (!fd)
+		fatal_strerror(errno, "Cannot create '%s'", path);
+
+	if (params->layout->asks_name) {
+		fprintf(fd, "Tester\n");
+		fprintf(fd, "Nobody\n");
+	}
+
+	for (i = 0; i < params->nr_commands; i++) {
+		switch (gen_rand() % 12) {
+		case 0:
+			fprintf(fd, "go %s\n",
+				direction_words[gen_rand() % NR_DIRECTIONS]);
+			break;
+
+		case 1:
+			fprintf(fd, "%s, %s\n",
+				direction_words[gen_rand() % NR_DIRECTIONS],
+				direction_words[gen_rand() % NR_DIRECTIONS]);
+			break;
+
+		case 2:
+			fprintf(fd, "pick up %s\n",
+				word_for_index(g, random_noun(g),
+					       WORD_TYPE_NOUN_MASK));
+			break;
+
+		case 3:
+			fprintf(fd, "%s\n", gen_chance(50) ? "i" : "look");
+			break;
+
+		case 4:
+			/* Unknown words and prefix matches */
+			fprintf(fd, "%s xyzzy\n", gen_chance(50) ?
+				"examine" : "frobnicate");
+			break;
+
+		case 5:
+			if (gen_chance(20)) {
+				fprintf(fd, "!dump state\n");
+				break;
+			}
+			/* Fall-through */
+		default:
+			action = &g->actions[gen_rand() % g->nr_actions];
+			n = action->type == ACTION_VERB_VERB_NOUN_NOUN ||
+				action->type == ACTION_VERB_NOUN_JOIN_NOUN ? 4 :
+				action->type == ACTION_VERB_NOUN ? 2 :
+				action->type == ACTION_VERB_OPT_NOUN ? 1 : 3;
+
+			/* Save, restore and restart need an answer */
+			if (action->type == ACTION_VERB_OPT_NOUN &&
+			    (action->word[0] == VERB_SAVE ||
+			     action->word[0] == VERB_LOAD)) {
+				fprintf(fd, "%s\n2\n", verb_words[action->word[0] -
+								  VERB_GET]);
+				break;
+			}
+			if (action->type == ACTION_VERB_OPT_NOUN &&
+			    action->word[0] == VERB_RESTART) {
+				if (gen_chance(80))
+					break;
+				fprintf(fd, "restart\n\n");
+				break;
+			}
+
+			for (j = 0; j < n; j++) {
+				uint8_t mask;
+
+				switch (action->type) {
+				case ACTION_VERB_NOUN_JOIN_NOUN:
+					mask = j == 0 ? WORD_TYPE_VERB :
+						j == 2 ? WORD_TYPE_JOIN :
+						WORD_TYPE_NOUN_MASK;
+					break;
+				case ACTION_VERB_JOIN_NOUN:
+					mask = j == 0 ? WORD_TYPE_VERB :
+						j == 1 ? WORD_TYPE_JOIN :
+						WORD_TYPE_NOUN_MASK;
+					break;
+				case ACTION_VERB_VERB_NOUN_NOUN:
+				case ACTION_VERB_DIR_NOUN:
+					mask = j < 2 ? WORD_TYPE_VERB :
+						WORD_TYPE_NOUN_MASK;
+					break;
+				default:
+					mask = j == 0 ? WORD_TYPE_VERB :
+						WORD_TYPE_NOUN_MASK;
+					break;
+				}
+
+				fprintf(fd, "%s%s", j ? " " : "",
+					word_for_index(g, action->word[j], mask));
+			}
+			fprintf(fd, "\n");
+			break;
+		}
+	}
+
+	fprintf(fd, "!quit\n");
+	fclose(fd);
+}
+
+static void usage(const char *progname)
+{
+	int i;
+
+	printf("Usage: %s [OPTION]... OUTPUT_DIR\n", progname);
+	printf("\nOptions:\n");
+	printf("  -l, --layout=GAME     Game file layout (default tr)\n");
+	printf("  -r, --rooms=N         Number of rooms\n");
+	printf("  -i, --items=N         Number of items\n");
+	printf("  -w, --words=N         Number of dictionary words\n");
+	printf("  -s, --strings=N       Number of strings\n");
+	printf("  -f, --functions=N     Number of functions\n");
+	printf("  -c, --commands=N      Number of commands in the script\n");
+	printf("  -S, --seed=N          Random seed\n");
+
+	printf("\nLayouts:\n");
+	for (i = 0; i < ARRAY_SIZE(layouts); i++)
+		printf("    %-10s version %d\n", layouts[i].short_name,
+		       layouts[i].version);
+
+	exit(EXIT_FAILURE);
+}
+
+static unsigned parse_count(const char *arg, unsigned min, unsigned max)
+{
+	unsigned long val;
+
+	val = strtoul(arg, NULL, 0);
+	if (val < min || val > max)
+		fatal_error("Value %s out of range (%u - %u)", arg, min, max);
+	return val;
+}
+
+int main(int argc, char **argv)
+{
+	struct option long_opts[] = {
+		{"layout",	required_argument,	0, 'l'},
+		{"rooms",	required_argument,	0, 'r'},
+		{"items",	required_argument,	0, 'i'},
+		{"words",	required_argument,	0, 'w'},
+		{"strings",	required_argument,	0, 's'},
+		{"functions",	required_argument,	0, 'f'},
+		{"commands",	required_argument,	0, 'c'},
+		{"seed",	required_argument,	0, 'S'},
+		{"help",	no_argument,		0, '?'},
+		{NULL,		0,			0, 0},
+	};
+	const char *short_opts = "l:r:i:w:s:f:c:S:?";
+	struct gen_params params = {
+		.layout		= &layouts[0],
+		.nr_rooms	= 32,
+		.nr_items	= 48,
+		.nr_words	= 120,
+		.nr_strings	= 200,
+		.nr_functions	= 64,
+		.nr_commands	= 200,
+		.seed		= 1,
+	};
+	struct gen_game game = {0};
+	int i, c, opt_index;
+
+	while (1) {
+		c = getopt_long(argc, argv, short_opts, long_opts, &opt_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'l':
+			for (i = 0; i < ARRAY_SIZE(layouts); i++)
+				if (strcmp(optarg, layouts[i].short_name) == 0)
+					break;
+			if (i == ARRAY_SIZE(layouts)) {
+				printf("Unknown layout '%s'\n", optarg);
+				usage(argv[0]);
+			}
+			params.layout = &layouts[i];
+			break;
+
+		case 'r':
+			params.nr_rooms = parse_count(optarg, 2, MAX_ROOMS);
+			break;
+
+		case 'i':
+			params.nr_items = parse_count(optarg, 0x27, MAX_ITEMS);
+			break;
+
+		case 'w':
+			params.nr_words = parse_count(optarg, 0, MAX_WORDS);
+			break;
+
+		case 's':
+			params.nr_strings = parse_count(optarg, 0x30,
+							MAX_STRINGS);
+			break;
+
+		case 'f':
+			params.nr_functions = parse_count(optarg, 16,
+							  MAX_FUNCTIONS);
+			break;
+
+		case 'c':
+			params.nr_commands = parse_count(optarg, 0, 1000000);
+			break;
+
+		case 'S':
+			params.seed = parse_count(optarg, 1, UINT32_MAX);
+			break;
+
+		case '?':
+		default:
+			usage(argv[0]);
+			break;
+		}
+	}
+
+	if (optind >= argc || argc - optind != 1)
+		usage(argv[0]);
+	params.out_dir = argv[optind];
+
+	if (mkdir(params.out_dir, 0755) != 0 && errno != EEXIST)
+		fatal_strerror(errno, "Cannot create '%s'", params.out_dir);
+
+	rand_state = params.seed;
+	game.params = &params;
+	game.version = params.layout->version;
+	game.nr_room_images = count_files(params.layout->room_image_files,
+					  ARRAY_SIZE(params.layout->room_image_files)) *
+		IMAGES_PER_FILE;
+	game.nr_item_images = count_files(params.layout->item_image_files,
+					  ARRAY_SIZE(params.layout->item_image_files)) *
+		IMAGES_PER_FILE;
+
+	gen_strings(&game);
+	gen_dictionary(&game);
+	gen_replace_words(&game);
+	gen_rooms_and_items(&game);
+	gen_functions(&game);
+	gen_actions(&game);
+
+	write_game_data(&game);
+	write_string_files(&game);
+	write_image_files(&game);
+	write_script(&game);
+
+	exit(EXIT_SUCCESS);
+}
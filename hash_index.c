@@ -0,0 +1,76 @@
+/*
+ * This file is part of Re-Comprehend
+ *
+ * Ryan Mallon, 2015, <rmallon@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to
+ * the public domain worldwide. This software is distributed without
+ * any warranty.  You should have received a copy of the CC0 Public
+ * Domain Dedication along with this software. If not, see
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ */
+
+
+#include <stdint.h>
+
+#include "arena.h"
+#include "hash_index.h"
+
+void hash_index_init(struct hash_index *index, struct arena *arena,
+		     size_t nr_entries)
+{
+	size_t i;
+
+	/* Keep the table at most half full */
+	index->nr_buckets = 16;
+	while (index->nr_buckets < nr_entries * 2)
+		index->nr_buckets *= 2;
+
+	index->buckets = arena_alloc(arena, index->nr_buckets *
+				     sizeof(*index->buckets));
+	for (i = 0; i < index->nr_buckets; i++)
+		index->buckets[i].first = HASH_INDEX_NONE;
+
+	index->next = arena_alloc(arena, nr_entries * sizeof(*index->next));
+}
+
+static struct hash_index_bucket *hash_index_bucket(const struct hash_index *index,
+						   uint64_t key)
+{
+	size_t i;
+
+	i = (key * 0x9e3779b97f4a7c15ULL) >> 32;
+	while (1) {
+		i &= index->nr_buckets - 1;
+		if (index->buckets[i].first == HASH_INDEX_NONE ||
+		    index->buckets[i].key == key)
+			return &index->buckets[i];
+		i++;
+	}
+}
+
+/*
+ * Add an entry to the front of the chain for key. Entries should be added
+ * in reverse order so that each chain is in table order.
+ */
+void hash_index_add(struct hash_index *index, uint64_t key, uint32_t entry)
+{
+	struct hash_index_bucket *bucket;
+
+	bucket = hash_index_bucket(index, key);
+	index->next[entry] = bucket->first;
+	bucket->key = key;
+	bucket->first = entry;
+}
+
+/*
+ * Returns the first entry with key, or HASH_INDEX_NONE. Further entries
+ * with the same key follow the next chain.
+ */
+uint32_t hash_index_first(const struct hash_index *index, uint64_t key)
+{
+	return hash_index_bucket(index, key)->first;
+}
@@ -0,0 +1,48 @@
+/*
+ * This file is part of Re-Comprehend
+ *
+ * Ryan Mallon, 2015, <rmallon@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to
+ * the public domain worldwide. This software is distributed without
+ * any warranty.  You should have received a copy of the CC0 Public
+ * Domain Dedication along with this software. If not, see
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ */
+
+
+#ifndef _RECOMPREHEND_HASH_INDEX_H
+#define _RECOMPREHEND_HASH_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct arena;
+
+#define HASH_INDEX_NONE		UINT32_MAX
+
+struct hash_index_bucket {
+	uint64_t		key;
+	uint32_t		first;
+};
+
+/*
+ * Load-time index from 64-bit keys to the entries of a table. Entries
+ * with the same key are chained through next. The index is allocated
+ * from an arena and never modified once built.
+ */
+struct hash_index {
+	struct hash_index_bucket	*buckets;
+	size_t				nr_buckets;
+	uint32_t			*next;
+};
+
+void hash_index_init(struct hash_index *index, struct arena *arena,
+		     size_t nr_entries);
+void hash_index_add(struct hash_index *index, uint64_t key, uint32_t entry);
+uint32_t hash_index_first(const struct hash_index *index, uint64_t key);
+
+#endif /* _RECOMPREHEND_HASH_INDEX_H */
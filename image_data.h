@@ -20,9 +20,14 @@
 #include <stdio.h>
 
 struct file_buf;
+struct file_cache;
+struct thread_pool;
 struct comprehend_game;
 
+#define IMAGES_PER_FILE			16
+
 struct image_data {
+	/* One per image file, the files are owned by a file_cache */
 	struct file_buf	*fb;
 	uint16_t	*image_offsets;
 	size_t		nr_images;
@@ -81,7 +86,11 @@ void draw_bright_room(void);
 void draw_image(struct image_data *info, unsigned index);
 void draw_location_image(struct image_data *info, unsigned index);
 
-void comprehend_load_image_file(const char *filename, struct image_data *info);
-void comprehend_load_images(struct comprehend_game *game, const char *game_dir);
+void comprehend_load_image_file(const char *filename,
+				struct file_cache *files,
+				struct image_data *info);
+void comprehend_load_images(struct comprehend_game *game, const char *game_dir,
+			    struct thread_pool *pool);
+void comprehend_free_images(struct image_data *info);
 
 #endif /* _RECOMPREHEND_IMAGE_DATA_H */
@@ -0,0 +1,221 @@
+/*
+ * This file is part of Re-Comprehend
+ *
+ * Ryan Mallon, 2015, <rmallon@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to
+ * the public domain worldwide. This software is distributed without
+ * any warranty.  You should have received a copy of the CC0 Public
+ * Domain Dedication along with this software. If not, see
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ */
+
+/*
+ * The image op decoder. This file is included twice by image_data.c, to
+ * build a traced version for when image debugging is enabled and a release
+ * version with the tracing compiled out. IMAGE_NAME gives the functions
+ * unique names and image_trace prints an op, or does nothing.
+ */
+
+static bool IMAGE_NAME(do_image_op)(struct file_buf *fb,
+				    struct image_context *ctx)
+{
+	uint8_t opcode;
+	uint16_t a, b;
+
+	file_buf_get_u8(fb, &opcode);
+	image_trace("  %.4x [%.2x]: ", file_buf_get_pos(fb) - 1, opcode);
+
+	switch (opcode) {
+	case IMAGE_OP_SCENE_END:
+	case IMAGE_OP_EOF:
+		image_trace("end\n");
+		return true;
+
+	case IMAGE_OP_PEN_COLOR_A:
+	case IMAGE_OP_PEN_COLOR_B:
+	case IMAGE_OP_PEN_COLOR_C:
+	case IMAGE_OP_PEN_COLOR_D:
+	case IMAGE_OP_PEN_COLOR_E:
+	case IMAGE_OP_PEN_COLOR_F:
+	case IMAGE_OP_PEN_COLOR_G:
+	case IMAGE_OP_PEN_COLOR_H:
+		image_trace("set_pen_color(%.2x)\n", opcode);
+		ctx->pen_color = g_set_pen_color(opcode);
+		break;
+
+	case IMAGE_OP_DRAW_LINE:
+	case IMAGE_OP_DRAW_LINE_FAR:
+		a = image_get_operand(fb);
+		b = image_get_operand(fb);
+
+		if (opcode & 0x1)
+			a += 255;
+
+		image_trace("draw_line (%d, %d) - (%d, %d)\n",
+			    ctx->x, ctx->y, a, b);
+		g_draw_line(ctx->x, ctx->y, a, b, ctx->pen_color);
+
+		ctx->x = a;
+		ctx->y = b;
+		break;
+
+	case IMAGE_OP_DRAW_BOX:
+	case IMAGE_OP_DRAW_BOX_FAR:
+		a = image_get_operand(fb);
+		b = image_get_operand(fb);
+
+		if (opcode & 0x1)
+			a += 255;
+
+		image_trace("draw_box (%d, %d) - (%d, %d)\n",
+			    ctx->x, ctx->y, a, b);
+
+		g_draw_box(ctx->x, ctx->y, a, b, ctx->pen_color);
+		break;
+
+	case IMAGE_OP_MOVE_TO:
+	case IMAGE_OP_MOVE_TO_FAR:
+		/* Move to */
+		a = image_get_operand(fb);
+		b = image_get_operand(fb);
+
+		if (opcode & 0x1)
+			a += 255;
+
+		image_trace("move_to(%d, %d)\n", a, b);
+		ctx->x = a;
+		ctx->y = b;
+		break;
+
+	case IMAGE_OP_SHAPE_PIXEL:
+	case IMAGE_OP_SHAPE_BOX:
+	case IMAGE_OP_SHAPE_CIRCLE_TINY:
+	case IMAGE_OP_SHAPE_CIRCLE_SMALL:
+	case IMAGE_OP_SHAPE_CIRCLE_MED:
+	case IMAGE_OP_SHAPE_CIRCLE_LARGE:
+	case IMAGE_OP_SHAPE_A:
+	case IMAGE_OP_SHAPE_SPRAY:
+		image_trace("set_shape_type(%.2x)\n", opcode - 0x40);
+		ctx->shape = opcode;
+		break;
+
+	case 0x48:
+		/*
+		 * FIXME - This appears to be a shape type. Only used by
+		 *         OO-Topos.
+		 */
+		image_trace("shape_unknown()\n");
+		ctx->shape = IMAGE_OP_SHAPE_PIXEL;
+		break;
+
+	case IMAGE_OP_DRAW_SHAPE:
+	case IMAGE_OP_DRAW_SHAPE_FAR:
+		a = image_get_operand(fb);
+		b = image_get_operand(fb);
+
+		if (opcode & 0x1)
+			a += 255;
+
+		image_trace("draw_shape(%d, %d), style=%.2x, fill=%.2x\n",
+			    a, b, ctx->shape, ctx->fill_color);
+
+		g_draw_shape(a, b, ctx->shape, ctx->fill_color);
+		break;
+
+	case IMAGE_OP_PAINT:
+	case IMAGE_OP_PAINT_FAR:
+		/* Paint */
+		a = image_get_operand(fb);
+		b = image_get_operand(fb);
+
+		if (opcode & 0x1)
+			a += 255;
+
+		image_trace("paint(%d, %d)\n", a, b);
+		if (!(draw_flags & IMAGEF_NO_FLOODFILL))
+			g_floodfill(a, b, ctx->fill_color,
+				    g_get_pixel_color(a, b));
+		break;
+
+	case IMAGE_OP_FILL_COLOR:
+		a = image_get_operand(fb);
+		image_trace("set_fill_color(%.2x)\n", a);
+		ctx->fill_color = g_set_fill_color(a);
+		break;
+
+	case IMAGE_OP_SET_TEXT_POS:
+		a = image_get_operand(fb);
+		b = image_get_operand(fb);
+		image_trace("set_text_pos(%d, %d)\n", a, b);
+
+		ctx->text_x = a;
+		ctx->text_y = b;
+		break;
+
+	case IMAGE_OP_DRAW_CHAR:
+		a = image_get_operand(fb);
+		image_trace("draw_char(%c)\n", a >= 0x20 && a < 0x7f ? a : '?');
+
+		g_draw_box(ctx->text_x, ctx->text_y,
+			   ctx->text_x + 6, ctx->text_y + 7, ctx->fill_color);
+		ctx->text_x += 8;
+		break;
+
+	case 0xf3:
+		/*
+		 * FIXME - Oo-Topos uses this at the beginning of some room
+		 *         images.
+		 */
+		image_trace("unknown()\n");
+		break;
+
+	case 0xb5:
+	case 0x82:
+	case 0x50:
+		/* FIXME - unknown, no arguments */
+		image_trace("unknown\n");
+		break;
+
+	case 0x73:
+	case 0xb0:
+	case 0xd0:
+		/* FIXME - unknown, one argument */
+		a = image_get_operand(fb);
+		image_trace("unknown %.2x: (%.2x) '%c'\n",
+			    opcode, a, a >= 0x20 && a < 0x7f ? a : '?');
+		break;
+
+	default:
+		/* FIXME - Unknown, two arguments */
+		a = image_get_operand(fb);
+		b = image_get_operand(fb);
+
+		image_trace("unknown(%.2x, %.2x)\n", a, b);
+		g_draw_pixel(a, b, 0x00ff00ff);
+		break;
+	}
+
+	return false;
+}
+
+/*
+ * Run the image ops until the end of the image. Returns when the scene end
+ * or EOF op is reached.
+ */
+static void IMAGE_NAME(do_image_ops)(struct file_buf *fb,
+				     struct image_context *ctx)
+{
+	bool done = false;
+
+	while (!done) {
+		done = IMAGE_NAME(do_image_op)(fb, ctx);
+		if (!done && (draw_flags & IMAGEF_OP_WAIT_KEYPRESS)) {
+			getchar();
+			g_flip_buffers();
+		}
+	}
+}
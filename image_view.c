@@ -19,6 +19,7 @@
 #include <string.h>
 #include <stdio.h>
 
+#include "file_buf.h"
 #include "image_data.h"
 #include "graphics.h"
 #include "util.h"
@@ -53,6 +54,7 @@ int main(int argc, char **argv)
 		{NULL,			0,			0, 0},
 	};
 	const char *short_opts = "w:h:c:t:spfd?";
+	struct file_cache files = {0};
 	struct image_data info;
 	const char *filename;
 	unsigned index, clear_color = G_COLOR_WHITE,
@@ -119,7 +121,7 @@ int main(int argc, char **argv)
 
 	g_init(graphics_width, graphics_height);
 	g_set_color_table(color_table);
-	comprehend_load_image_file(filename, &info);
+	comprehend_load_image_file(filename, &files, &info);
 
 	while (index < 16) {
 		g_clear_screen(clear_color);
@@ -13,6 +13,7 @@
  *
  */
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "recomprehend.h"
@@ -172,3 +173,128 @@ uint8_t *get_opcode_map(struct comprehend_game *game)
 		return NULL;
 	}
 }
+
+static bool valid_item(struct game_info *info, uint8_t operand)
+{
+	return operand != 0 && operand - 1 < info->header.nr_items;
+}
+
+static bool valid_room(struct game_info *info, uint8_t room)
+{
+	return room != 0 && room - 1 < info->nr_rooms;
+}
+
+/*
+ * Decode an instruction into its generic opcode and arguments. Item
+ * operands become item indexes, and operands which are split across two
+ * bytes, such as string and function indexes, are combined. Operands
+ * which index the game data are checked here rather than each time the
+ * instruction is run. An instruction with a bad operand is decoded as
+ * OPCODE_BAD_OPERAND, which is a fatal error if it is run.
+ */
+static void decode_instruction(struct game_info *info, uint8_t *opcode_map,
+			       struct instruction *instr)
+{
+	uint8_t *operand = instr->operand;
+
+	instr->op = opcode_map[instr->opcode];
+	instr->arg[0] = operand[0];
+	instr->arg[1] = operand[1];
+
+	switch (instr->op) {
+	case OPCODE_HAVE_OBJECT:
+	case OPCODE_NOT_HAVE_OBJECT:
+	case OPCODE_OBJECT_PRESENT:
+	case OPCODE_OBJECT_NOT_PRESENT:
+	case OPCODE_OBJECT_IN_ROOM:
+	case OPCODE_OBJECT_NOT_IN_ROOM:
+	case OPCODE_OBJECT_IS_NOWHERE:
+	case OPCODE_OBJECT_IS_NOT_NOWHERE:
+	case OPCODE_MOVE_OBJECT_TO_ROOM:
+	case OPCODE_MOVE_OBJECT_TO_CURRENT_ROOM:
+	case OPCODE_REMOVE_OBJECT:
+	case OPCODE_DROP_OBJECT:
+	case OPCODE_TAKE_OBJECT:
+	case OPCODE_SET_OBJECT_GRAPHIC:
+		if (!valid_item(info, operand[0]))
+			goto bad_operand;
+		instr->arg[0] = operand[0] - 1;
+		break;
+
+	case OPCODE_SET_OBJECT_DESCRIPTION:
+	case OPCODE_SET_OBJECT_LONG_DESCRIPTION:
+		if (!valid_item(info, operand[0]))
+			goto bad_operand;
+		instr->arg[0] = operand[0] - 1;
+		instr->arg[1] = (operand[2] << 8) | operand[1];
+		break;
+
+	case OPCODE_SET_ROOM_DESCRIPTION:
+		if (!valid_room(info, operand[0]) ||
+		    operand[2] < 0x80 || operand[2] > 0x82)
+			goto bad_operand;
+		instr->arg[1] = operand[1] + ((operand[2] - 0x80) << 8);
+		break;
+
+	case OPCODE_SET_ROOM_GRAPHIC:
+		if (!valid_room(info, operand[0]))
+			goto bad_operand;
+		break;
+
+	case OPCODE_MOVE_DIRECTION:
+		if (operand[0] == 0 || operand[0] - 1 >= NR_DIRECTIONS)
+			goto bad_operand;
+		instr->arg[0] = operand[0] - 1;
+		break;
+
+	case OPCODE_PRINT:
+		instr->arg[0] = (operand[1] << 8) | operand[0];
+		break;
+
+	case OPCODE_CALL_FUNC:
+		instr->arg[0] = operand[0];
+		if (operand[1] == 0x81)
+			instr->arg[0] += 0x100;
+		if (instr->arg[0] >= info->nr_functions)
+			goto bad_operand;
+		break;
+
+	case OPCODE_SET_STRING_REPLACEMENT:
+		instr->arg[0] = (uint8_t)(operand[0] - 1);
+		break;
+	}
+	return;
+
+bad_operand:
+	instr->op = OPCODE_BAD_OPERAND;
+}
+
+/*
+ * Decode every instruction once the game is loaded, so that the VM never
+ * needs the version specific opcode maps.
+ */
+void decode_instructions(struct comprehend_game *game)
+{
+	struct game_info *info = game->info;
+	uint8_t *opcode_map = get_opcode_map(game);
+	struct instruction *instr;
+	uint16_t skip = 0;
+	size_t i;
+
+	for (i = 0; i < info->nr_instructions; i++)
+		decode_instruction(info, opcode_map, &info->instructions[i]);
+
+	/*
+	 * Count the commands left in each command block, working backwards.
+	 * Blocks may run on past the end of a function, the VM clamps the
+	 * skip count to the function it is running.
+	 */
+	for (i = info->nr_instructions; i-- > 0; ) {
+		instr = &info->instructions[i];
+		if (!instr->is_command)
+			skip = 0;
+		else if (skip < UINT16_MAX)
+			skip++;
+		instr->skip = skip;
+	}
+}
@@ -21,5 +21,6 @@
 struct comprehend_game;
 
 uint8_t *get_opcode_map(struct comprehend_game *game);
+void decode_instructions(struct comprehend_game *game);
 
 #endif /* _RECOMPREHEND_OPCODE_MAP_H */
@@ -17,11 +17,15 @@
 #include <getopt.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <stdio.h>
 
 #include "recomprehend.h"
 #include "dump_game_data.h"
+#include "game_cache.h"
 #include "game_data.h"
+#include "game_native.h"
+#include "strings.h"
 #include "graphics.h"
 #include "game.h"
 #include "util.h"
@@ -70,6 +74,15 @@ static void usage(const char *progname)
 	for (i = 0; i < ARRAY_SIZE(dump_options); i++)
 		printf("        %s\n", dump_options[i].option);
 	printf("  -p, --no-play                 Don't run the interpreter\n");
+	printf("  -c, --cache=FILE              Load game from compiled cache\n");
+	printf("  -C, --compile-cache=FILE      Write compiled game cache\n");
+	printf("  -n, --native=FILE             Load native code\n");
+	printf("  -N, --compile-native=FILE     Write native code\n");
+	printf("  -k, --native-check            Check native code\n");
+	printf("  -s, --string-cache=BYTES      Decoded string cache limit\n");
+	printf("  -m, --max-call-depth=N        Function call depth limit\n");
+	printf("  -S, --script=FILE             Read input from a script\n");
+	printf("  -t, --transcript=FILE         Write output to a transcript\n");
 	printf("  -g, --no-graphics             Disable graphics\n");
 	printf("  -f, --no-floodfill            Disable floodfill\n");
 	printf("  -w, --graphics-width=WIDTH    Graphics width\n");
@@ -89,6 +102,15 @@ int main(int argc, char **argv)
 		{"debug",		no_argument,		0, 'd'},
 		{"dump",		required_argument,	0, 'D'},
 		{"no-play",		no_argument,		0, 'p'},
+		{"cache",		required_argument,	0, 'c'},
+		{"compile-cache",	required_argument,	0, 'C'},
+		{"native",		required_argument,	0, 'n'},
+		{"compile-native",	required_argument,	0, 'N'},
+		{"native-check",	no_argument,		0, 'k'},
+		{"string-cache",	required_argument,	0, 's'},
+		{"max-call-depth",	required_argument,	0, 'm'},
+		{"script",		required_argument,	0, 'S'},
+		{"transcript",		required_argument,	0, 't'},
 		{"no-graphics",		no_argument,		0, 'g'},
 		{"no-floodfill",	no_argument,		0, 'f'},
 		{"graphics-width",	required_argument,	0, 'w'},
@@ -96,9 +118,11 @@ int main(int argc, char **argv)
 		{"help",		no_argument,		0, '?'},
 		{NULL,			0,			0, 0},
 	};
-	const char *short_opts = "dD:pgfw:h:?";
+	const char *short_opts = "dD:pc:C:n:N:ks:m:S:t:gfw:h:?";
 	struct comprehend_game *game;
 	const char *game_name, *game_dir;
+	const char *compile_cache_file = NULL, *transcript_file = NULL;
+	const char *compile_native_file = NULL;
 	unsigned dump_flags = 0;
 	int i, c, opt_index;
 	unsigned graphics_width = G_RENDER_WIDTH,
@@ -132,6 +156,42 @@ int main(int argc, char **argv)
 			play_game = false;
 			break;
 
+		case 'c':
+			game_cache_set_file(optarg);
+			break;
+
+		case 'C':
+			compile_cache_file = optarg;
+			break;
+
+		case 'n':
+			game_native_set_file(optarg);
+			break;
+
+		case 'N':
+			compile_native_file = optarg;
+			break;
+
+		case 'k':
+			game_native_set_check(true);
+			break;
+
+		case 's':
+			string_cache_set_limit(strtoul(optarg, NULL, 0));
+			break;
+
+		case 'm':
+			eval_set_max_call_depth(strtoul(optarg, NULL, 0));
+			break;
+
+		case 'S':
+			console_set_script(optarg);
+			break;
+
+		case 't':
+			transcript_file = optarg;
+			break;
+
 		case 'g':
 			graphics_enabled = false;
 			break;
@@ -178,12 +238,22 @@ int main(int argc, char **argv)
 		usage(argv[0]);
 	}
 
+	if (transcript_file && !freopen(transcript_file, "w", stdout))
+		fatal_strerror(errno, "Cannot create transcript '%s'",
+			       transcript_file);
+
 	if (graphics_enabled)
 		g_init(graphics_width, graphics_height);
 
 	game->info = xmalloc(sizeof(*game->info));
 	comprehend_load_game(game, game_dir);
 
+	if (compile_cache_file)
+		game_cache_write(game, game_dir, compile_cache_file);
+
+	if (compile_native_file)
+		game_native_write(game, game_dir, compile_native_file);
+
 	if (dump_flags)
 		dump_game_data(game, dump_flags);
 
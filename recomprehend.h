@@ -17,6 +17,7 @@
 #define _RECOMPREHEND_RECOMPREHEND_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define MAX_FILES	10
@@ -51,6 +52,12 @@ struct game_ops {
 			       unsigned *room_desc_string);
 	void (*handle_special_opcode)(struct comprehend_game *game,
 				      uint8_t operand);
+
+	/*
+	 * Size of the per-session state used by the hooks. It is zeroed
+	 * when a session starts or the game is restarted.
+	 */
+	size_t hook_state_size;
 };
 
 struct comprehend_game {
@@ -59,6 +66,10 @@ struct comprehend_game {
 
 	const char		*game_dir;
 
+	/* Hash of the game files in game_dir, see game_cache_hash */
+	uint64_t		source_hash;
+	bool			source_hashed;
+
 	const char		*game_data_file;
 	struct string_file	string_files[MAX_FILES];
 	const char		*location_graphic_files[MAX_FILES];
@@ -70,6 +81,7 @@ struct comprehend_game {
 	struct game_ops		*ops;
 
 	struct game_info	*info;
+	struct game_state	*state;
 };
 
 #endif /* _RECOMPREHEND_RECOMPREHEND_H */
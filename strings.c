@@ -13,17 +13,497 @@
  *
  */
 
+#include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
 
 #include "recomprehend.h"
 #include "game_data.h"
+#include "file_buf.h"
+#include "arena.h"
 #include "strings.h"
+#include "util.h"
+
+/* Maximum size of a session's lazily decoded strings for each table */
+#define DEFAULT_STRING_CACHE_LIMIT	(64 * 1024)
+
+/*
+ * Character tables for the element values 0x01 to 0x1d, which are the only
+ * values looked up. Upper-case characters are the lower-case ones less 0x20.
+ * A capital space means that the character is dynamically replaced at
+ * runtime. We use the character '@' since it cannot otherwise appear in
+ * strings.
+ */
+static const char *const charsets[] = {
+	"..abcdefghijklmnopqrstuvwxyz .",
+	"\x0e\x0e" "ABCDEFGHIJKLMNOPQRSTUVWXYZ@\x0e",
+	"[]\n!\"#$%&'(),-/0123456789:;?<>",
+};
 
 static char bad_string[128];
 
-const char *string_lookup(struct comprehend_game *game, uint16_t index)
+static size_t string_cache_limit = DEFAULT_STRING_CACHE_LIMIT;
+
+/* Returns the previous limit */
+size_t string_cache_set_limit(size_t limit)
+{
+	size_t old_limit = string_cache_limit;
+
+	string_cache_limit = limit;
+	return old_limit;
+}
+
+/*
+ * Unpack groups of five bytes into eight 5-bit elements each. The x86
+ * versions unpack several groups per step using byte shuffles, and may
+ * read and write up to 32 bytes past the last group.
+ */
+typedef void (*unpack_fn_t)(const uint8_t *encoded, uint8_t *elems,
+			    size_t nr_groups);
+
+static void unpack_elems(const uint8_t *encoded, uint8_t *elems,
+			 size_t nr_groups)
+{
+	uint64_t chunk;
+	size_t i;
+	int j;
+
+	for (i = 0; i < nr_groups; i++, encoded += 5, elems += 8) {
+		chunk = ((uint64_t)encoded[0] << 32) |
+			((uint64_t)encoded[1] << 24) |
+			((uint64_t)encoded[2] << 16) |
+			((uint64_t)encoded[3] << 8) |
+			((uint64_t)encoded[4]);
+
+		for (j = 0; j < 8; j++)
+			elems[j] = (chunk >> (35 - (5 * j))) & 0x1f;
+	}
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+
+#define HAVE_UNPACK_SIMD
+
+/*
+ * Each element is taken from a big-endian pair of bytes. The shuffles put
+ * the pair for each element of a group into a 16-bit lane, the multiply
+ * shifts the element to the top of the lane and the shift moves it down.
+ */
+#define UNPACK_SHUFFLE(o)						\
+	(o) + 1, (o), (o) + 1, (o), (o) + 2, (o) + 1, (o) + 2, (o) + 1,	\
+	(o) + 3, (o) + 2, (o) + 4, (o) + 3, (o) + 4, (o) + 3, (o) + 5, (o) + 4
+#define UNPACK_SHIFTS	1, 32, 4, 128, 16, 2, 64, 8
+
+__attribute__((target("ssse3")))
+static void unpack_elems_ssse3(const uint8_t *encoded, uint8_t *elems,
+			       size_t nr_groups)
+{
+	const __m128i shuffle0 = _mm_setr_epi8(UNPACK_SHUFFLE(0));
+	const __m128i shuffle1 = _mm_setr_epi8(UNPACK_SHUFFLE(5));
+	const __m128i shifts = _mm_setr_epi16(UNPACK_SHIFTS);
+	__m128i in, lo, hi;
+	size_t i;
+
+	/* Two groups per step */
+	for (i = 0; i < nr_groups; i += 2, encoded += 10, elems += 16) {
+		in = _mm_loadu_si128((const __m128i *)encoded);
+		lo = _mm_mullo_epi16(_mm_shuffle_epi8(in, shuffle0), shifts);
+		hi = _mm_mullo_epi16(_mm_shuffle_epi8(in, shuffle1), shifts);
+		lo = _mm_srli_epi16(lo, 11);
+		hi = _mm_srli_epi16(hi, 11);
+		_mm_storeu_si128((__m128i *)elems, _mm_packus_epi16(lo, hi));
+	}
+}
+
+__attribute__((target("avx2")))
+static void unpack_elems_avx2(const uint8_t *encoded, uint8_t *elems,
+			      size_t nr_groups)
+{
+	const __m256i shuffle0 = _mm256_setr_epi8(UNPACK_SHUFFLE(0),
+						  UNPACK_SHUFFLE(0));
+	const __m256i shuffle1 = _mm256_setr_epi8(UNPACK_SHUFFLE(5),
+						  UNPACK_SHUFFLE(5));
+	const __m256i shifts = _mm256_setr_epi16(UNPACK_SHIFTS, UNPACK_SHIFTS);
+	__m256i in, lo, hi;
+	size_t i;
+
+	/*
+	 * Four groups per step, two in each 128-bit lane. The pack works
+	 * within lanes, so the groups come out in order.
+	 */
+	for (i = 0; i < nr_groups; i += 4, encoded += 20, elems += 32) {
+		in = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(
+				_mm_loadu_si128((const __m128i *)encoded)),
+			_mm_loadu_si128((const __m128i *)(encoded + 10)), 1);
+		lo = _mm256_mullo_epi16(_mm256_shuffle_epi8(in, shuffle0),
+					shifts);
+		hi = _mm256_mullo_epi16(_mm256_shuffle_epi8(in, shuffle1),
+					shifts);
+		lo = _mm256_srli_epi16(lo, 11);
+		hi = _mm256_srli_epi16(hi, 11);
+		_mm256_storeu_si256((__m256i *)elems,
+				    _mm256_packus_epi16(lo, hi));
+	}
+}
+#endif
+
+static unpack_fn_t unpack_fn;
+static pthread_once_t unpack_fn_once = PTHREAD_ONCE_INIT;
+
+/* Pick the unpacker for this CPU, once per process */
+static void init_unpack_fn(void)
+{
+	unpack_fn = unpack_elems;
+#ifdef HAVE_UNPACK_SIMD
+	if (__builtin_cpu_supports("avx2"))
+		unpack_fn = unpack_elems_avx2;
+	else if (__builtin_cpu_supports("ssse3"))
+		unpack_fn = unpack_elems_ssse3;
+#endif
+}
+
+/*
+ * Game strings are stored using 5-bit characters. By default a character
+ * value maps to the lower-case letter table. If a character has the value 0x1e
+ * then the next character is upper-case. An upper-case space is used to
+ * specify that the character should be replaced at runtime (like a '%s'
+ * specifier). If a character has the value 0x1f then the next character is
+ * taken from the symbols table.
+ */
+static char *decode_string(struct file_buf *fb)
+{
+	bool capital_next = false, special_next = false;
+	size_t encoded_len, nr_groups, i, k = 0;
+	uint8_t elem, *encoded, *elems;
+	char *string;
+
+	encoded_len = file_buf_strlen(fb, NULL);
+	nr_groups = (encoded_len + 4) / 5;
+
+	/*
+	 * Get the encoded string. The padding is zeroed by xmalloc so that
+	 * the unpackers can overrun it, and so that a partial last group
+	 * ends the string.
+	 */
+	encoded = xmalloc(nr_groups * 5 + 32);
+	file_buf_get_data(fb, encoded, encoded_len);
+
+	/* Skip over the zero byte */
+	if (file_buf_get_pos(fb) < fb->size)
+		file_buf_get_data(fb, NULL, 1);
+
+	elems = xmalloc(nr_groups * 8 + 32);
+	pthread_once(&unpack_fn_once, init_unpack_fn);
+	unpack_fn(encoded, elems, nr_groups);
+	elems[nr_groups * 8] = 0;
+	free(encoded);
+
+	string = xmalloc(nr_groups * 8 + 1);
+	for (i = 0; (elem = elems[i]) != 0; i++) {
+		if (elem == 0x1e) {
+			capital_next = true;
+		} else if (elem == 0x1f) {
+			special_next = true;
+		} else {
+			/* Special takes precedence over capital */
+			string[k++] = charsets[special_next ? 2 :
+					       capital_next][elem];
+			special_next = false;
+			capital_next = false;
+		}
+	}
+
+	string[k] = '\0';
+	free(elems);
+
+	/* Strings are cached once decoded, so don't keep the slack */
+	return xrealloc(string, k + 1);
+}
+
+/*
+ * Split a string into a template of tokens for console_println. Text
+ * tokens are runs of the string which are printed as a single word, and
+ * replace word tokens are the '@' characters which are substituted at
+ * runtime. The splitting matches the original console output exactly,
+ * including printing everything up to a later '@' as one word.
+ *
+ * The template must have room for string_template_max_size(text) bytes.
+ */
+void string_template_split(struct string_template *tmpl, const char *text)
+{
+	struct string_token *token;
+	const char *p = text, *next_replace;
+	size_t len;
+
+	tmpl->text = text;
+	tmpl->nr_tokens = 0;
+
+	next_replace = strchr(p, '@');
+	while (*p) {
+		if (*p == ' ') {
+			/* Leading space, or spaces after a newline */
+			p++;
+			continue;
+		}
+
+		token = &tmpl->tokens[tmpl->nr_tokens++];
+		token->space = false;
+		if (*p == '\n') {
+			token->type = STRING_TOKEN_NEWLINE;
+			p++;
+			continue;
+		}
+
+		if (*p == '@') {
+			token->type = STRING_TOKEN_REPLACE_WORD;
+			p++;
+		} else {
+			if (next_replace && next_replace < p)
+				next_replace = strchr(p, '@');
+
+			len = strcspn(p, " \n");
+			if (next_replace)
+				len = next_replace - p;
+
+			token->type = STRING_TOKEN_TEXT;
+			token->offset = p - text;
+			token->len = len;
+			p += len;
+		}
+
+		if (*p == ' ') {
+			token->space = true;
+			while (*p == ' ')
+				p++;
+		}
+	}
+}
+
+/* Largest size of the template for text, one token per character */
+size_t string_template_max_size(const char *text)
+{
+	return sizeof(struct string_template) +
+		strlen(text) * sizeof(struct string_token);
+}
+
+struct string_template *string_template_compile(const char *text)
+{
+	struct string_template *tmpl;
+
+	tmpl = xmalloc(string_template_max_size(text));
+	string_template_split(tmpl, text);
+
+	return xrealloc(tmpl, string_template_size(tmpl));
+}
+
+size_t string_template_size(const struct string_template *tmpl)
+{
+	return sizeof(*tmpl) + tmpl->nr_tokens * sizeof(tmpl->tokens[0]);
+}
+
+/*
+ * Skip over an encoded string without decoding it.
+ */
+void string_skip(struct file_buf *fb)
+{
+	file_buf_get_data(fb, NULL, file_buf_strlen(fb, NULL));
+
+	/* Skip over the zero byte */
+	if (file_buf_get_pos(fb) < fb->size)
+		file_buf_get_data(fb, NULL, 1);
+}
+
+/*
+ * Add a string at offset in file to the table. The file must stay mapped
+ * until the game is unloaded, the string is decoded from it when it is
+ * first looked up.
+ */
+void string_table_add(struct string_table *table,
+		      const struct file_buf *file, uint32_t offset)
+{
+	struct string_entry *entry;
+
+	table->entries = grow_array(table->entries, &table->nr_allocated,
+				    table->nr_strings + 1,
+				    sizeof(*table->entries));
+	entry = &table->entries[table->nr_strings++];
+	entry->string = NULL;
+	entry->file = file;
+	entry->offset = offset;
+}
+
+/*
+ * Move the table entries into the game's arena once all strings have
+ * been added.
+ */
+void string_table_trim(struct string_table *table, struct arena *arena)
+{
+	table->entries = arena_move(arena, table->entries,
+				    table->nr_strings *
+				    sizeof(*table->entries));
+	table->nr_allocated = table->nr_strings;
+}
+
+static void string_cache_init(struct string_cache *cache,
+			      const struct string_table *table)
+{
+	if (cache->strings)
+		return;
+
+	cache->strings = xmalloc(table->nr_strings * sizeof(*cache->strings));
+	cache->tmpls = xmalloc(table->nr_strings * sizeof(*cache->tmpls));
+	cache->decoded = xmalloc(table->nr_strings * sizeof(*cache->decoded));
+	cache->nr_strings = table->nr_strings;
+}
+
+/*
+ * Free a session's decoded strings and templates.
+ */
+void string_cache_free(struct string_cache *cache)
+{
+	size_t i;
+
+	for (i = 0; i < cache->nr_strings; i++) {
+		free(cache->strings[i]);
+		free(cache->tmpls[i]);
+	}
+	free(cache->strings);
+	free(cache->tmpls);
+	free(cache->decoded);
+
+	memset(cache, 0, sizeof(*cache));
+}
+
+static size_t decoded_size(struct string_cache *cache, size_t index)
+{
+	return strlen(cache->strings[index]) + 1 +
+		string_template_size(cache->tmpls[index]);
+}
+
+/*
+ * Free the oldest decoded strings until there is room for size more
+ * bytes. Evicted strings are decoded again if they are looked up later.
+ */
+static void string_cache_evict(struct string_cache *cache, size_t size)
+{
+	size_t index;
+
+	while (cache->nr_decoded &&
+	       cache->decoded_size + size > string_cache_limit) {
+		index = cache->decoded[cache->decoded_first];
+		cache->decoded_size -= decoded_size(cache, index);
+		free(cache->strings[index]);
+		free(cache->tmpls[index]);
+		cache->strings[index] = NULL;
+		cache->tmpls[index] = NULL;
+
+		cache->decoded_first = (cache->decoded_first + 1) %
+			cache->nr_strings;
+		cache->nr_decoded--;
+	}
+}
+
+static const char *string_table_decode(const struct string_table *table,
+				       struct string_cache *cache,
+				       size_t index)
+{
+	const struct string_entry *entry = &table->entries[index];
+	struct string_template *tmpl;
+	struct file_buf fb;
+	char *string;
+	size_t size;
+
+	/* Decode from a copy so that the table's files are never moved */
+	fb = *entry->file;
+	file_buf_set_pos(&fb, entry->offset);
+	string = decode_string(&fb);
+	tmpl = string_template_compile(string);
+	size = strlen(string) + 1 + string_template_size(tmpl);
+
+	if (!cache->keep_decoded)
+		string_cache_evict(cache, size);
+
+	cache->decoded[(cache->decoded_first + cache->nr_decoded) %
+		       cache->nr_strings] = index;
+	cache->nr_decoded++;
+	cache->decoded_size += size;
+
+	cache->strings[index] = string;
+	cache->tmpls[index] = tmpl;
+	return string;
+}
+
+/*
+ * Returns the string at index in the table, decoding it into the
+ * session's cache if needed. The returned string is only guaranteed to
+ * remain valid until the next lookup in the same cache. Returns NULL for
+ * unused entries in the table.
+ */
+const char *string_table_lookup(const struct string_table *table,
+				struct string_cache *cache, size_t index)
+{
+	const struct string_entry *entry = &table->entries[index];
+
+	if (entry->string)
+		return entry->string;
+	if (!entry->file)
+		return NULL;
+
+	string_cache_init(cache, table);
+	if (cache->strings[index])
+		return cache->strings[index];
+
+	return string_table_decode(table, cache, index);
+}
+
+/*
+ * Returns the template for the string at index in the table, or NULL for
+ * unused entries. Valid for the same time as string_table_lookup.
+ */
+const struct string_template *
+string_table_lookup_template(const struct string_table *table,
+			     struct string_cache *cache, size_t index)
+{
+	const char *string;
+
+	string = string_table_lookup(table, cache, index);
+	if (!string)
+		return NULL;
+
+	/*
+	 * Strings from a compiled cache are not decoded, so their templates
+	 * are compiled on first use and kept until the cache is freed.
+	 */
+	string_cache_init(cache, table);
+	if (!cache->tmpls[index])
+		cache->tmpls[index] = string_template_compile(string);
+
+	return cache->tmpls[index];
+}
+
+/*
+ * Decode every string in the table into the cache and keep them all. Used
+ * when the whole table is needed, such as for dumping the game data.
+ */
+void string_table_decode_all(const struct string_table *table,
+			     struct string_cache *cache)
+{
+	size_t i;
+
+	cache->keep_decoded = true;
+	for (i = 0; i < table->nr_strings; i++)
+		string_table_lookup(table, cache, i);
+}
+
+static struct string_table *string_index_table(struct comprehend_game *game,
+					       uint16_t index, size_t *string,
+					       struct string_cache **cache)
 {
-	uint16_t string;
 	uint8_t table;
 
 	/*
@@ -37,33 +517,68 @@ const char *string_lookup(struct comprehend_game *game, uint16_t index)
 	 * them the same everywhere.
 	 */
 	table = (index >> 8) & 0xff;
-	string = index & 0xff;
+	*string = index & 0xff;
 
 	switch (table) {
 	case 0x81:
 	case 0x01:
-		string += 0x100;
+		*string += 0x100;
 		/* Fall-through */
 	case 0x00:
 	case 0x80:
-		if (string < game->info->strings.nr_strings)
-			return game->info->strings.strings[string];
+		if (*string < game->info->strings.nr_strings) {
+			*cache = &game->state->strings;
+			return &game->info->strings;
+		}
 		break;
 
 	case 0x83:
-		string += 0x100;
+		*string += 0x100;
 		/* Fall-through */
 	case 0x02:
 	case 0x82:
-		if (string < game->info->strings2.nr_strings)
-			return game->info->strings2.strings[string];
+		if (*string < game->info->strings2.nr_strings) {
+			*cache = &game->state->strings2;
+			return &game->info->strings2;
+		}
 		break;
 	}
 
+	return NULL;
+}
+
+const char *string_lookup(struct comprehend_game *game, uint16_t index)
+{
+	struct string_table *table;
+	struct string_cache *cache;
+	size_t string;
+
+	table = string_index_table(game, index, &string, &cache);
+	if (table)
+		return string_table_lookup(table, cache, string);
+
 	snprintf(bad_string, sizeof(bad_string), "BAD_STRING(%.4x)", index);
 	return bad_string;
 }
 
+/*
+ * Returns the template for a string, or NULL if the string index is bad
+ * or unused.
+ */
+const struct string_template *string_lookup_template(struct comprehend_game *game,
+						     uint16_t index)
+{
+	struct string_table *table;
+	struct string_cache *cache;
+	size_t string;
+
+	table = string_index_table(game, index, &string, &cache);
+	if (!table)
+		return NULL;
+
+	return string_table_lookup_template(table, cache, string);
+}
+
 const char *instr_lookup_string(struct comprehend_game *game, uint8_t index,
 				uint8_t table)
 {
@@ -16,11 +16,59 @@
 #ifndef _RECOMPREHEND_STRINGS_H
 #define _RECOMPREHEND_STRINGS_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 struct comprehend_game;
+struct string_table;
+struct string_cache;
+struct file_buf;
+struct arena;
+
+enum {
+	STRING_TOKEN_TEXT,
+	STRING_TOKEN_REPLACE_WORD,
+	STRING_TOKEN_NEWLINE,
+};
+
+struct string_token {
+	uint8_t			type;
+	bool			space;		/* Followed by a space */
+	uint32_t		offset;		/* Text tokens only */
+	uint32_t		len;
+};
+
+/* String split into tokens for printing, see string_template_compile */
+struct string_template {
+	const char		*text;
+	size_t			nr_tokens;
+	struct string_token	tokens[];
+};
+
+void string_template_split(struct string_template *tmpl, const char *text);
+size_t string_template_max_size(const char *text);
+struct string_template *string_template_compile(const char *text);
+size_t string_template_size(const struct string_template *tmpl);
+
+size_t string_cache_set_limit(size_t limit);
+void string_skip(struct file_buf *fb);
+
+void string_table_add(struct string_table *table,
+		      const struct file_buf *file, uint32_t offset);
+void string_table_trim(struct string_table *table, struct arena *arena);
+const char *string_table_lookup(const struct string_table *table,
+				struct string_cache *cache, size_t index);
+const struct string_template *
+string_table_lookup_template(const struct string_table *table,
+			     struct string_cache *cache, size_t index);
+void string_table_decode_all(const struct string_table *table,
+			     struct string_cache *cache);
+void string_cache_free(struct string_cache *cache);
 
 const char *string_lookup(struct comprehend_game *game, uint16_t index);
+const struct string_template *string_lookup_template(struct comprehend_game *game,
+						     uint16_t index);
 const char *instr_lookup_string(struct comprehend_game *game, uint8_t index,
 				uint8_t table);
 
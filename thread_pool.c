@@ -0,0 +1,169 @@
+/*
+ * This file is part of Re-Comprehend
+ *
+ * Ryan Mallon, 2015, <rmallon@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to
+ * the public domain worldwide. This software is distributed without
+ * any warranty.  You should have received a copy of the CC0 Public
+ * Domain Dedication along with this software. If not, see
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ */
+
+
+/*
+ * Small pool of worker threads used to load independent game files at
+ * the same time. Jobs must not depend on the order they are run in, any
+ * ordering of the results is done by the caller after thread_pool_wait.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "thread_pool.h"
+#include "util.h"
+
+#define MAX_THREADS	4
+
+struct thread_pool_job {
+	thread_pool_fn_t	fn;
+	void			*arg;
+	struct thread_pool_job	*next;
+};
+
+struct thread_pool {
+	pthread_t		threads[MAX_THREADS];
+	size_t			nr_threads;
+
+	pthread_mutex_t		lock;
+	pthread_cond_t		job_added;
+	pthread_cond_t		job_done;
+
+	/* Queued jobs, oldest first */
+	struct thread_pool_job	*jobs;
+	struct thread_pool_job	**jobs_tail;
+	size_t			nr_busy;
+	bool			exiting;
+};
+
+static void *thread_pool_worker(void *data)
+{
+	struct thread_pool *pool = data;
+	struct thread_pool_job *job;
+
+	pthread_mutex_lock(&pool->lock);
+	while (1) {
+		while (!pool->jobs && !pool->exiting)
+			pthread_cond_wait(&pool->job_added, &pool->lock);
+		if (!pool->jobs)
+			break;
+
+		job = pool->jobs;
+		pool->jobs = job->next;
+		if (!pool->jobs)
+			pool->jobs_tail = &pool->jobs;
+		pool->nr_busy++;
+		pthread_mutex_unlock(&pool->lock);
+
+		job->fn(job->arg);
+		free(job);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->nr_busy--;
+		if (!pool->jobs && !pool->nr_busy)
+			pthread_cond_broadcast(&pool->job_done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+struct thread_pool *thread_pool_create(void)
+{
+	struct thread_pool *pool;
+	long nr_cpus;
+	int err;
+
+	pool = xmalloc(sizeof(*pool));
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->job_added, NULL);
+	pthread_cond_init(&pool->job_done, NULL);
+	pool->jobs_tail = &pool->jobs;
+
+	nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_cpus < 1)
+		nr_cpus = 1;
+	if (nr_cpus > MAX_THREADS)
+		nr_cpus = MAX_THREADS;
+
+	for (pool->nr_threads = 0; pool->nr_threads < nr_cpus;
+	     pool->nr_threads++) {
+		err = pthread_create(&pool->threads[pool->nr_threads], NULL,
+				     thread_pool_worker, pool);
+		if (err)
+			fatal_strerror(err, "Cannot create loader thread");
+	}
+
+	return pool;
+}
+
+/*
+ * Queue a job to be run by one of the pool's threads. If pool is NULL
+ * then the job is run immediately instead.
+ */
+void thread_pool_add(struct thread_pool *pool, thread_pool_fn_t fn, void *arg)
+{
+	struct thread_pool_job *job;
+
+	if (!pool) {
+		fn(arg);
+		return;
+	}
+
+	job = xmalloc(sizeof(*job));
+	job->fn = fn;
+	job->arg = arg;
+
+	pthread_mutex_lock(&pool->lock);
+	*pool->jobs_tail = job;
+	pool->jobs_tail = &job->next;
+	pthread_cond_signal(&pool->job_added);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Wait until every job added to the pool has finished.
+ */
+void thread_pool_wait(struct thread_pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	while (pool->jobs || pool->nr_busy)
+		pthread_cond_wait(&pool->job_done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Finish any remaining jobs and stop the worker threads.
+ */
+void thread_pool_free(struct thread_pool *pool)
+{
+	size_t i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->exiting = true;
+	pthread_cond_broadcast(&pool->job_added);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->nr_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_cond_destroy(&pool->job_added);
+	pthread_cond_destroy(&pool->job_done);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
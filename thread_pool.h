@@ -0,0 +1,29 @@
+/*
+ * This file is part of Re-Comprehend
+ *
+ * Ryan Mallon, 2015, <rmallon@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to
+ * the public domain worldwide. This software is distributed without
+ * any warranty.  You should have received a copy of the CC0 Public
+ * Domain Dedication along with this software. If not, see
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ */
+
+
+#ifndef _RECOMPREHEND_THREAD_POOL_H
+#define _RECOMPREHEND_THREAD_POOL_H
+
+struct thread_pool;
+
+typedef void (*thread_pool_fn_t)(void *arg);
+
+struct thread_pool *thread_pool_create(void);
+void thread_pool_add(struct thread_pool *pool, thread_pool_fn_t fn, void *arg);
+void thread_pool_wait(struct thread_pool *pool);
+void thread_pool_free(struct thread_pool *pool);
+
+#endif /* _RECOMPREHEND_THREAD_POOL_H */
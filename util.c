@@ -21,7 +21,7 @@
 
 #include "util.h"
 
-static unsigned debug_flags;
+unsigned debug_flags;
 
 void __fatal_error(const char *func, unsigned line, const char *fmt, ...)
 {
@@ -62,6 +62,42 @@ void *xmalloc(size_t size)
 	return p;
 }
 
+void *xrealloc(void *ptr, size_t size)
+{
+	void *p;
+
+	p = realloc(ptr, size);
+	if (!p)
+		fatal_error("Out of memory");
+
+	return p;
+}
+
+/*
+ * Make sure that a dynamically sized array has room for at least nr_entries.
+ * The array is grown geometrically so that appending one entry at a time is
+ * cheap, and any newly allocated entries are zeroed.
+ */
+void *grow_array(void *array, size_t *nr_allocated, size_t nr_entries,
+		 size_t entry_size)
+{
+	size_t new_size;
+
+	if (nr_entries <= *nr_allocated)
+		return array;
+
+	new_size = *nr_allocated ? *nr_allocated : 16;
+	while (new_size < nr_entries)
+		new_size *= 2;
+
+	array = xrealloc(array, new_size * entry_size);
+	memset((char *)array + (*nr_allocated * entry_size), 0,
+	       (new_size - *nr_allocated) * entry_size);
+	*nr_allocated = new_size;
+
+	return array;
+}
+
 char *xstrndup(const char *str, size_t len)
 {
 	char *p;
@@ -72,14 +108,27 @@ char *xstrndup(const char *str, size_t len)
 	return p;
 }
 
-void debug_printf(unsigned flags, const char *fmt, ...)
+/* FNV-1a, continuing from hash. Start with FNV_OFFSET_BASIS. */
+uint64_t hash_data(uint64_t hash, const void *data, size_t size)
 {
-	va_list args;
+	const uint8_t *p = data;
+	size_t i;
 
-	if (debug_flags & flags) {
-		va_start(args, fmt);
-		vprintf(fmt, args);
+	for (i = 0; i < size; i++) {
+		hash ^= p[i];
+		hash *= FNV_PRIME;
 	}
+
+	return hash;
+}
+
+void __debug_printf(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vprintf(fmt, args);
+	va_end(args);
 }
 
 void debug_enable(unsigned flags)
@@ -91,9 +140,3 @@ void debug_disable(unsigned flags)
 {
 	debug_flags &= ~flags;
 }
-
-bool debugging_enabled(void)
-{
-	// FIXME
-	return debug_flags;
-}
@@ -17,6 +17,7 @@
 #define _RECOMPREHEND_UTIL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #define DEBUG_IMAGE_DRAW	(1 << 0)
@@ -34,11 +35,36 @@
 void __fatal_error(const char *func, unsigned line, const char *fmt, ...);
 void fatal_strerror(int err, const char *fmt, ...);
 void *xmalloc(size_t size);
+void *xrealloc(void *ptr, size_t size);
+void *grow_array(void *array, size_t *nr_allocated, size_t nr_entries,
+		 size_t entry_size);
 char *xstrndup(const char *str, size_t size);
 
-void debug_printf(unsigned flags, const char *fmt, ...);
+#define FNV_OFFSET_BASIS	0xcbf29ce484222325ULL
+#define FNV_PRIME		0x100000001b3ULL
+
+uint64_t hash_data(uint64_t hash, const void *data, size_t size);
+
+extern unsigned debug_flags;
+
+/*
+ * The arguments are only evaluated if one of the given debug flags is
+ * enabled, so debug messages cost a single test when debugging is off.
+ */
+#define debug_printf(flags, fmt, args...)			\
+	do {							\
+		if (debug_flags & (flags))			\
+			__debug_printf(fmt, ##args);		\
+	} while (0)
+
+void __debug_printf(const char *fmt, ...)
+	__attribute__((format(printf, 1, 2)));
 void debug_enable(unsigned flags);
 void debug_disable(unsigned flags);
-bool debugging_enabled(void);
+
+static inline bool debugging_enabled(void)
+{
+	return debug_flags != 0;
+}
 
 #endif /* _RECOMPREHEND_UTIL_H */